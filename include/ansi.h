@@ -0,0 +1,118 @@
+/*! \file
+ * \noop Copyright 2026 Christoph Raitzig
+ *
+ * \brief Formatting ANSI escape sequences into a buffer.
+ *
+ * Colored output consists mostly of escape sequences with small decimal numbers.
+ * These functions write them into a line buffer without going through printf, every function returns the new end of the buffer.
+ * The caller has to make sure the buffer is large enough, #ANSI_CELL_MAX bytes per character are always sufficient.
+ *
+ * Instead of writing a fresh escape sequence for every character, the output keeps track of the "select graphic rendition" (SGR) state of the terminal in an #ansi_state.
+ * ansi_transition() only writes the parameters that differ between two states, so characters with the same quantized color need no escape sequence at all.
+ *
+ * \author Christoph Raitzig
+ * \copyright Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#ifndef INC_JP2A_ANSI_H
+#define INC_JP2A_ANSI_H
+
+#include "config.h"
+
+#include <limits.h>
+
+//! color of an #ansi_state that is the terminal's default color
+#define ANSI_DEFAULT -1
+//! longest escape sequence written by ansi_transition(): reset, bold, a true color foreground and background
+#define ANSI_ESCAPE_MAX 48
+//! maximum number of bytes a single character of colored output takes: an escape sequence and the character itself
+#define ANSI_CELL_MAX (ANSI_ESCAPE_MAX + MB_LEN_MAX)
+//! longest escape sequence written by ansi_cursor()
+#define ANSI_CURSOR_MAX 12
+
+/*! \struct ansi_state
+ * \brief Graphic rendition state of a terminal.
+ *
+ * Colors are stored depending on the color depth: the SGR code (30 to 37 and 40 to 47) for 4 bit colors, the palette index for 8 bit colors and 0xRRGGBB for 24 bit colors.
+ */
+typedef struct ansi_state {
+	int fg; //!< foreground color or #ANSI_DEFAULT
+	int bg; //!< background color or #ANSI_DEFAULT
+	int bold; //!< true if bold (highlighted) characters are printed
+} ansi_state;
+/*!
+ * \typedef ansi_state
+ * \brief See #ansi_state
+ */
+
+/*!
+ * \brief Sets a state to the terminal defaults, i. e. the state after `ESC [ 0 m`.
+ *
+ * \param state the state
+ */
+void ansi_state_reset(ansi_state *state);
+
+/*!
+ * \brief Writes a non-negative number in decimal.
+ *
+ * \param p where to write to
+ * \param n non-negative number
+ * \returns end of the written text
+ */
+char *ansi_decimal(char *p, int n);
+
+/*!
+ * \brief Writes a string.
+ *
+ * \param p where to write to
+ * \param s string
+ * \param length number of bytes of s to write
+ * \returns end of the written text
+ */
+char *ansi_copy(char *p, const char *s, size_t length);
+
+/*!
+ * \brief Writes a "select graphic rendition" sequence with a single parameter, e. g. `ESC [ 0 m`.
+ *
+ * \param p where to write to
+ * \param code parameter, e. g. 0 for reset or 31 for red foreground
+ * \returns end of the written text
+ */
+char *ansi_sgr(char *p, int code);
+
+/*!
+ * \brief Writes the SGR parameters for a color, e. g. `38;5;208`.
+ *
+ * \param p where to write to
+ * \param type 38 for foreground, 48 for background, not used for 4 bit colors
+ * \param color color as stored in an #ansi_state
+ * \param color_depth 4, 8 or 24
+ * \returns end of the written text
+ */
+char *ansi_color(char *p, int type, int color, int color_depth);
+
+/*!
+ * \brief Writes an escape sequence that moves the cursor, i. e. `ESC [ row ; column H`.
+ *
+ * \param p where to write to
+ * \param row line, starting with 1 at the top of the screen
+ * \param column column, starting with 1 at the left of the screen
+ * \returns end of the written text
+ */
+char *ansi_cursor(char *p, int row, int column);
+
+/*!
+ * \brief Writes a single escape sequence that changes the terminal from one state to another.
+ *
+ * Nothing is written if the states are equal.
+ * Going back to a default color or from bold to normal characters requires a reset, the other parameters of the new state are then written after it.
+ *
+ * \param p where to write to
+ * \param from current state of the terminal
+ * \param to wanted state
+ * \param color_depth 4, 8 or 24
+ * \returns end of the written text
+ */
+char *ansi_transition(char *p, const ansi_state *from, const ansi_state *to, int color_depth);
+
+#endif
@@ -12,12 +12,18 @@
 #ifndef INC_JP2A_ASPECT_RATIO_H
 #define INC_JP2A_ASPECT_RATIO_H
 
+#include "libjp2a.h"
+
 /*!
  * \brief Calculate the output width or height, but not both.
  *
+ * Starts from the requested dimensions in the context.
+ *
+ * \param ctx context
  * \param jpeg_width,jpeg_height dimensions of the input image
  * \param switch_x_y whether to switch x and y dimensions, this is the case when the stored pixels differ from the displayed pixels due to a rotation
+ * \param width,height stores the output dimensions
  */
-void aspect_ratio(const int jpeg_width, const int jpeg_height, const int switch_x_y);
+void aspect_ratio(const jp2a_context *ctx, const int jpeg_width, const int jpeg_height, const int switch_x_y, int *width, int *height);
 
 #endif
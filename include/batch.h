@@ -0,0 +1,89 @@
+/*! \file
+ * \noop Copyright 2026 Christoph Raitzig
+ *
+ * \brief Converting several images at the same time (--jobs).
+ *
+ * Worker threads convert files into memory buffers while the main thread prints the buffers in the order of the arguments.
+ * Standard input and URLs are converted by the main thread itself when it is their turn.
+ * With --verbose a thread locks stderr while it converts an image, so the messages of the images are not mixed, but the images are converted one after another.
+ *
+ * \author Christoph Raitzig
+ * \copyright Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#ifndef INC_JP2A_BATCH_H
+#define INC_JP2A_BATCH_H
+
+#include "config.h"
+
+#ifdef FEAT_THREADS
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "libjp2a.h"
+
+//! maximum number of converted but not yet printed images per worker thread
+#define BATCH_WINDOW_PER_JOB 4
+
+/*! \struct batch_task
+ * \brief One input of a batch.
+ */
+typedef struct batch_task {
+	const char *name; //!< file name, URL or - for standard input
+	int serial; //!< true if the input is converted by the main thread (standard input and URLs)
+	int done; //!< true if the conversion is finished
+	int status; //!< return value of convert_input()
+	char *output; //!< converted image
+	size_t output_size; //!< size of the converted image in bytes
+} batch_task;
+/*!
+ * \typedef batch_task
+ * \brief See #batch_task
+ */
+
+/*! \struct batch
+ * \brief State shared by the main thread and the worker threads.
+ */
+typedef struct batch {
+	const jp2a_context *ctx; //!< prepared context used by all threads
+	batch_task *tasks; //!< all inputs in the order of the arguments
+	int count; //!< number of tasks
+	int next; //!< index of the next task a worker may take
+	int written; //!< number of tasks already printed by the main thread
+	int window; //!< a worker only takes a task whose index is less than #written + #window
+	int stop; //!< true if the workers should stop taking tasks
+	pthread_mutex_t lock; //!< protects all fields above and the tasks
+	pthread_cond_t task_done; //!< signaled when a task is done
+	pthread_cond_t slot_free; //!< signaled when #written or #stop changes
+} batch;
+/*!
+ * \typedef batch
+ * \brief See #batch
+ */
+
+/*!
+ * \brief Converts all inputs given as arguments with several threads.
+ *
+ * The output is the same as converting the inputs one after another.
+ *
+ * \param ctx prepared context
+ * \param argc argument count
+ * \param argv the arguments, options are skipped
+ * \param fout stream to print the images to
+ * \param jobs number of worker threads
+ * \return 0 if all images were converted, 1 otherwise
+ */
+int convert_parallel(const jp2a_context *ctx, int argc, char **argv, FILE *fout, int jobs);
+
+/*!
+ * \brief Worker thread: takes tasks and converts them until there are none left.
+ *
+ * \param arg the #batch
+ * \return NULL
+ */
+void *batch_worker(void *arg);
+
+#endif
+
+#endif
@@ -0,0 +1,219 @@
+/*! \file
+ * \noop Copyright 2026 Christoph Raitzig
+ *
+ * \brief Keeping the output of images in a directory (--cache-dir).
+ *
+ * The output of an image file is saved in the cache directory under a name made of a hash of the file's bytes and a hash of the options that change the output (see cache_hash_options()).
+ * Converting the same file with the same options again only copies the saved output instead of decoding the image.
+ * The start and end of HTML/XHTML documents are not saved, only the image itself.
+ *
+ * The downscaled #Image is saved as well (see save_image()), under a hash of the options it depends on: the output size, --row-step, the weights and whether colors are printed (see cache_hash_image_options()).
+ * Converting the file with another palette, color depth, --invert, flips or edge threshold only prints the saved image again.
+ *
+ * The hash of a file is computed while it is decoded, so the file is only read once.
+ * It is saved under a key made of the file's device, inode, size and change times (see cache_file_key()), so when the file is converted again its hash is known without reading it.
+ * A file whose content changed without changing any of these is not detected.
+ *
+ * Only files are cached: standard input and URLs are never converted again, and videos are played with pauses between the frames.
+ * The output is written to a temporary file in the cache directory first and renamed when it is complete, so several jp2a processes can share one cache directory.
+ * Images that could not be decoded are not saved.
+ *
+ * \author Christoph Raitzig
+ * \copyright Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#ifndef INC_JP2A_CACHE_H
+#define INC_JP2A_CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "libjp2a.h"
+#include "image.h"
+
+//! initial value of a hash (the FNV-1a offset basis)
+#define CACHE_HASH_INIT 0xcbf29ce484222325ULL
+
+//! size of the buffer files are read with
+#define CACHE_BUFFER_SIZE 65536
+
+//! extension of saved outputs
+#define CACHE_OUTPUT_EXTENSION ".jp2a"
+//! extension of saved downscaled images
+#define CACHE_IMAGE_EXTENSION ".img"
+//! extension of the files that hold the hash of the content of an image file, see cache_file_key()
+#define CACHE_KEY_EXTENSION ".key"
+
+#define CACHE_MISS 0 //!< the image was decoded
+#define CACHE_HIT 1 //!< the output was saved
+#define CACHE_IMAGE_HIT 2 //!< the downscaled image was saved, the output was not
+
+/*!
+ * \brief Adds bytes to a 64-bit FNV-1a hash.
+ *
+ * \param hash the hash of the previous bytes, #CACHE_HASH_INIT for the first bytes
+ * \param data the bytes
+ * \param size number of bytes
+ * \return the hash of the previous bytes and data
+ */
+uint64_t cache_hash(uint64_t hash, const void *data, const size_t size);
+
+/*!
+ * \brief Adds the bytes read from an input stream to a hash, see input_stream_init_observed().
+ *
+ * \param data the hash, a uint64_t
+ * \param bytes the bytes that were read
+ * \param size number of bytes
+ */
+void cache_hash_observer(void *data, const void *bytes, size_t size);
+
+/*!
+ * \brief Hashes the status of a file, which changes whenever the file is written.
+ *
+ * The hash of the file's content is saved under this key, so it does not have to be read to look up its output.
+ *
+ * \param f the file
+ * \param key where to store the hash
+ * \return true if successful, false if the file is not a regular file (e.g. standard input or a named pipe)
+ */
+int cache_file_key(FILE *f, uint64_t *key);
+
+/*!
+ * \brief Hashes the options that change the output of an image.
+ *
+ * The jp2a version is part of the hash, so outputs saved by other versions are not used.
+ * Options that only change the start and end of HTML/XHTML documents or how fast the output is made (e.g. --threads) are not part of it.
+ *
+ * \param ctx prepared context
+ * \return the hash
+ */
+uint64_t cache_hash_options(const jp2a_context *ctx);
+
+/*!
+ * \brief Hashes the options that change the downscaled image.
+ *
+ * These are the options the output dimensions are calculated from, --row-step, the weights for the luminosity and whether the colors are kept.
+ * Options that are only used for printing the image (e.g. the palette, --invert, --flipx or --edge-threshold) are not part of it.
+ *
+ * \param ctx prepared context
+ * \return the hash
+ */
+uint64_t cache_hash_image_options(const jp2a_context *ctx);
+
+/*!
+ * \brief Name of a file in the cache directory.
+ *
+ * \param dir the cache directory
+ * \param input hash of the image file
+ * \param options hash of the options
+ * \param extension #CACHE_OUTPUT_EXTENSION or #CACHE_IMAGE_EXTENSION
+ * \return the allocated path, NULL if there is not enough memory
+ */
+char *cache_path(const char *dir, const uint64_t input, const uint64_t options, const char *extension);
+
+/*!
+ * \brief Name of the temporary file a file in the cache directory is written to.
+ *
+ * The name contains the process ID and the number of the cache lookup, so no other thread or process writes to it.
+ *
+ * \param path a file in the cache directory the temporary file belongs to
+ * \param lookup number of the cache lookup, see cache_count()
+ * \param extension what the temporary file is for, e.g. #CACHE_OUTPUT_EXTENSION
+ * \return the allocated path, NULL if there is not enough memory
+ */
+char *cache_temp_path(const char *path, const int lookup, const char *extension);
+
+/*!
+ * \brief Copies the rest of a file to a stream.
+ *
+ * \param from the file
+ * \param to the stream
+ * \return true if successful, false if reading failed
+ */
+int cache_copy(FILE *from, FILE *to);
+
+/*!
+ * \brief Prints a saved output.
+ *
+ * The output is read completely before it is printed, so nothing is printed if reading fails.
+ *
+ * \param path the file, see cache_path()
+ * \param fout stream to print the output to
+ * \return true if the output was printed, false if there is no such file or it could not be read
+ */
+int cache_print_output(const char *path, FILE *fout);
+
+/*!
+ * \brief Reads the hash of the content of an image file.
+ *
+ * \param path the file in the cache directory, named after the key of the image file (see cache_file_key())
+ * \param input where to store the hash
+ * \return true if the hash was read, false if the image file was not converted before
+ */
+int cache_load_input_hash(const char *path, uint64_t *input);
+
+/*!
+ * \brief Saves the hash of the content of an image file under its key.
+ *
+ * \param path the file in the cache directory, named after the key of the image file (see cache_file_key())
+ * \param temp name of the temporary file, see cache_temp_path()
+ * \param input hash of the content
+ */
+void cache_save_input_hash(const char *path, const char *temp, const uint64_t input);
+
+/*!
+ * \brief Closes a temporary file and renames it to its name in the cache directory.
+ *
+ * The temporary file is removed instead if it should not be kept, is empty or could not be written.
+ *
+ * \param f the temporary file
+ * \param temp name of the temporary file, see cache_temp_path()
+ * \param path name of the file in the cache directory
+ * \param keep true if the file is complete, false if it should be removed (e.g. because the image could not be decoded)
+ */
+void cache_close(FILE *f, const char *temp, const char *path, const int keep);
+
+/*!
+ * \brief Counts a cache lookup for cache_print_stats().
+ *
+ * Can be called by several threads at the same time.
+ *
+ * \param result #CACHE_HIT, #CACHE_IMAGE_HIT or #CACHE_MISS
+ * \return number of cache lookups before this one
+ */
+int cache_count(const int result);
+
+/*!
+ * \brief Prints the number of cache hits and misses to stderr.
+ */
+void cache_print_stats();
+
+/*!
+ * \brief Reads a downscaled image from the cache directory.
+ *
+ * \param ctx prepared context
+ * \param path the file, see cache_path()
+ * \param image the image, has to be freed with free_image() if it was read
+ * \param err stream error messages are printed to
+ * \return true if the image was read, false if there is no matching file
+ */
+int cache_load_image(const jp2a_context *ctx, const char *path, Image *image, FILE *err);
+
+/*!
+ * \brief Prints an image file, either from the cache or by decoding it and saving the output in the cache.
+ *
+ * If only the downscaled image is in the cache it is printed without decoding the file.
+ * Otherwise the file is decoded and hashed at the same time, its output and downscaled image are saved under that hash.
+ * Does nothing and returns false if the cache can not be used for the file, the file has not been read then and has to be converted as usual.
+ *
+ * \param ctx prepared context
+ * \param dir the cache directory
+ * \param fp the image file, at its start
+ * \param fout stream to print the image to
+ * \param errors used to save errors if the image is decoded
+ * \return true if the image was printed, false otherwise
+ */
+int convert_cached(const jp2a_context *ctx, const char *dir, FILE *fp, FILE *fout, error_collector *errors);
+
+#endif
@@ -0,0 +1,120 @@
+/*! \file
+ * \noop Copyright 2026 Christoph Raitzig
+ *
+ * \brief Printing only the characters of a frame that changed.
+ *
+ * When a video is printed with the clear option every frame is printed at the same place of the screen.
+ * A #delta_grid keeps the glyph and colors of every character of the frame on the screen.
+ * For the next frame only characters that differ are printed, after moving the cursor to them with an escape sequence.
+ * If more than #jp2a_context_::redraw_threshold of the characters changed, the whole frame is printed instead.
+ *
+ * \author Christoph Raitzig
+ * \copyright Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#ifndef INC_JP2A_DELTA_H
+#define INC_JP2A_DELTA_H
+
+#include <stdio.h>
+
+#include "ansi.h"
+#include "image.h"
+#include "libjp2a.h"
+
+//! returned by delta_grid_update() if the frame can not be compared to the one on the screen
+#define DELTA_REDRAW -1
+//! up to this many unchanged characters between two changed ones are printed again instead of moving the cursor
+#define DELTA_GAP_MAX 4
+
+/*! \struct delta_cell
+ * \brief A character on the screen.
+ */
+typedef struct delta_cell {
+	ansi_state state; //!< colors of the character
+	int glyph; //!< the character, see image_glyph()
+} delta_cell;
+/*!
+ * \typedef delta_cell
+ * \brief See #delta_cell
+ */
+
+/*! \struct delta_grid
+ * \brief The frame on the screen and the frame to print next.
+ */
+typedef struct delta_grid {
+	int width; //!< width of the frame on the screen, 0 if there is none
+	int height; //!< height of the frame on the screen, 0 if there is none
+	delta_cell *cells; //!< characters of the frame on the screen
+	delta_cell *next; //!< characters of the frame to print next
+	size_t allocated; //!< number of cells allocated for #cells and #next
+	char *line; //!< buffer for the output of one line
+	size_t line_size; //!< size of #line
+} delta_grid;
+/*!
+ * \typedef delta_grid
+ * \brief See #delta_grid
+ */
+
+/*!
+ * \brief Checks whether frames can be printed over the previous one.
+ *
+ * \param ctx context
+ * \return true for terminal output with the clear option, unless all frames are dumped
+ */
+int uses_delta(const jp2a_context *ctx);
+
+/*!
+ * \brief Initializes a grid without a frame on the screen.
+ *
+ * \param grid the grid
+ */
+void delta_grid_init(delta_grid *grid);
+
+/*!
+ * \brief Frees the buffers of a grid.
+ *
+ * \param grid the grid
+ */
+void delta_grid_free(delta_grid *grid);
+
+/*!
+ * \brief Checks whether two characters look the same.
+ *
+ * \param a,b the characters
+ * \return true if glyph and colors are equal
+ */
+int delta_cell_equal(const delta_cell *a, const delta_cell *b);
+
+/*!
+ * \brief Determines the characters of the next frame and compares them to the frame on the screen.
+ *
+ * \param ctx context
+ * \param image the next frame, in display order
+ * \param chars the character palette
+ * \param grid the grid, #delta_grid::next is filled
+ * \return number of changed characters, #DELTA_REDRAW if there is no frame with the same dimensions on the screen or not enough memory
+ */
+int delta_grid_update(const jp2a_context *ctx, const Image* const image, const int chars, delta_grid *grid);
+
+/*!
+ * \brief Makes the next frame the frame on the screen.
+ *
+ * \param grid the grid
+ * \param width,height dimensions of the frame
+ */
+void delta_grid_commit(delta_grid *grid, const int width, const int height);
+
+/*!
+ * \brief Prints the characters that differ between the frame on the screen and the next frame.
+ *
+ * Afterwards the cursor is below the frame, where it is after printing the whole frame.
+ *
+ * \param ctx context
+ * \param image the next frame
+ * \param grid the grid after delta_grid_update()
+ * \param f the stream to print to
+ * \return true if successful, false if there was not enough memory
+ */
+int print_image_delta(const jp2a_context *ctx, const Image* const image, delta_grid *grid, FILE *f);
+
+#endif
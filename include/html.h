@@ -12,13 +12,21 @@
 
 #include "config.h"
 
+#include <stdio.h>
+
+#include "libjp2a.h"
+
+//! background color passed to print_html_span_start() if only the foreground is colored
+#define HTML_NO_COLOR -1
+
 /*!
  * \brief Prints the start of a HTML document.
  *
+ * \param ctx context
  * \param fontsize font size
  * \param fout stream to print to
  */
-void print_html_document_start(const int fontsize, FILE *fout);
+void print_html_document_start(const jp2a_context *ctx, const int fontsize, FILE *fout);
 
 /*!
  * \brief Prints the start of a HTML image.
@@ -40,33 +48,43 @@ void print_html_document_end(FILE *fout);
  * \param f stream to print to
  */
 void print_html_image_end(FILE *f);
-#if ASCII
 
 /*!
- * \brief Prints a char of the output image for HTML.
+ * \brief Starts a span of characters with the same color for HTML and XHTML.
  *
+ * With jp2a_context_::html_classes the colors are indices into the 256 color palette and refer to CSS classes printed by print_css(), otherwise they are 0xRRGGBB values.
+ *
+ * \param ctx context
  * \param fout stream to print to
- * \param ch char to print
- * \param red_fg,green_fg,blue_fg foreground color
- * \param red_bg,green_bg,blue_bg background color
+ * \param fg foreground color
+ * \param bg background color or #HTML_NO_COLOR
  */
-void print_html_char(FILE *fout, const char ch,
-	const int red_fg, const int green_fg, const int blue_fg,
-	const int red_bg, const int green_bg, const int blue_bg);
-#else
+void print_html_span_start(const jp2a_context *ctx, FILE *fout, const int fg, const int bg);
 
 /*!
- * \brief Prints a char of the output image for HTML.
+ * \brief Ends a span started with print_html_span_start().
  *
  * \param fout stream to print to
- * \param ch char to print
- * \param red_fg,green_fg,blue_fg foreground color
- * \param red_bg,green_bg,blue_bg background color
  */
-void print_html_char(FILE *fout, const char* ch,
-	const int red_fg, const int green_fg, const int blue_fg,
-	const int red_bg, const int green_bg, const int blue_bg);
-#endif
+void print_html_span_end(FILE *fout);
+
+/*!
+ * \brief Finds the closest color of the 256 color palette for --html-classes.
+ *
+ * Only the color cube and the gray ramp (16 to 255) are used, the first 16 colors differ between terminals.
+ *
+ * \param rgb color as 0xRRGGBB
+ * \return palette index between 16 and 255
+ */
+int html_palette_index(const int rgb);
+
+/*!
+ * \brief Returns a color of the 256 color palette.
+ *
+ * \param index palette index between 16 and 255
+ * \return color as 0xRRGGBB
+ */
+int html_palette_color(const int index);
 
 /*!
  * \brief Prints a new line (for HTML, i.e. "<br>").
@@ -78,10 +96,11 @@ void print_html_newline(FILE *fout);
 /*!
  * \brief Prints the start of a XHTML document.
  *
+ * \param ctx context
  * \param fontsize font size
  * \param fout stream to print to
  */
-void print_xhtml_document_start(const int fontsize, FILE *fout);
+void print_xhtml_document_start(const jp2a_context *ctx, const int fontsize, FILE *fout);
 
 /*!
  * \brief Prints the start of a XHTML image.
@@ -103,34 +122,6 @@ void print_xhtml_document_end(FILE *fout);
  * \param f stream to print to
  */
 void print_xhtml_image_end(FILE *f);
-#if ASCII
-
-/*!
- * \brief Prints a char of the output image for XHTML.
- *
- * \param fout stream to print to
- * \param ch char to print
- * \param red_fg,green_fg,blue_fg foreground color
- * \param red_bg,green_bg,blue_bg background color
- */
-void print_xhtml_char(FILE *fout, const char ch,
-	const int red_fg, const int green_fg, const int blue_fg,
-	const int red_bg, const int green_bg, const int blue_bg);
-#else
-
-/*!
- * \brief Prints a char of the output image for XHTML.
- *
- * \param fout stream to print to
- * \param ch char to print
- * \param red_fg,green_fg,blue_fg foreground color
- * \param red_bg,green_bg,blue_bg background color
- */
-void print_xhtml_char(FILE *fout, const char* ch,
-	const int red_fg, const int green_fg, const int blue_fg,
-	const int red_bg, const int green_bg, const int blue_bg);
-#endif
-
 /*!
  * \brief Prints a new line (for XHTML, i.e. "<br/>").
  *
@@ -164,18 +155,22 @@ const char* html_entity(const char* ch);
 /*!
  * \brief Prints the CSS for a HTML/XHTML document.
  *
+ * With jp2a_context_::html_classes this includes a class for every color of the palette used by print_html_span_start().
+ *
+ * \param ctx context
  * \param fontsize font size
  * \param f stream to print to
  */
-void print_css(const int fontsize, FILE *f);
+void print_css(const jp2a_context *ctx, const int fontsize, FILE *f);
 
 /*!
  * \brief Escapes the title as necesary.
  *
- * Takes the title in #html_title_raw and escapes chars to HTML entities as necessary and saves the resulting title in #html_title.
+ * Takes the title in jp2a_context_::html_title_raw and escapes chars to HTML entities as necessary and saves the resulting title in jp2a_context_::html_title.
  *
+ * \param ctx context
  * \return true if successful, false otherwise
  */
-int escape_title();
+int escape_title(jp2a_context *ctx);
 
 #endif
@@ -4,11 +4,11 @@
  *
  * \brief Functions that work directly with images.
  *
- * Call decompress_jpeg() or decompress_png() to read an input image from a stream and print it.
- * Which is called does not matter in regards to functionality, if decompress_jpeg() fails decompress_png() is called and vice versa.
- * For efficiency call the function that is most likely to work.
+ * Call decompress_stream() to read an input image from a stream and print it.
+ * It determines the image format from the first bytes of the stream and calls decompress_jpeg(), decompress_png() or decompress_webp() once.
+ * Streams with several frames are handled by the functions in video.h.
  *
- * All other functions in this file are called by decompress_jpeg() or decompress_png() or one of the functions they call.
+ * All other functions in this file are called by these functions or one of the functions they call.
  *
  * \author Christian Stigen Larsen
  * \author Christoph Raitzig
@@ -29,9 +29,29 @@
 #include "jpeglib.h"
 #include "png.h"
 #include "webp/decode.h"
+#include <libexif/exif-data.h>
 #include <setjmp.h>
 
+#include "ansi.h"
 #include "html.h"
+#include "libjp2a.h"
+#include "resample.h"
+#include "stream.h"
+
+//! the gradient magnitude of luminosities between 0 and 1 is at most sqrt(2), edge thresholds above this never draw edges
+#define EDGE_MAGNITUDE_MAX 2.0f
+#define EDGE_BELOW_THRESHOLD -2 //!< value in Image_::edges if the gradient is below the edge threshold
+#define EDGE_NONE -1 //!< value in Image_::edges if the gradient equals the edge threshold, or no edges are used at all
+//! glyphs (see image_glyph()) from this number on are directional characters for edges, lower glyphs are indexes into the character palette
+#define GLYPH_EDGE ASCII_PALETTE_SIZE
+//! value of a fully bright or opaque channel of an #Image: the channels are 8-bit values with 8 fractional bits
+#define IMAGE_ONE 65280
+//! converts a channel of an #Image to a float between 0 and 1
+#define IMAGE_FLOAT(v) ((float) (v) / (float) IMAGE_ONE)
+//! first bytes of an image saved with save_image()
+#define IMAGE_FILE_MAGIC "jp2aimg"
+//! version of the format of save_image(), change it when the format or the meaning of the pixels changes
+#define IMAGE_FILE_VERSION 1
 
 /*! \enum Orientation
  * \brief Image orientation
@@ -52,7 +72,10 @@ typedef enum {
 /*! \struct Image_
  * \brief Holds a decompressed image.
  *
- * #pixel, #red, #green, #blue, #alpha and #yadds are arrays of size #width * #height.
+ * #pixel is an array of size #width * #height, #rgba of size #channels * #width * #height.
+ * #rgba only holds what the output uses: red, green and blue if colors are printed (not with grayscale output), and the opacity if the source image has an alpha channel.
+ * Without an alpha channel all pixels are opaque, see image_opacity().
+ * All channels are fixed-point numbers from 0 to #IMAGE_ONE.
  */
 typedef struct Image_ {
 	int width; //!< width
@@ -61,15 +84,21 @@ typedef struct Image_ {
 	int switch_x_y; //!< whether stored x-y-dimensions differ from displayed ones due to a rotation
 	int src_width; //!< width in source orientation - differs from width if x and y dimensions are switched
 	int src_height; //!< height in source orientation - differs from height if x and y dimensions are switched
-	float *pixel; //!< luminosities (i.e. gray values)
-	float *red; //!< red part
-	float *green; //!< green part
-	float *blue; //!< blue part
-	float *alpha; //!< opacities
-	int *yadds; //!< how many scanlines were used for a pixel, used by normalize()
-	float resize_y; //!< Factor by which the output image is resized from the input image in the y dimension (height). For example for an output height of 40 and input height of 80 this equals approximately 0.5.
-	float resize_x; //!< Factor by which the output image is resized from the input image in the x dimension (width). For example for an output width of 50 and input height of 100 this equals approximately 2.0.
-	int *lookup_resx; //!< where to start and end using pixels of the input image to calculate a pixel of the output image along the x axis
+	uint16_t *pixel; //!< luminosities (i.e. gray values)
+	uint16_t *rgba; //!< red, green, blue (if #colors) and opacity (if #alpha) of every pixel one after another, NULL if #channels is 0
+	int colors; //!< true if #rgba has red, green and blue values
+	int alpha; //!< true if the last value of every pixel in #rgba is its opacity
+	int channels; //!< number of values per pixel in #rgba
+	int *lookup_resx; //!< first column of the input image used for a pixel of the output image along the x axis, lookup_resx[src_width] is #row_width
+	int lasty; //!< output line the next scanline is added to, used by resample_row()
+	int row_width; //!< number of pixels of the scanlines passed to process_scanline_jpeg() and process_scanline_png()
+	int row_height; //!< number of scanlines of the source image
+	resampler resample; //!< sums of the scanlines of the current output line
+	int allocated_width; //!< width the buffers were allocated for, see reuse_image()
+	int allocated_height; //!< height the buffers were allocated for, see reuse_image()
+	int allocated_switch_x_y; //!< #switch_x_y the buffers were allocated for, see reuse_image()
+	signed char *edges; //!< per pixel #EDGE_BELOW_THRESHOLD, #EDGE_NONE or the index of the directional character for an edge; set by compute_edges(), NULL if no edges are used
+	struct delta_grid *delta; //!< characters of the previous frame on the screen, so print_image() only has to print the changed ones; NULL to always print the whole image
 } Image;
 /*!
  * \typedef Image
@@ -82,6 +111,7 @@ typedef struct Image_ {
 typedef struct my_jpeg_error_mgr {
 	struct jpeg_error_mgr pub; //!< libjpeg's error manager
 	jmp_buf setjmp_buffer; //!< where to jump to if an error occurs
+	FILE *err; //!< stream the messages of libjpeg are printed to, see jpeg_output_message()
 } my_jpeg_error_mgr;
 /*!
  * \typedef my_jpeg_error_mgr
@@ -93,106 +123,291 @@ typedef struct my_jpeg_error_mgr {
  */
 typedef struct my_jpeg_error_mgr *my_jpeg_error_ptr;
 
-/*!
- * \brief WebP image data struct
- */
-typedef struct {
-	uint8_t* data;
-	size_t size;
-} webp_data;
-
 /*! \struct error_collector
  * \brief Contains and collects errors that occur while decompressing an image.
  *
- * With this struct decompress_jpeg(), decompress_png() and decompress_webp() can be called recursively since #jpeg_status, #png_status and #webp_status can be used to determine whether a previous call failed or not.
+ * Initialize all status fields with 0 and set the error stream, after decompressing an image decompress_failed() tells whether there was an error.
  */
 typedef struct error_collector {
+	FILE *err; //!< stream the error messages of the decoders are printed to, stderr on the command line
+	int unknown_format; //!< true if the image format could not be determined
 	my_jpeg_error_mgr *jpeg_error; //!< contains information about a JPEG decompression error
 	char *png_error_msg; //!< error message for a PNG decompression error
 	char *webp_error_msg; //!< error message for a WebP decompression error
+	char *y4m_error_msg; //!< error message for an error while reading a Y4M video
 	int jpeg_status; //!< true if an error occurred during JPEG decompression, false otherwise
 	int png_status; //!< true if an error occurred during PNG decompression, false otherwise
 	int webp_status; //!< true if an error occurred during WebP decompression, false otherwise
+	int y4m_status; //!< true if an error occurred while reading a Y4M video, false otherwise
+	int output_status; //!< true if a downscaled image from the cache could not be printed, false otherwise
 } error_collector;
 /*!
  * \typedef error_collector
  * \brief See #error_collector
  */
 
+/*!
+ * \brief Calculates the height of the top margin of an image.
+ *
+ * \param ctx context
+ * \param image Image
+ * \returns number of lines print_margin_top() prints
+ */
+int margin_top_height(const jp2a_context *ctx, const Image *image);
+
+/*!
+ * \brief Calculates the height of the bottom margin of an image.
+ *
+ * \param ctx context
+ * \param image Image
+ * \returns number of lines print_margin_bottom() prints
+ */
+int margin_bottom_height(const jp2a_context *ctx, const Image *image);
+
 /*!
  * \brief Prints the top margin of an image
  *
+ * \param ctx context
  * \param image Image
  * \param f output stream
  */
-void print_margin_top(const Image *image, FILE *f);
+void print_margin_top(const jp2a_context *ctx, const Image *image, FILE *f);
 
 /*!
  * \brief Prints the bottom margin of an image
  *
+ * \param ctx context
  * \param image Image
  * \param f output stream
  */
-void print_margin_bottom(const Image *image, FILE *f);
+void print_margin_bottom(const jp2a_context *ctx, const Image *image, FILE *f);
 
 /*!
  * \brief Prints the start margin of an image
  *
+ * \param ctx context
  * \param image Image
  * \param f output stream
  */
-void print_margin_start(const Image *image, FILE *f);
+void print_margin_start(const jp2a_context *ctx, const Image *image, FILE *f);
+
+/*!
+ * \brief Calculates the width of the left margin of an image.
+ *
+ * \param ctx context
+ * \param image Image
+ * \returns number of spaces print_margin_start() prints
+ */
+int margin_start_width(const jp2a_context *ctx, const Image *image);
 
 /*!
  * \brief Prints the top or bottom of a border around an image.
  *
  * \param width width of the output image
+ * \param f output stream
  */
-void print_border(const int width);
+void print_border(const int width, FILE *f);
 
 /*!
  * \brief Prints an image.
  *
- * Calls print_image_colors() or print_image_no_colors().
+ * Calls print_image_colors(), print_image_ansi() or print_image_no_colors().
+ * If the image has a #Image_::delta grid and only a few characters differ from the frame on the screen, print_image_delta() prints just those.
+ * If there is an image_out stream the downscaled image is saved to it with save_image() first.
+ *
+ * \param ctx context
+ * \param image the output image
+ * \param f the stream to print to
+ * \param image_out stream the downscaled image is saved to before it is printed, NULL to not save it
+ * \param err stream error messages are printed to
+ * \return true if successful, false if there was not enough memory
+ */
+int print_image(const jp2a_context *ctx, Image *image, FILE *f, FILE *image_out, FILE *err);
+
+/*!
+ * \brief Determines the character for a pixel.
+ *
+ * \param ctx context
+ * \param image the output image, in display order
+ * \param chars the character palette
+ * \param pixel_index index of the pixel
+ * \return index into the character palette or #GLYPH_EDGE plus the index of a directional character
+ */
+int image_glyph(const jp2a_context *ctx, const Image* const image, const int chars, const int pixel_index);
+
+/*!
+ * \brief Looks up the text of a glyph.
+ *
+ * \param ctx context
+ * \param glyph glyph as returned by image_glyph()
+ * \param length where to store the number of bytes of the character
+ * \return the character, not terminated
+ */
+const char *glyph_text(const jp2a_context *ctx, const int glyph, size_t *length);
+
+/*!
+ * \brief Determines the terminal colors of a pixel.
+ *
+ * Characters without a 4 bit color keep the color of the character before them, so the colors depend on the previous pixels of the line.
+ *
+ * \param ctx context
+ * \param image the output image, in display order
+ * \param pixel_index index of the pixel
+ * \param current colors left by the previous pixel of the line (reset at the start of a line), updated for the next pixel
+ * \param state where to store the colors the character is printed with
+ */
+void image_ansi_state(const jp2a_context *ctx, const Image* const image, const int pixel_index, ansi_state *current, ansi_state *state);
+
+/*!
+ * \brief Prints an image with ANSI colors to a terminal.
+ *
+ * Prints the lines with print_image_ansi_rows(), with several threads if the threads option says so (see render_rows()).
+ *
+ * \param ctx context
+ * \param image the output image
+ * \param chars the character palette
+ * \param f the stream to print to
+ * \return true if successful, false if there was not enough memory
+ */
+int print_image_ansi(const jp2a_context *ctx, const Image* const image, const int chars, FILE *f);
+
+/*!
+ * \brief Prints some lines of an image with ANSI colors to a terminal.
+ *
+ * Every line is formatted into a buffer (see ansi.h) and written with a single fwrite().
+ *
+ * \param ctx context
+ * \param image the output image
+ * \param chars the character palette
+ * \param y_begin first line
+ * \param y_end line after the last line
+ * \param f the stream to print to
+ * \return true if successful, false if there was not enough memory
+ */
+int print_image_ansi_rows(const jp2a_context *ctx, const Image* const image, const int chars, const int y_begin, const int y_end, FILE *f);
+
+/*!
+ * \brief Prints an image with color as HTML or XHTML.
+ *
+ * Prints the lines with print_image_colors_rows(), see render_rows().
  *
+ * \param ctx context
  * \param image the output image
+ * \param chars the character palette
  * \param f the stream to print to
+ * \return true if successful, false if there was not enough memory
  */
-void print_image(Image *image, FILE *f);
+int print_image_colors(const jp2a_context *ctx, const Image* const image, const int chars, FILE *f);
 
 /*!
- * \brief Prints an image with color.
+ * \brief Prints some lines of an image with color as HTML or XHTML.
  *
+ * \param ctx context
  * \param image the output image
  * \param chars the character palette
+ * \param y_begin first line
+ * \param y_end line after the last line
  * \param f the stream to print to
+ * \return true if successful, false if there was not enough memory
  */
-void print_image_colors(const Image* const image, const int chars, FILE *f);
+int print_image_colors_rows(const jp2a_context *ctx, const Image* const image, const int chars, const int y_begin, const int y_end, FILE *f);
 
 /*!
  * \brief Prints an image without color.
  *
+ * Prints the lines with print_image_no_colors_rows(), see render_rows().
+ *
+ * \param ctx context
  * \param image the output image
  * \param chars the character palette
  * \param f the stream to print to
+ * \return true if successful, false if there was not enough memory
  */
-void print_image_no_colors(const Image* const image, const int chars, FILE *f);
+int print_image_no_colors(const jp2a_context *ctx, const Image* const image, const int chars, FILE *f);
+
+/*!
+ * \brief Prints some lines of an image without color.
+ *
+ * \param ctx context
+ * \param image the output image
+ * \param chars the character palette
+ * \param y_begin first line
+ * \param y_end line after the last line
+ * \param f the stream to print to
+ * \return true if successful, false if there was not enough memory
+ */
+int print_image_no_colors_rows(const jp2a_context *ctx, const Image* const image, const int chars, const int y_begin, const int y_end, FILE *f);
+
+/*!
+ * \brief Opacity of a pixel.
+ *
+ * \param image the image
+ * \param pixel_index index of the pixel
+ * \return the opacity from 0 to #IMAGE_ONE, #IMAGE_ONE if the image has no alpha channel
+ */
+uint16_t image_opacity(const Image* const image, const int pixel_index);
 
 /*!
  * \brief Clears the image (i.e. sets all pixels to black, alpha to max)
  *
+ * \param ctx context
  * \param i the image
  */
-void clear(Image* i);
+void clear(const jp2a_context *ctx, Image* i);
 
 /*!
  * \brief Normalizes the image.
  *
- * After decompressing the image into RAM the G/RGB values must not be between 0 and 1. The functions normalizes them so that they are.
+ * Writes the output line the last scanlines were added to, see resample_finish().
+ * Afterwards all G/RGB values are between 0 and 1.
+ *
+ * \param ctx context
+ * \param i the image
+ */
+void normalize(const jp2a_context *ctx, Image* i);
+
+/*!
+ * \brief Puts the pixels of a normalized image into display order.
+ *
+ * Applies the orientation and the --flipx and --flipy options once, so that pixel (x, y) of the output is at index y * width + x of every buffer.
+ * Afterwards the image has no orientation and its source dimensions equal its display dimensions.
+ *
+ * \param ctx context
+ * \param i the image
+ * \returns true on success, false if there is not enough memory
+ */
+int orient_image(const jp2a_context *ctx, Image* i);
+
+/*!
+ * \brief Checks whether the edge gradient matters for the output.
+ *
+ * \param ctx context
+ * \returns true if --edges-only is given or --edge-threshold is low enough for edges to be drawn
+ */
+int uses_edges(const jp2a_context *ctx);
+
+/*!
+ * \brief Precomputes the edges of an image in display order.
+ *
+ * Does nothing if uses_edges() is false, so the image is printed without any gradient calculations.
+ * Must be called after orient_image().
+ * The lines are split between several threads if the threads option says so, see render_edges().
  *
+ * \param ctx context
  * \param i the image
+ * \returns true on success, false if there is not enough memory
  */
-void normalize(Image* i);
+int compute_edges(const jp2a_context *ctx, Image* i);
+
+/*!
+ * \brief Computes the edges of some lines of an image.
+ *
+ * \param ctx context
+ * \param i the image, with an allocated #Image_::edges buffer
+ * \param y_begin first line
+ * \param y_end line after the last line
+ */
+void compute_edges_rows(const jp2a_context *ctx, const Image* const i, const int y_begin, const int y_end);
 
 /*!
  * \brief Prints a progress bar.
@@ -204,48 +419,91 @@ void print_progress(float progress);
 /*!
  * \brief Prints some information about the image and how it will be printed.
  *
+ * \param ctx context
  * \param jpg contains information about the JPEG image
  * \param orientation image orientation (read from Exif metadata)
+ * \param width,height output dimensions
  */
-void print_info_jpeg(const struct jpeg_decompress_struct* jpg, const Orientation orientation);
+void print_info_jpeg(const jp2a_context *ctx, const struct jpeg_decompress_struct* jpg, const Orientation orientation, const int width, const int height);
 
 /*!
  * \brief Prints some information about the image and how it will be printed.
  *
+ * \param ctx context
  * \param png_ptr necessary for calling libpng functions
  * \param info_ptr contains information about the PNG image
+ * \param width,height output dimensions
  */
-void print_info_png(const png_structp png_ptr, const png_infop info_ptr);
+void print_info_png(const jp2a_context *ctx, const png_structp png_ptr, const png_infop info_ptr, const int width, const int height);
 
 
 /*!
  * \brief Prints some information about the image and how it will be printed.
  *
+ * \param ctx context
  * \param config WebP decoding information
+ * \param width,height output dimensions
  */
-void print_info_webp(WebPDecoderConfig* config);
+void print_info_webp(const jp2a_context *ctx, WebPDecoderConfig* config, const int width, const int height);
 
 /*!
  * \brief Processes a scanline of a JPEG image.
  *
+ * Passes the scanline to resample_row().
+ *
+ * \param ctx context
  * \param jpg contains information about the JPEG image
- * \param scanline the scanline
+ * \param scanline the scanline, JSAMPLE values for 8-bit images and J12SAMPLE values for 12-bit images
  * \param i the output image
  */
-void process_scanline_jpeg(const struct jpeg_decompress_struct *jpg,
-	const JSAMPLE* scanline, Image* i);
+void process_scanline_jpeg(const jp2a_context *ctx, const struct jpeg_decompress_struct *jpg,
+	const void* scanline, Image* i);
+
+/*!
+ * \brief Reads the next scanline of a JPEG image.
+ *
+ * 12-bit images are read with jpeg12_read_scanlines() if libjpeg provides it (libjpeg-turbo 3).
+ *
+ * \param jpg the decompressor
+ * \param buffer room for one scanline, see process_scanline_jpeg()
+ */
+void read_jpeg_scanline(struct jpeg_decompress_struct *jpg, JSAMPARRAY buffer);
+
+#ifdef HAVE_JPEG_SKIP_SCANLINES
+/*!
+ * \brief Skips scanlines of a JPEG image without decoding them completely.
+ *
+ * 12-bit images are skipped with jpeg12_skip_scanlines() if libjpeg provides it (libjpeg-turbo 3).
+ *
+ * \param jpg the decompressor
+ * \param lines number of scanlines to skip
+ */
+void skip_jpeg_scanlines(struct jpeg_decompress_struct *jpg, const int lines);
+#endif
+
+/*!
+ * \brief Layout of the pixels of a PNG scanline.
+ *
+ * \param color_components the number of color components: 1 for G, 2 for GA, 3 for RGB and 4 for RGBA
+ * \param bit_depth 8 or 16
+ * \param format where to store the layout
+ */
+void png_resample_format(const int color_components, const int bit_depth, resample_format *format);
 
 /*!
  * \brief Processes a scanline of a PNG image.
  *
  * Supports a bit-depth of 8 and G, GA, RGB and RGBA.
+ * Passes the row to resample_row().
+ * Also used for WebP images and Y4M frames.
  *
+ * \param ctx context
  * \param row scanline (i.e. the row of pixels)
  * \param current_y the current height
  * \param color_components the number of color components (e.g. 4 for RGBA)
  * \param i the output image
  */
-void process_scanline_png(const png_bytep row, const int current_y, const int color_components, Image* i);
+void process_scanline_png(const jp2a_context *ctx, const png_bytep row, const int current_y, const int color_components, Image* i);
 
 /*!
  * \brief Frees allocated memory of an image.
@@ -257,42 +515,202 @@ void free_image(Image* i);
 /*!
  * \brief Allocates memory for holding the pixels etc. Sets the width and height.
  *
+ * Only allocates the channels the output uses (see #Image_::rgba).
+ * Prints an error message if there is not enough memory.
+ *
+ * \param ctx context
  * \param i the image
+ * \param width,height output dimensions
  * \param switch_x_y whether to switch x and y dimensions, this is the case when the stored pixels differ from the displayed pixels due to a rotation
+ * \param alpha whether the source image has an alpha channel
+ * \param err stream error messages are printed to
+ * \return true if successful, false otherwise
  */
-void malloc_image(Image* i, int switch_x_y);
+int malloc_image(const jp2a_context *ctx, Image* i, const int width, const int height, int switch_x_y, const int alpha, FILE *err);
+
+/*!
+ * \brief Saves a downscaled image, so it can be printed again with other options without decoding it.
+ *
+ * Saves the dimensions, the orientation and the #Image_::pixel and #Image_::rgba buffers as they are after normalize() and before orient_image().
+ * The values are in the byte order of the processor.
+ *
+ * \param i the image, after normalize()
+ * \param f the stream to save it to
+ * \return true if successful, false if writing failed
+ */
+int save_image(const Image* i, FILE *f);
+
+/*!
+ * \brief Reads an image saved with save_image().
+ *
+ * Afterwards the image can be passed to print_image() and has to be freed with free_image().
+ *
+ * \param ctx context, the image is only read if it has the channels the output uses
+ * \param i the image, its buffers are allocated
+ * \param f the stream to read it from
+ * \param err stream error messages are printed to
+ * \return true if successful, false if the stream does not contain a matching image or there is not enough memory
+ */
+int load_image(const jp2a_context *ctx, Image* i, FILE *f, FILE *err);
+
+/*!
+ * \brief Initializes an image without any buffers.
+ *
+ * Use this for images that are passed to reuse_image().
+ *
+ * \param i the image
+ */
+void empty_image(Image* i);
+
+/*!
+ * \brief Makes sure an image has buffers for the given dimensions.
+ *
+ * Keeps the buffers if they were allocated for the same dimensions before, so a sequence of frames does not allocate memory for every frame.
+ * Otherwise the old buffers are freed and new ones are allocated with malloc_image().
+ * The #Image_::delta grid is kept in both cases.
+ *
+ * \param ctx context
+ * \param i the image, initialized with empty_image() or malloc_image()
+ * \param width,height output dimensions
+ * \param switch_x_y whether to switch x and y dimensions
+ * \param alpha whether the source image has an alpha channel
+ * \param err stream error messages are printed to
+ * \return true if successful, false otherwise
+ */
+int reuse_image(const jp2a_context *ctx, Image* i, const int width, const int height, int switch_x_y, const int alpha, FILE *err);
 
 /*!
  * \brief Sets internal values necessary for processing scanlines.
  *
+ * Prints an error message if there is not enough memory for the sums of a scanline.
+ *
  * \param i the struct to hold the output image
  * \param src_width width of the source image
  * \param src_height height of the source image
+ * \param wide true if the scanlines have 16-bit samples (16-bit PNG and 12-bit JPEG images)
+ * \param err stream error messages are printed to
+ * \return true if successful, false otherwise
  */
-void init_image(Image *i, int src_width, int src_height);
+int init_image(Image *i, int src_width, int src_height, const int wide, FILE *err);
 
 /*!
- * \brief Get the image orientation
+ * \brief Get the image orientation from the Exif marker of a JPEG image.
  *
- * Determine the image orientation from EXIF metadata.
+ * The APP1 marker has to be saved with jpeg_save_markers() before jpeg_read_header() is called.
+ * This way the orientation is known after reading the header and the image is only read once.
  *
- * Rewinds the file.
+ * \param jpg the decompressor after jpeg_read_header()
+ * \return the orientation, #HORIZONTAL if there is no Exif marker
+ */
+Orientation get_orientation_jpeg(const struct jpeg_decompress_struct *jpg);
+
+/*!
+ * \brief Get the image orientation from Exif data.
  *
- * \param imageFP image file pointer
+ * \param edata Exif data (may be NULL)
+ * \return the orientation, #HORIZONTAL if the orientation tag is missing
  */
-Orientation get_orientation(FILE *imageFP);
+Orientation get_orientation_exif(ExifData *edata);
+
+/*!
+ * \brief Lets libjpeg downscale a JPEG image while decompressing it.
+ *
+ * Chooses the largest reduction (1/2, 1/4 or 1/8) for which the decompressed image still has at least as many pixels as the output in both directions.
+ * The downscaling is done in the IDCT, which is much faster than decompressing at full size and averaging afterwards.
+ * Must be called after jpeg_read_header() and before jpeg_start_decompress().
+ *
+ * \param jpg the decompressor
+ * \param width,height output dimensions
+ * \param switch_x_y true if the image is rotated by 90 or 270 degrees
+ */
+void set_jpeg_scale(struct jpeg_decompress_struct *jpg, const int width, const int height, const int switch_x_y);
+
+/*!
+ * \brief Returns the frequencies the IDCT of libjpeg uses in one direction when it decompresses a block to the given size.
+ *
+ * \param scaled_size number of pixels per block in that direction (DCT_h_scaled_size, DCT_v_scaled_size or DCT_scaled_size)
+ * \return bit mask with bit i set if the frequency i (0 to 7) is used
+ */
+int jpeg_idct_frequencies(const int scaled_size);
+
+/*!
+ * \brief Checks whether a progressive JPEG image has all coefficients its IDCT uses at the chosen scale.
+ *
+ * A component that is decompressed to one pixel per block (scale 1/8 without chroma subsampling) only needs the DC coefficient,
+ * at 2 or 4 pixels per block the highest frequencies are not needed (see jpeg_idct_frequencies()).
+ * Only valid between two scans, libjpeg updates the progression status when a scan starts.
+ *
+ * \param jpg the decompressor after jpeg_start_decompress()
+ * \return true if no scan (or refinement of one) that changes the output is missing, false for a sequential image whose coefficients libjpeg does not track
+ */
+int jpeg_scans_complete(const struct jpeg_decompress_struct *jpg);
+
+/*!
+ * \brief Reads the scans of a progressive JPEG image until the remaining ones do not change the output.
+ *
+ * At scale 1/8 libjpeg computes the luminance from the DC coefficients only, so the luminance AC scans (the largest part of most progressive images) can be skipped.
+ * Grayscale images and images without chroma subsampling only need their DC scans.
+ * At scales 1/4 and 1/2 only scans that refine the highest frequencies can be skipped.
+ * The image has to be decompressed in buffered image mode.
+ *
+ * \param jpg the decompressor after jpeg_start_decompress()
+ * \return number of the last scan read, for jpeg_start_output()
+ */
+int consume_jpeg_scans(struct jpeg_decompress_struct *jpg);
+
+/*!
+ * \brief Decompresses and prints the next image of a JPEG decompressor.
+ *
+ * Reads the header, decodes the image into the given #Image and prints it.
+ * Downscaled progressive images are only read until the remaining scans do not change the output (see consume_jpeg_scans()), the rest of the image is skipped.
+ * After jpeg_finish_decompress() libjpeg keeps any data that was read beyond the image, so calling this again decodes the next image of a Motion JPEG stream.
+ * Errors in the image data longjmp to the decompressor's error handler.
+ *
+ * \param ctx context
+ * \param jpg decompressor with a source and error handler
+ * \param image image whose buffers are reused, see reuse_image()
+ * \param fout stream to print the image to
+ * \param image_out stream the downscaled image is saved to, see print_image()
+ * \param err stream error messages are printed to
+ * \return true if an image was printed, false otherwise
+ */
+int decompress_jpeg_frame(const jp2a_context *ctx, struct jpeg_decompress_struct *jpg, Image *image, FILE *fout, FILE *image_out, FILE *err);
 
 /*!
  * \brief Decompresses and prints an image.
  *
- * Calls decompress_webp() if the image is not a JPEG image.
- * Instead prints errors if there was an error when decompressing this image as JPEG previously.
+ * Prints errors if the image is not a valid JPEG image.
  *
- * \param fin input stream, has to be seekable
+ * \param ctx context
+ * \param in input stream
  * \param fout stream to print the image to
- * \param errors contains previous errors and is used to save errors
+ * \param image_out stream the downscaled image is saved to, see print_image()
+ * \param errors used to save errors
+ */
+void decompress_jpeg(const jp2a_context *ctx, input_stream *in, FILE *fout, FILE *image_out, error_collector *errors);
+
+/*!
+ * \brief Callback for messages of libjpeg: prints them to the error stream of the #my_jpeg_error_mgr instead of stderr.
+ *
+ * \param jerr contains the message
+ */
+void jpeg_output_message(j_common_ptr jerr);
+
+/*!
+ * \brief Callback for errors of libpng: prints the message to the error stream of the #error_collector and jumps back.
+ *
+ * \param png_ptr PNG reader, its error pointer has to be the #error_collector
+ * \param message the message
+ */
+void png_error_handler(png_structp png_ptr, png_const_charp message);
+
+/*!
+ * \brief Callback for warnings of libpng: prints the message to the error stream of the #error_collector.
+ *
+ * \param png_ptr PNG reader, its error pointer has to be the #error_collector
+ * \param message the message
  */
-void decompress_jpeg(FILE *fin, FILE *fout, error_collector *errors);
+void png_warning_handler(png_structp png_ptr, png_const_charp message);
 
 /*!
  * \brief Callback for errors while decompressing a JPEG image.
@@ -304,40 +722,54 @@ void jpeg_error_exit(j_common_ptr jerr);
 /*!
  * \brief Decompresses and prints an image.
  *
- * Calls decompress_jpeg() if the image is not a PNG image.
- * Instead prints errors if there was an error when decompressing this image as PNG previously.
+ * Prints errors if the image is not a valid PNG image.
  *
- * \param fin input stream, has to be seekable
+ * \param ctx context
+ * \param in input stream
  * \param fout stream to print the image to
- * \param errors contains previous errors and is used to save errors
+ * \param image_out stream the downscaled image is saved to, see print_image()
+ * \param errors used to save errors
  */
-void decompress_png(FILE *fin, FILE *fout, error_collector *errors);
+void decompress_png(const jp2a_context *ctx, input_stream *in, FILE *fout, FILE *image_out, error_collector *errors);
 
 /*!
- * \brief Read WebP image into a buffer
+ * \brief Decompresses and prints an image.
+ *
+ * Prints errors if the image is not a valid WebP image.
+ *
+ * The image is fed to libwebp's incremental decoder chunk by chunk.
+ * Animated images are read completely and printed by play_webp().
  *
- * \param fp input stream
+ * \param ctx context
+ * \param in input stream
+ * \param fout stream to print the image to
+ * \param image_out stream the downscaled image is saved to, see print_image()
+ * \param errors used to save errors
  */
-webp_data* get_webp_data(FILE *fp);
+void decompress_webp(const jp2a_context *ctx, input_stream *in, FILE *fout, FILE *image_out, error_collector *errors);
 
 /*!
- * \brief Free WebP image buffer
- * 
- * \param data WebP data
+ * \brief Decompresses and prints an image, choosing the decoder by the first bytes of the stream.
+ *
+ * Prints errors if the format is unknown.
+ * With the video option a JPEG stream is played as Motion JPEG, Y4M streams are always passed to decompress_y4m().
+ * Works with streams that are not seekable (pipes, downloads), the image is never read into memory as a whole.
+ *
+ * \param ctx context
+ * \param in input stream
+ * \param fout stream to print the image to
+ * \param image_out stream the downscaled image is saved to, see print_image()
+ * \param errors used to save errors
  */
-void free_webp_data(webp_data* data);
+void decompress_stream(const jp2a_context *ctx, input_stream *in, FILE *fout, FILE *image_out, error_collector *errors);
 
 /*!
- * \brief Decompresses and prints an image.
- *
- * Calls decompress_png() if the image is not a WebP image.
- * Instead prints errors if there was an error when decompressing this image as WebP previously.
+ * \brief Checks whether decompressing an image failed.
  *
- * \param fin input stream, has to be seekable
- * \param fout stream to print the image to
- * \param errors contains previous errors and is used to save errors
+ * \param errors the collected errors
+ * \return true if there was an error
  */
-void decompress_webp(FILE *fp, FILE *fout, error_collector *errors);
+int decompress_failed(const error_collector *errors);
 
 /*!
  * \brief Prints errors.
@@ -1,8 +1,8 @@
 /*! \file
  * \noop Copyright 2006-2016 Christian Stigen Larsen
- * \noop Copyright 2020 Christoph Raitzig
+ * \noop Copyright 2020-2026 Christoph Raitzig
  *
- * \brief The main function and a helper function.
+ * \brief The main function and helper functions for converting the inputs.
  *
  * \author Christian Stigen Larsen
  * \author Christoph Raitzig
@@ -12,9 +12,9 @@
 #ifndef INC_JP2A_H
 #define INC_JP2A_H
 
-#ifdef _WIN32
-#include <windows.h>
-#endif
+#include <stdio.h>
+
+#include "libjp2a.h"
 
 /*!
  * \brief The main function.
@@ -25,34 +25,82 @@
 int main(int argc, char** argv);
 
 /*!
- * \brief Reads from a stream into a buffer.
+ * \brief Converts one input file, URL or standard input (-).
  *
- * This function is used to make a seekable stream from a non-seekable stream:
- * Read the contents of the non-seekable stream into a buffer (with this function) and open a stream to this buffer (with fmemopen()).
- * The buffer is (re)allocated as needed.
+ * If an output directory is set (see #output_dir), the image is written to its own file in that directory instead of \p fout.
  *
- * \param fp stream to read into buffer
- * \param buffer the buffer to read into
- * \param buffer_size the allocated size of the buffer
- * \param actual_size the number of bytes read into the buffer
- * \return true if sucessful, false otherwise
+ * \param ctx prepared context
+ * \param name file name, URL or - for standard input
+ * \param fout stream to print the image to
+ * \return 0 if successful, 1 if the image could not be decoded and -1 if the input or output could not be opened (jp2a stops then)
  */
-int read_into_buffer(FILE *fp, char **buffer, size_t *buffer_size, size_t *actual_size);
+int convert_input(const jp2a_context *ctx, const char *name, FILE *fout);
 
-#ifdef _WIN32
+/*! \struct output_file
+ * \brief The output file of an argument, used by check_output_files().
+ */
+typedef struct output_file {
+	char *path; //!< path of the output file, see output_file_path()
+	int arg; //!< index of the argument
+} output_file;
+/*!
+ * \typedef output_file
+ * \brief See #output_file
+ */
 
 /*!
- * \brief fmemopen alternative for Windows.
+ * \brief Path of the output file for an input in the output directory.
  *
- * Windows does not support opening a file stream to part of the RAM.
- * This function creates a temporary file and writes the contents of the buffer to it.
+ * The output file is named like the input without its extension and with .txt (or .html for HTML/XHTML output) appended.
+ * Standard input is written to stdin.txt.
+ * Prints an error message if the input has no name to use.
  *
- * \param buf data to write to the file
- * \param size number of bytes to write
- * \param mode ignored, for compatibility with the actual fmemopen()
- * \return the file handle (or NULL if an error occurred)
+ * \param ctx prepared context
+ * \param name file name, URL or - for standard input
+ * \return the allocated path or NULL if an error occurred
  */
-HANDLE fmemopen(void *buf, size_t size, const char *mode);
-#endif
+char *output_file_path(const jp2a_context *ctx, const char *name);
+
+/*!
+ * \brief Compares two output files by path and then by argument, for qsort().
+ *
+ * \param a the first #output_file
+ * \param b the second #output_file
+ * \return less than, equal to or greater than zero like strcmp()
+ */
+int compare_output_files(const void *a, const void *b);
+
+/*!
+ * \brief Checks that no two inputs are written to the same file in the output directory.
+ *
+ * Prints an error message naming both inputs otherwise.
+ *
+ * \param ctx prepared context
+ * \param argc argument count
+ * \param argv the arguments, options are skipped
+ * \return true if every input has its own output file, false otherwise
+ */
+int check_output_files(const jp2a_context *ctx, int argc, char **argv);
+
+/*!
+ * \brief Opens the output file for an input in the output directory.
+ *
+ * See output_file_path() for the name of the file.
+ *
+ * \param ctx prepared context
+ * \param name file name, URL or - for standard input
+ * \return the opened file or NULL if an error occurred
+ */
+FILE *open_output_file(const jp2a_context *ctx, const char *name);
+
+/*!
+ * \brief Finishes and closes a file opened with open_output_file().
+ *
+ * Does nothing if no output directory is used.
+ *
+ * \param ctx prepared context
+ * \param f the file to close
+ */
+void close_output_file(const jp2a_context *ctx, FILE *f);
 
 #endif
@@ -0,0 +1,144 @@
+/*! \file
+ * \noop Copyright 2006-2016 Christian Stigen Larsen
+ * \noop Copyright 2020-2026 Christoph Raitzig
+ *
+ * \brief Reentrant rendering interface (libjp2a).
+ *
+ * All options and lookup tables used for converting an image are held by a #jp2a_context instead of global variables.
+ * Initialize a context with jp2a_context_init(), change the options as needed and call jp2a_context_prepare() afterwards.
+ * jp2a_render() does not modify the context, so one prepared context can be used by several threads at the same time.
+ *
+ * \author Christian Stigen Larsen
+ * \author Christoph Raitzig
+ * \copyright Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#ifndef INC_JP2A_LIBJP2A_H
+#define INC_JP2A_LIBJP2A_H
+
+#include <stdio.h>
+#include <limits.h>
+#include <stdint.h>
+
+//! size of the ASCII palette (in chars)
+#define ASCII_PALETTE_SIZE 256
+//! default ASCII palette
+#define ASCII_PALETTE_DEFAULT "   ...',;:clodxkO0KXNWM"
+//! default title for HTML/XHTML documents
+#define HTML_DEFAULT_TITLE "jp2a converted image"
+//! default edge_threshold - very high so no edges will be drawn
+#define EDGE_THRESHOLD_DEFAULT 1000.
+//! default redraw_threshold - print a frame as a whole if more than a quarter of its characters changed
+#define REDRAW_THRESHOLD_DEFAULT 0.25f
+//! maximum number of threads that format the characters of an image
+#define JP2A_MAX_THREADS 256
+
+#define TERM_FIT_ZOOM 1 //!< stretch image to fill the terminal
+#define TERM_FIT_WIDTH 2 //!< calculate the width (based on the height)
+#define TERM_FIT_HEIGHT 3 //!< calculate the height (based on the width)
+#define TERM_FIT_AUTO 4 //!< use the largest possible dimensions while retaining the input image aspect ratio
+
+/*! \struct jp2a_context_
+ * \brief Options and lookup tables for converting images.
+ *
+ * Width and height are the requested output dimensions, the actual dimensions are calculated for every image by aspect_ratio().
+ */
+typedef struct jp2a_context_ {
+	int verbose; //!< produce verbose output
+	int debug; //!< print debug information
+	int auto_height; //!< automatically calculate the output width from the height
+	int auto_width; //!< automatically calculate the output height from the width
+	int width; //!< output width
+	int height; //!< output height
+	int use_border; //!< print a border around images
+	int invert; //!< invert output (color/gray channels, not alpha)
+	int flipx; //!< flip output along x axis
+	int flipy; //!< flip output along y axis
+	int centerx; //!< center output along the x axis
+	int centery; //!< center output along the y axis
+	int html; //!< produce HTML output
+	int xhtml; //!< produce XHTML output
+	int html_fontsize; //!< font size for HTML/XHTML output
+	int colorfill; //!< also fill the background
+	int convert_grayscale; //!< produce grayscale output
+	const char *html_title_raw; //!< HTML title
+	char *html_title; //!< HTML title with escaped HTML entities, set by jp2a_context_prepare()
+	int html_rawoutput; //!< produce only the image part and not the rest of the website
+	int html_bold; //!< use bold characters in HTML output
+	int html_classes; //!< use CSS classes for the colors of the 256 color palette instead of inline styles in HTML output
+	int clearscr; //!< clear the screen before printing an image
+	int video; //!< play streams with several frames (Motion JPEG, Y4M, animated WebP) instead of printing only one image
+	int dump_frames; //!< print all frames of a video one after another as fast as possible instead of playing it
+	float fps; //!< frames per second for video output, 0 for the rate of the video or as fast as possible
+	float redraw_threshold; //!< fraction of changed characters above which a frame of a video is printed as a whole instead of only the changed characters
+	int row_step; //!< only use every row_step-th source row of an output row, 1 to use all rows
+	int threads; //!< number of threads that format the characters of an image, 0 for one per processor, at most #JP2A_MAX_THREADS (see render.h)
+	float edge_threshold; //!< image gradient above which edges should be drawn with /-\| characters
+	int edges_only; //!< only draw edges - make sure you use it with the edge-threshold option so edges are drawn
+	int ascii_palette_length; //!< number of charactrs in the palette
+	char ascii_palette[ASCII_PALETTE_SIZE * MB_LEN_MAX + 1]; //!< the palette
+	unsigned char ascii_palette_indizes[ASCII_PALETTE_SIZE]; //!< indizes of the first byte of each char in the palette (not used with --enable-pure-ascii)
+	char ascii_palette_lengths[ASCII_PALETTE_SIZE]; //!< byte lengths of the chars in the palette (not used with --enable-pure-ascii)
+	float redweight; //!< weight for red
+	float greenweight; //!< weight for green
+	float blueweight; //!< weight for blue
+	uint32_t weights[3]; //!< red, green and blue weight with 16 fractional bits, their sum is exactly 1 (65536), set by precalc_rgb()
+	int usecolors; //!< produce colored output
+	int colorDepth; //!< output color bit depth (4 for ANSI, 8 for 256 colors, 24 for true color)
+	int termfit; //!< the way the output dimensions are calculated
+	int term_width; //!< width of the terminal
+	int term_height; //!< height of the terminal
+} jp2a_context;
+/*!
+ * \typedef jp2a_context
+ * \brief See #jp2a_context_
+ */
+
+/*!
+ * \brief Sets all options of a context to their defaults.
+ *
+ * \param ctx the context
+ */
+void jp2a_context_init(jp2a_context *ctx);
+
+/*!
+ * \brief Calculates the fixed-point weights for converting red, green and blue to luminosity.
+ *
+ * \param ctx the context, the fixed-point weights are calculated from its float weights
+ */
+void precalc_rgb(jp2a_context *ctx);
+
+/*!
+ * \brief Prepares a context for rendering.
+ *
+ * Must be called after changing options and before calling jp2a_render().
+ * Calculates the lookup tables and escapes the HTML title.
+ *
+ * \param ctx the context
+ * \return true if successful, false otherwise
+ */
+int jp2a_context_prepare(jp2a_context *ctx);
+
+/*!
+ * \brief Frees memory allocated by jp2a_context_prepare().
+ *
+ * \param ctx the context
+ */
+void jp2a_context_free(jp2a_context *ctx);
+
+/*!
+ * \brief Decompresses an image and prints it.
+ *
+ * The image format is determined from the first bytes of the stream.
+ * Only the image itself is printed, not the start and end of a HTML/XHTML document.
+ * The context is not modified, so several threads can render with the same context at the same time.
+ *
+ * \param ctx prepared context
+ * \param fin input stream, does not have to be seekable
+ * \param fout stream to print the image to
+ * \param err stream the error messages are printed to
+ * \return true if the image could be decoded and printed, false otherwise (also if there was not enough memory)
+ */
+int jp2a_render(const jp2a_context *ctx, FILE *fin, FILE *fout, FILE *err);
+
+#endif
@@ -4,6 +4,8 @@
  *
  * \brief Functions for parsing command line arguments.
  *
+ * Options that affect how images are converted are saved in a #jp2a_context, options that only concern the command line program are global variables.
+ *
  * \author Christian Stigen Larsen
  * \author Christoph Raitzig
  * \copyright Distributed under the GNU General Public License (GPL) v2.
@@ -12,63 +14,16 @@
 #ifndef INC_JP2A_OPTIONS_H
 #define INC_JP2A_OPTIONS_H
 
-//! size of the ASCII palette (in chars)
-#define ASCII_PALETTE_SIZE 256
-//! default ASCII palette
-#define ASCII_PALETTE_DEFAULT "   ...',;:clodxkO0KXNWM";
-//! default title for HTML/XHTML documents
-#define HTML_DEFAULT_TITLE "jp2a converted image"
-//! default edge_threshold - very high so no edges will be drawn
-#define EDGE_THRESHOLD_DEFAULT 1000.
+#include <stdio.h>
+
+#include "libjp2a.h"
 
-extern int verbose; //!< produce verbose output
-extern int auto_height; //!< automatically calculate the output width from the height
-extern int auto_width; //!< automatically calculate the output height from the width
-extern int width; //!< output width
-extern int height; //!< output height
-extern int use_border; //!< print a border around images
-extern int invert; //!< invert output (color/gray channels, not alpha)
-extern int flipx; //!< flip output along x axis
-extern int flipy; //!< flip output along y axis
-extern int centerx; //!< center output along the x axis
-extern int centery; //!< center output along the y axis
-extern int html; //!< produce HTML output
-extern int xhtml; //!< produce XHTML output
-extern int html_fontsize; //!< font size for HTML/XHTML output
-extern int colorfill; //!< also fill the background
-extern int convert_grayscale; //!< produce grayscale output
-extern const char *html_title_raw; //!< HTML title
-extern char *html_title; //!< HTML title with escaped HTML entities
-extern int html_rawoutput; //!< produce only the image part and not the rest of the website
-extern int html_bold; //!< use bold characters in HTML output
-extern int debug; //!< print debug information
-extern int clearscr; //!< clear the screen before printing an image
-extern float edge_threshold; //!< image gradient above which edges should be drawn with /-\| characters
-extern int edges_only; //!< only draw edges - make sure you use it with the edge-threshold option so edges are drawn
-extern int ascii_palette_length; //!< number of charactrs in the palette
-extern char ascii_palette[]; //!< the palette
-#if ! ASCII
-extern unsigned char ascii_palette_indizes[]; //!< indizes of the first byte of each char in the palette
-extern char ascii_palette_lengths[]; //!< byte lengths of the chars in the palette
-#endif
-extern float redweight; //!< weight for red
-extern float greenweight; //!< weight for green
-extern float blueweight; //!< weight for blue
-extern float RED[256]; //!< red channel lookup table
-extern float GREEN[256]; //!< green channel lookup table
-extern float BLUE[256]; //!< blue channel lookup table
-extern float ALPHA[256]; //!< alpha channel lookup table
-extern float GRAY[256]; //!< gray channel lookup table
 extern const char *fileout; //!< name of the output file (or - for stdout)
-extern int usecolors; //!< produce colored output
-extern int colorDepth; //!< output color bit depth (4 for ANSI, 8 for 256 colors, 24 for true color)
-extern int termfit; //!< the way the output dimensions are calculated
-extern int term_width; //!< width of the terminal
-extern int term_height; //!< height of the terminal
-#define TERM_FIT_ZOOM 1 //!< stretch image to fill the terminal
-#define TERM_FIT_WIDTH 2 //!< calculate the width (based on the height)
-#define TERM_FIT_HEIGHT 3 //!< calculate the height (based on the width)
-#define TERM_FIT_AUTO 4 //!< use the largest possible dimensions while retaining the input image aspect ratio
+extern const char *output_dir; //!< directory to write one output file per image to (or NULL)
+extern const char *cache_dir; //!< directory to save the output of image files in and read it from, see cache.h (or NULL)
+extern const char *serve_path; //!< socket to listen on for requests, see serve.h (or NULL)
+extern const char *connect_path; //!< socket of a server to send the images to, see serve.h (or NULL)
+extern int jobs; //!< number of images to convert at the same time
 
 /*!
  * \brief Prints version information.
@@ -80,22 +35,45 @@ void print_version();
  */
 void help();
 
+#define PARSE_OK 0 //!< the option was applied
+#define PARSE_UNKNOWN 1 //!< the option does not change how images are converted
+#define PARSE_ERROR 2 //!< the option is invalid, an error message was printed
+
+/*!
+ * \brief Applies an option that changes how images are converted to a context.
+ *
+ * Used for the command line and for the options of requests sent to a server (see serve.h).
+ *
+ * \param s the option, e.g. `--width=80`
+ * \param ctx the context
+ * \param err stream error messages are printed to
+ * \return #PARSE_OK, #PARSE_UNKNOWN or #PARSE_ERROR
+ */
+int parse_context_option(const char *s, jp2a_context *ctx, FILE *err);
+
 /*!
- * \brief Calculates red, green, blue, gray and alpha 8-bit to float lookup tables.
+ * \brief Checks the options of a context, calculates the output size and prepares it with jp2a_context_prepare().
+ *
+ * Without a terminal the options for the terminal are invalid and the output is 78 characters wide unless a size is given.
  *
- * \param red,green,blue weights for each color
+ * \param ctx context the options were applied to
+ * \param terminal true if the output is printed to the terminal jp2a runs in
+ * \param err stream error messages are printed to
+ * \return true if successful, false if the options are invalid
  */
-void precalc_rgb(const float red, const float green, const float blue);
+int finish_options(jp2a_context *ctx, const int terminal, FILE *err);
 
 /*!
  * \brief Parses the command line arguments.
  *
- * Options are saved with the global variables.
+ * Options are saved in the context or the global variables.
  * Exits if help or the version is printed.
+ * The context is prepared with jp2a_context_prepare().
  *
  * \param argc argument count
  * \param argv the arguments
+ * \param ctx context initialized with jp2a_context_init()
  */
-void parse_options(int argc, char** argv);
+void parse_options(int argc, char** argv, jp2a_context *ctx);
 
 #endif
@@ -0,0 +1,186 @@
+/*! \file
+ * \noop Copyright 2026 Christoph Raitzig
+ *
+ * \brief Formatting the characters of one image with several threads (--threads).
+ *
+ * The output lines are split into bands of at most #RENDER_BAND_ROWS lines.
+ * Each thread computes the edges (see compute_edges()) or formats the characters of one band into its own memory buffer, the buffers are written in the order of the lines.
+ * Only as many bands as there are threads are formatted at the same time, so large images are not kept in memory as a whole.
+ * The threads are started the first time they are needed and are kept for all further images (see #render_pool), also when several images are formatted at the same time (--jobs, --serve).
+ *
+ * Decoding and downscaling stay on one thread: the compressed data of JPEG, PNG and WebP images can only be decoded from the start, and downscaling is a small part of decoding a large image (see resample.h).
+ * Without POSIX threads (`./configure --disable-threads`) all bands are formatted by the calling thread.
+ *
+ * \author Christoph Raitzig
+ * \copyright Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#ifndef INC_JP2A_RENDER_H
+#define INC_JP2A_RENDER_H
+
+#include "config.h"
+
+#include <stdio.h>
+
+#ifdef FEAT_THREADS
+#include <pthread.h>
+#endif
+
+#include "libjp2a.h"
+
+//! maximum number of output lines one thread formats at a time
+#define RENDER_BAND_ROWS 32
+
+struct Image_;
+
+/*!
+ * \brief Prints some lines of an image.
+ *
+ * \param ctx context
+ * \param image the output image
+ * \param chars the character palette
+ * \param y_begin first line
+ * \param y_end line after the last line
+ * \param f the stream to print to
+ * \return true if successful, false if there was not enough memory
+ */
+typedef int (*render_rows_fn)(const jp2a_context *ctx, const struct Image_* const image, const int chars, const int y_begin, const int y_end, FILE *f);
+
+/*! \struct render_band
+ * \brief Lines of an image one thread works on.
+ */
+typedef struct render_band {
+	const jp2a_context *ctx; //!< context
+	const struct Image_ *image; //!< the output image
+	int chars; //!< the character palette
+	int y_begin; //!< first line of the band
+	int y_end; //!< line after the last line of the band
+	render_rows_fn print_rows; //!< prints the lines of the band, NULL to compute the edges of the band
+	char *output; //!< the printed lines
+	size_t output_size; //!< size of the printed lines in bytes
+	int status; //!< true if the band was printed, false if there was not enough memory or print_rows failed
+	int finished; //!< true when a thread of the #render_pool has worked on the band
+	struct render_band *next; //!< next band in the queue of the #render_pool
+} render_band;
+/*!
+ * \typedef render_band
+ * \brief See #render_band
+ */
+
+#ifdef FEAT_THREADS
+/*! \struct render_pool
+ * \brief Threads that work on the bands of all images.
+ *
+ * The bands are queued and taken by the first free thread.
+ * A thread that queued bands works on queued bands itself until its own ones are finished, so the bands are finished even if no thread could be started.
+ */
+typedef struct render_pool {
+	pthread_mutex_t lock; //!< protects all other members and #render_band::finished
+	pthread_cond_t work; //!< signaled when bands are queued or the threads should stop
+	pthread_cond_t done; //!< signaled when a band is finished
+	render_band *queue; //!< the bands no thread has taken yet
+	pthread_t *threads; //!< the threads, #JP2A_MAX_THREADS at most
+	int thread_count; //!< number of started threads
+	int stopping; //!< true if the threads should stop
+} render_pool;
+/*!
+ * \typedef render_pool
+ * \brief See #render_pool
+ */
+
+//! the pool render_bands() uses
+extern render_pool jp2a_render_pool;
+#endif
+
+/*!
+ * \brief Number of threads the characters of an image are formatted with.
+ *
+ * \param ctx context
+ * \return #jp2a_context_::threads, the number of processors if it is 0, always 1 without POSIX threads; #JP2A_MAX_THREADS at most
+ */
+int render_threads(const jp2a_context *ctx);
+
+/*!
+ * \brief Works on one band: prints its lines into #render_band::output or computes its edges.
+ *
+ * Used as a thread function.
+ *
+ * \param arg the #render_band
+ * \return NULL
+ */
+void *render_band_worker(void *arg);
+
+#ifdef FEAT_THREADS
+/*!
+ * \brief Thread function of the #render_pool: works on queued bands until the pool is stopped.
+ *
+ * \param arg the #render_pool
+ * \return NULL
+ */
+void *render_pool_worker(void *arg);
+
+/*!
+ * \brief Makes sure the pool has a number of threads.
+ *
+ * Threads that are already running are kept, so this only starts threads the first time or when more are needed.
+ *
+ * \param pool the pool
+ * \param threads number of threads, at most #JP2A_MAX_THREADS are started
+ * \return number of threads of the pool, less if not all could be started
+ */
+int render_pool_start(render_pool *pool, int threads);
+
+/*!
+ * \brief Stops the threads of a pool and waits for them.
+ *
+ * No bands may be queued when it is called. The pool can be started again afterwards.
+ *
+ * \param pool the pool
+ */
+void render_pool_stop(render_pool *pool);
+
+/*!
+ * \brief Takes the next band from the queue of a pool.
+ *
+ * \param pool the pool, locked
+ * \return the band, NULL if the queue is empty
+ */
+render_band *render_pool_take(render_pool *pool);
+#endif
+
+/*!
+ * \brief Works on several bands at the same time.
+ *
+ * The calling thread takes the first band and queues the others for the threads of the #jp2a_render_pool, which is started if needed.
+ * If there are no free threads the calling thread works on the queued bands itself.
+ *
+ * \param bands the bands
+ * \param count number of bands
+ */
+void render_bands(render_band *bands, const int count);
+
+/*!
+ * \brief Computes the edges of an image with render_threads() threads.
+ *
+ * \param ctx context
+ * \param image the image, after orient_image() and with an allocated #Image_::edges buffer
+ */
+void render_edges(const jp2a_context *ctx, const struct Image_ *image);
+
+/*!
+ * \brief Prints all lines of an image with render_threads() threads.
+ *
+ * The output is the same as printing the lines with one call of print_rows.
+ * Lines there is no memory for are printed by the calling thread.
+ * There are never more threads than lines.
+ *
+ * \param ctx context
+ * \param image the output image
+ * \param chars the character palette
+ * \param print_rows prints some lines of the image
+ * \param f the stream to print to
+ * \return true if all lines were printed, false if print_rows failed
+ */
+int render_rows(const jp2a_context *ctx, const struct Image_ *image, const int chars, render_rows_fn print_rows, FILE *f);
+
+#endif
@@ -0,0 +1,321 @@
+/*! \file
+ * \noop Copyright 2026 Christoph Raitzig
+ *
+ * \brief Downscaling decoded rows into the pixels of an #Image.
+ *
+ * All decoders pass their rows of 8-bit or 16-bit samples to resample_row().
+ * The resampling is a box filter: the source image is split into as many columns and rows as the output has pixels and every output pixel is the average of the source pixels in its box.
+ * Every source pixel belongs to exactly one box, when upscaling a box is the nearest source pixel.
+ * The resampling is separable:
+ *
+ *  1. Every source row is added to 32-bit integer sums (64-bit for 16-bit samples) at full source width until all rows of an output row are there.
+ *     This touches every decoded sample, so it has SSE2 and AVX2 versions (see resample_accumulate() and resample_accumulate_wide()).
+ *  2. Then resample_flush() averages the sums over the columns of each output pixel (see #Image_::lookup_resx), once per output row.
+ *
+ * With the row_step option only every row_step-th row of an output row is needed, see resample_next_row().
+ *
+ * Interlaced PNG images send their pixels in seven passes over the whole image.
+ * Instead of keeping all rows until the last pass, every pass row is added to sums per output pixel right away (see resample_grid_init()), so the memory depends on the output size only.
+ * The sums are the same as the ones of the separable resampling, so the output is too.
+ *
+ * \author Christoph Raitzig
+ * \copyright Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#ifndef INC_JP2A_RESAMPLE_H
+#define INC_JP2A_RESAMPLE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libjp2a.h"
+
+struct Image_;
+
+/*! \struct resample_format
+ * \brief Layout of the pixels of a decoded row.
+ */
+typedef struct resample_format {
+	int components; //!< number of samples per pixel
+	int gray; //!< true if the first sample is the luminance and there are no colors
+	int alpha; //!< index of the alpha sample of a pixel, -1 if the image is opaque
+	int wide; //!< true if the samples are 16-bit integers, otherwise they are bytes
+	int big_endian; //!< true if 16-bit samples have their most significant byte first (PNG), otherwise they are in the byte order of the processor
+	int max; //!< value of a sample at full intensity, e.g. 255 for bytes, 4095 for 12-bit and 65535 for 16-bit samples
+} resample_format;
+/*!
+ * \typedef resample_format
+ * \brief See #resample_format
+ */
+
+/*! \struct resampler
+ * \brief Sums of the source rows of the current output row.
+ */
+typedef struct resampler {
+	resample_format format; //!< layout of the rows
+	uint32_t *sums; //!< sum of every byte of the source rows added so far
+	uint64_t *wide_sums; //!< sum of every 16-bit sample of the source rows added so far, instead of #sums
+	size_t allocated; //!< number of samples of a row #sums or #wide_sums was allocated for
+	int rows; //!< number of source rows added to #sums
+	int last_row; //!< the source row added last, -1 before the first row
+	uint64_t *grid; //!< sums of red, green, blue and opacity per output pixel of an interlaced image, NULL otherwise
+	int *grid_cols; //!< for every source column the first output column and the column after the last one that it belongs to
+	int *grid_rows; //!< for every source row the first output row and the row after the last one that it is added to (the same if the row is not used)
+	int *grid_used; //!< number of source rows added to every output row
+} resampler;
+/*!
+ * \typedef resampler
+ * \brief See #resampler
+ */
+
+/*!
+ * \brief Initializes a resampler without buffers.
+ *
+ * \param r the resampler
+ */
+void resampler_init(resampler *r);
+
+/*!
+ * \brief Frees the buffers of a resampler.
+ *
+ * \param r the resampler
+ */
+void resampler_free(resampler *r);
+
+/*!
+ * \brief Prepares a resampler for rows of the given length and discards any sums.
+ *
+ * \param r the resampler
+ * \param row_size number of samples of a row (width times the maximum number of components)
+ * \param wide true for rows of 16-bit samples
+ * \return true if successful, false if there is not enough memory
+ */
+int resampler_reset(resampler *r, const size_t row_size, const int wide);
+
+/*!
+ * \brief Adds a row of bytes to 32-bit sums, without SIMD instructions.
+ *
+ * \param sums the sums
+ * \param row the row
+ * \param n number of bytes
+ */
+void resample_accumulate_scalar(uint32_t *sums, const unsigned char *row, const size_t n);
+
+#ifdef FEAT_SIMD
+/*!
+ * \brief Adds a row of bytes to 32-bit sums with SSE2 instructions.
+ *
+ * \param sums the sums
+ * \param row the row
+ * \param n number of bytes
+ */
+void resample_accumulate_sse2(uint32_t *sums, const unsigned char *row, const size_t n);
+
+/*!
+ * \brief Adds a row of bytes to 32-bit sums with AVX2 instructions.
+ *
+ * Must only be called if the processor supports AVX2.
+ *
+ * \param sums the sums
+ * \param row the row
+ * \param n number of bytes
+ */
+__attribute__((target("avx2")))
+void resample_accumulate_avx2(uint32_t *sums, const unsigned char *row, const size_t n);
+#endif
+
+/*!
+ * \brief Adds a row of bytes to 32-bit sums with the fastest instructions the processor supports.
+ *
+ * \param sums the sums
+ * \param row the row
+ * \param n number of bytes
+ */
+void resample_accumulate(uint32_t *sums, const unsigned char *row, const size_t n);
+
+/*!
+ * \brief Adds a row of 16-bit samples to 64-bit sums, without SIMD instructions.
+ *
+ * \param sums the sums
+ * \param row the row
+ * \param n number of samples
+ * \param big_endian true if the most significant byte of a sample comes first
+ */
+void resample_accumulate_wide_scalar(uint64_t *sums, const unsigned char *row, const size_t n, const int big_endian);
+
+#ifdef FEAT_SIMD
+/*!
+ * \brief Adds a row of 16-bit samples to 64-bit sums with SSE2 instructions.
+ *
+ * \param sums the sums
+ * \param row the row
+ * \param n number of samples
+ * \param big_endian true if the most significant byte of a sample comes first
+ */
+void resample_accumulate_wide_sse2(uint64_t *sums, const unsigned char *row, const size_t n, const int big_endian);
+
+/*!
+ * \brief Adds a row of 16-bit samples to 64-bit sums with AVX2 instructions.
+ *
+ * Must only be called if the processor supports AVX2.
+ *
+ * \param sums the sums
+ * \param row the row
+ * \param n number of samples
+ * \param big_endian true if the most significant byte of a sample comes first
+ */
+__attribute__((target("avx2")))
+void resample_accumulate_wide_avx2(uint64_t *sums, const unsigned char *row, const size_t n, const int big_endian);
+#endif
+
+/*!
+ * \brief Adds a row of 16-bit samples to 64-bit sums with the fastest instructions the processor supports.
+ *
+ * \param sums the sums
+ * \param row the row
+ * \param n number of samples
+ * \param big_endian true if the most significant byte of a sample comes first
+ */
+void resample_accumulate_wide(uint64_t *sums, const unsigned char *row, const size_t n, const int big_endian);
+
+/*!
+ * \brief Reads a sample of a row.
+ *
+ * \param format layout of the row
+ * \param row the row
+ * \param index index of the sample
+ * \return the sample
+ */
+unsigned int resample_sample(const resample_format *format, const unsigned char *row, const size_t index);
+
+/*!
+ * \brief First source row of an output row.
+ *
+ * \param i the image, after init_image()
+ * \param y the output row (in source orientation)
+ * \return the source row
+ */
+int resample_row_start(const struct Image_ *i, const int y);
+
+/*!
+ * \brief End of the source rows of an output row.
+ *
+ * \param i the image, after init_image()
+ * \param y the output row (in source orientation)
+ * \return the source row after the last one of output row y, at least resample_row_start() + 1
+ */
+int resample_row_end(const struct Image_ *i, const int y);
+
+/*!
+ * \brief Writes the output rows whose source rows end before a source row.
+ *
+ * Output rows no source row was added for are left as they are.
+ *
+ * \param ctx context
+ * \param i the image
+ * \param src_y the source row
+ */
+void resample_complete(const jp2a_context *ctx, struct Image_ *i, const int src_y);
+
+/*!
+ * \brief Adds a decoded row to the image.
+ *
+ * Rows have to be added from top to bottom.
+ * The output rows that end before the row are written by resample_flush() first.
+ *
+ * \param ctx context
+ * \param i the image, after init_image()
+ * \param format layout of the row, the same for all rows of an image, 16-bit samples only if init_image() was told so
+ * \param row the row, #Image_::row_width pixels
+ * \param src_y the number of the row in the source image
+ */
+void resample_row(const jp2a_context *ctx, struct Image_ *i, const resample_format *format, const unsigned char *row, const int src_y);
+
+/*!
+ * \brief The next source row that has to be passed to resample_row().
+ *
+ * Usually this is the row after src_y.
+ * With the row_step option only every row_step-th row of an output row is used, starting with its first row, the decoders do not have to convert the others.
+ *
+ * \param ctx context
+ * \param i the image
+ * \param src_y the source row that was passed to resample_row() last
+ * \return the next source row
+ */
+int resample_next_row(const jp2a_context *ctx, const struct Image_ *i, const int src_y);
+
+/*!
+ * \brief Writes the averages of an output pixel.
+ *
+ * The averages are scaled from 0 to resample_format::max to 0 to #IMAGE_ONE and rounded down.
+ * For bytes they are the averages with 8 fractional bits, so rounding them to 8 bits gives the same result as rounding the exact average.
+ *
+ * \param ctx context
+ * \param i the image
+ * \param format layout of the source pixels
+ * \param index index of the output pixel in #Image_::pixel
+ * \param sum sums of red (or gray), green, blue and opacity of the source pixels
+ * \param count number of source pixels
+ */
+void resample_store(const jp2a_context *ctx, struct Image_ *i, const resample_format *format, const size_t index, const uint64_t sum[4], const uint64_t count);
+
+/*!
+ * \brief Writes the average of the sums to an output row of the image.
+ *
+ * \param ctx context
+ * \param i the image
+ * \param y the output row (in source orientation)
+ */
+void resample_flush(const jp2a_context *ctx, struct Image_ *i, const int y);
+
+/*!
+ * \brief Writes the output rows the last rows were added to.
+ *
+ * Called by normalize() after the last row of an image.
+ *
+ * \param ctx context
+ * \param i the image
+ */
+void resample_finish(const jp2a_context *ctx, struct Image_ *i);
+
+/*!
+ * \brief Prepares sums per output pixel for rows that arrive in any order.
+ *
+ * Used for interlaced PNG images instead of resample_row().
+ * Prints an error message if there is not enough memory.
+ *
+ * \param ctx context
+ * \param i the image, after init_image()
+ * \param err stream the error message is printed to
+ * \return true if successful, false otherwise
+ */
+int resample_grid_init(const jp2a_context *ctx, struct Image_ *i, FILE *err);
+
+/*!
+ * \brief Adds every dx-th pixel of a source row to the sums per output pixel.
+ *
+ * Rows the row_step option skips are ignored.
+ *
+ * \param i the image, after resample_grid_init()
+ * \param format layout of the row
+ * \param row the pixels, the first one is in column x
+ * \param x source column of the first pixel
+ * \param dx number of source columns between two pixels
+ * \param n number of pixels
+ * \param src_y source row of the pixels
+ */
+void resample_grid_add(struct Image_ *i, const resample_format *format, const unsigned char *row, const int x, const int dx, const int n, const int src_y);
+
+/*!
+ * \brief Writes the averages of the sums per output pixel to the image.
+ *
+ * Afterwards all output rows are written and resample_finish() does nothing.
+ *
+ * \param ctx context
+ * \param i the image
+ * \param format layout of the rows
+ */
+void resample_grid_finish(const jp2a_context *ctx, struct Image_ *i, const resample_format *format);
+
+#endif
@@ -0,0 +1,230 @@
+/*! \file
+ * \noop Copyright 2026 Christoph Raitzig
+ *
+ * \brief Converting images sent over a Unix domain socket (--serve) and sending images to such a server (--connect).
+ *
+ * `jp2a --serve=PATH` listens on a Unix domain socket and converts the images clients send, without starting a process for every image.
+ * All numbers of the protocol are 32-bit unsigned integers with the most significant byte first.
+ * A client sends any number of requests over one connection, each one is:
+ *
+ *  1. the length of the options and the options, every option (e.g. `--width=80`) followed by a zero byte,
+ *  2. the length of the image and the image (JPEG, PNG, WebP or Y4M).
+ *
+ * The server answers every request with a status (#SERVE_OK, #SERVE_FAILED or #SERVE_INVALID), a length and the output (or the error messages if the status is not #SERVE_OK).
+ * HTML/XHTML output is a whole document unless --html-raw is given.
+ *
+ * Every request is converted with its own #jp2a_context: the conversion options given to the server are the defaults, the options of the request are applied to them (see serve_context()).
+ * Options for the terminal, --verbose and --debug can not be used and the output is 78 characters wide by default.
+ * A request can not ask for more threads than the command line or for a width or height larger than #SERVE_MAX_SIZE.
+ * The server has a pool of --jobs threads, each one takes the next connection and answers its requests, so --jobs connections are handled at the same time.
+ * The socket is removed when the server is stopped with SIGINT or SIGTERM.
+ *
+ * `jp2a --connect=PATH [options] files` sends every file with the conversion options to the server and prints the answers, e.g. for testing.
+ *
+ * \author Christoph Raitzig
+ * \copyright Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#ifndef INC_JP2A_SERVE_H
+#define INC_JP2A_SERVE_H
+
+#include "config.h"
+
+#ifdef FEAT_SERVE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "libjp2a.h"
+
+//! maximum length of the options of a request in bytes
+#define SERVE_MAX_OPTIONS 65536
+//! maximum length of the image of a request in bytes
+#define SERVE_MAX_IMAGE (256 * 1024 * 1024)
+//! maximum width and height of the output a request can ask for
+#define SERVE_MAX_SIZE 4096
+
+#define SERVE_OK 0 //!< status of a reply: the image was converted
+#define SERVE_FAILED 1 //!< status of a reply: the image could not be decoded, the reply is the error message
+#define SERVE_INVALID 2 //!< status of a reply: the options are invalid, the reply is the error message
+
+/*! \struct serve_server
+ * \brief The listening socket and the defaults of the requests, shared by the threads of the pool.
+ */
+typedef struct serve_server {
+	int fd; //!< the listening socket
+	int argc; //!< number of command line arguments
+	char **argv; //!< command line arguments, their conversion options are the defaults of every request
+} serve_server;
+/*!
+ * \typedef serve_server
+ * \brief See #serve_server
+ */
+
+/*! \struct serve_request
+ * \brief A request read from a client.
+ */
+typedef struct serve_request {
+	char *options; //!< the options, each one followed by a zero byte
+	size_t options_size; //!< length of the options in bytes
+	unsigned char *image; //!< the image
+	size_t image_size; //!< length of the image in bytes
+} serve_request;
+/*!
+ * \typedef serve_request
+ * \brief See #serve_request
+ */
+
+/*!
+ * \brief Reads exactly the given number of bytes from a socket.
+ *
+ * \param fd the socket
+ * \param buffer where to store the bytes
+ * \param size number of bytes
+ * \return true if successful, false if the connection was closed or an error occurred
+ */
+int serve_read(const int fd, void *buffer, const size_t size);
+
+/*!
+ * \brief Writes all bytes to a socket.
+ *
+ * \param fd the socket
+ * \param buffer the bytes
+ * \param size number of bytes
+ * \return true if successful, false if the connection was closed or an error occurred
+ */
+int serve_write(const int fd, const void *buffer, const size_t size);
+
+/*!
+ * \brief Reads a number of the protocol.
+ *
+ * \param fd the socket
+ * \param value where to store the number
+ * \return true if successful, false otherwise
+ */
+int serve_read_number(const int fd, uint32_t *value);
+
+/*!
+ * \brief Writes a number of the protocol.
+ *
+ * \param fd the socket
+ * \param value the number
+ * \return true if successful, false otherwise
+ */
+int serve_write_number(const int fd, const uint32_t value);
+
+/*!
+ * \brief Reads the next request of a connection.
+ *
+ * \param fd the connected socket
+ * \param r where to store the request, free it with serve_free_request()
+ * \return true if successful, false if the connection was closed, an error occurred or the request is too large
+ */
+int serve_read_request(const int fd, serve_request *r);
+
+/*!
+ * \brief Frees the buffers of a request.
+ *
+ * \param r the request
+ */
+void serve_free_request(serve_request *r);
+
+/*!
+ * \brief Tells whether a request may contain an option.
+ *
+ * --verbose and --debug print to the standard error of the server, so only its command line can contain them.
+ *
+ * \param s the option
+ * \return true if the option can be used, false otherwise
+ */
+int serve_option_allowed(const char *s);
+
+/*!
+ * \brief Sets up the context of a request.
+ *
+ * Starts with the defaults of jp2a_context_init() without a terminal, applies the conversion options of the command line and then the options of the request.
+ * The request can not use more threads than the command line, see serve_option_allowed() and #SERVE_MAX_SIZE for the other limits.
+ *
+ * \param server the server
+ * \param r the request
+ * \param ctx the context, free it with jp2a_context_free() if successful
+ * \param err stream error messages are printed to
+ * \return true if successful, false if the options are invalid
+ */
+int serve_context(const serve_server *server, const serve_request *r, jp2a_context *ctx, FILE *err);
+
+/*!
+ * \brief Converts the image of a request.
+ *
+ * \param ctx the context of the request, see serve_context()
+ * \param r the request
+ * \param fout stream to print the output to, HTML/XHTML documents are printed as a whole
+ * \param err stream the error messages of the decoders are printed to
+ * \return #SERVE_OK or #SERVE_FAILED
+ */
+int serve_convert(const jp2a_context *ctx, const serve_request *r, FILE *fout, FILE *err);
+
+/*!
+ * \brief Answers all requests of a connection.
+ *
+ * \param server the server
+ * \param fd the connected socket, it is closed afterwards
+ */
+void serve_connection(const serve_server *server, const int fd);
+
+/*!
+ * \brief Takes connections from the listening socket and answers them, one after another.
+ *
+ * Used as a thread function.
+ *
+ * \param arg the #serve_server
+ * \return NULL
+ */
+void *serve_worker(void *arg);
+
+/*!
+ * \brief Removes the socket and exits, called for SIGINT and SIGTERM.
+ *
+ * \param sig the signal
+ */
+void serve_stop(int sig);
+
+/*!
+ * \brief Listens on a Unix domain socket and converts the images of the requests until the process is stopped.
+ *
+ * Prints an error message if the socket can not be created.
+ *
+ * \param path path of the socket, an old socket at this path is replaced
+ * \param argc number of command line arguments
+ * \param argv command line arguments, their conversion options are the defaults of every request
+ * \param threads number of connections answered at the same time
+ * \return 1 if the socket could not be created, otherwise the server does not return
+ */
+int serve(const char *path, int argc, char **argv, const int threads);
+
+/*!
+ * \brief Reads a whole file into memory.
+ *
+ * \param name file name or - for standard input
+ * \param size where to store the size of the file
+ * \return the allocated content, NULL if the file could not be read
+ */
+unsigned char *connect_read_file(const char *name, size_t *size);
+
+/*!
+ * \brief Sends files to a server started with --serve and prints the replies.
+ *
+ * The conversion options of the command line are sent with every file, except the ones serve_option_allowed() rejects.
+ *
+ * \param path path of the server's socket
+ * \param argc number of command line arguments
+ * \param argv command line arguments
+ * \param fout stream to print the replies to
+ * \return 0 if all files were converted, 1 otherwise
+ */
+int connect_convert(const char *path, int argc, char **argv, FILE *fout);
+
+#endif
+
+#endif
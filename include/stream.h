@@ -0,0 +1,202 @@
+/*! \file
+ * \noop Copyright 2026 Christoph Raitzig
+ *
+ * \brief Reading images from streams that might not be seekable.
+ *
+ * An #input_stream reads the first bytes of an image ahead so the format can be determined from them.
+ * The decoders then read from the #input_stream instead of the FILE, so those bytes are not lost even if the FILE is a pipe.
+ * No more than one chunk of the input is held in memory by jp2a itself.
+ *
+ * \author Christoph Raitzig
+ * \copyright Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#ifndef INC_JP2A_STREAM_H
+#define INC_JP2A_STREAM_H
+
+#include <stdio.h>
+
+#include "jpeglib.h"
+#include "png.h"
+
+//! number of bytes read ahead to determine the image format
+#define INPUT_STREAM_HEADER_SIZE 12
+//! number of bytes read at once from an input stream by the decoders
+#define INPUT_STREAM_CHUNK_SIZE 65536
+//! JPEG start of image marker code (libjpeg only defines the end of image marker #JPEG_EOI)
+#define JPEG_SOI 0xD8
+
+/*! \enum ImageFormat
+ * \brief Image file formats.
+ */
+typedef enum {
+	FORMAT_UNKNOWN,
+	FORMAT_JPEG,
+	FORMAT_PNG,
+	FORMAT_WEBP,
+	FORMAT_Y4M
+} ImageFormat;
+
+/*!
+ * \brief Function that is called with the bytes read from the FILE of an #input_stream, e.g. to hash them.
+ *
+ * \param data the observer_data of the input stream
+ * \param bytes the bytes that were read
+ * \param size number of bytes
+ */
+typedef void (*input_stream_observer)(void *data, const void *bytes, size_t size);
+
+/*! \struct input_stream
+ * \brief A FILE with its first bytes read ahead.
+ */
+typedef struct input_stream {
+	FILE *fp; //!< the underlying stream
+	unsigned char header[INPUT_STREAM_HEADER_SIZE]; //!< the first bytes of the stream
+	size_t header_size; //!< number of bytes in #header (less than #INPUT_STREAM_HEADER_SIZE for very short streams)
+	size_t header_pos; //!< number of bytes of #header already returned by input_stream_read()
+	input_stream_observer observer; //!< called with every byte read from #fp exactly once, NULL if nobody is interested
+	void *observer_data; //!< passed to #observer
+} input_stream;
+/*!
+ * \typedef input_stream
+ * \brief See #input_stream
+ */
+
+/*!
+ * \brief Reads the first bytes of a stream.
+ *
+ * \param in the input stream to initialize
+ * \param fp the stream to read from, does not have to be seekable
+ */
+void input_stream_init(input_stream *in, FILE *fp);
+
+/*!
+ * \brief Reads the first bytes of a stream and passes every byte read from it to an observer.
+ *
+ * This way the bytes can be processed while the image is decoded, without reading the stream a second time.
+ *
+ * \param in the input stream to initialize
+ * \param fp the stream to read from, does not have to be seekable
+ * \param observer called with the bytes read from fp, see #input_stream_observer
+ * \param data passed to the observer
+ */
+void input_stream_init_observed(input_stream *in, FILE *fp, input_stream_observer observer, void *data);
+
+/*!
+ * \brief Reads the rest of an input stream, e.g. the bytes after the end of the image, so the observer sees all of them.
+ *
+ * \param in input stream
+ * \return true if the end of the stream was reached, false if reading failed
+ */
+int input_stream_read_rest(input_stream *in);
+
+/*!
+ * \brief Reads from an input stream.
+ *
+ * \param in input stream
+ * \param buf where to store the bytes
+ * \param size maximum number of bytes to read
+ * \return number of bytes read, 0 at the end of the stream
+ */
+size_t input_stream_read(input_stream *in, void *buf, size_t size);
+
+/*!
+ * \brief Reads a line of text from an input stream.
+ *
+ * \param in input stream
+ * \param buf where to store the line, without the newline and terminated with a null character
+ * \param size size of buf
+ * \return length of the line, -1 at the end of the stream or if the line does not fit into buf
+ */
+int input_stream_read_line(input_stream *in, char *buf, size_t size);
+
+/*!
+ * \brief Determines the image format from the first bytes of the stream.
+ *
+ * \param in input stream
+ * \return the image format or #FORMAT_UNKNOWN
+ */
+ImageFormat input_stream_format(const input_stream *in);
+
+/*!
+ * \brief Name of an image format for messages.
+ *
+ * \param format the image format
+ * \return the name, e.g. "JPEG"
+ */
+const char *image_format_name(ImageFormat format);
+
+/*! \struct jpeg_input_stream_source
+ * \brief libjpeg source manager that reads from an #input_stream.
+ */
+typedef struct jpeg_input_stream_source {
+	struct jpeg_source_mgr pub; //!< libjpeg's source manager
+	input_stream *in; //!< the stream to read from
+	JOCTET *buffer; //!< buffer for one chunk
+} jpeg_input_stream_source;
+/*!
+ * \typedef jpeg_input_stream_source
+ * \brief See #jpeg_input_stream_source
+ */
+
+/*!
+ * \brief Makes libjpeg read from an input stream (like jpeg_stdio_src()).
+ *
+ * \param jpg the decompressor
+ * \param in input stream
+ */
+void jpeg_input_stream_src(j_decompress_ptr jpg, input_stream *in);
+
+/*!
+ * \brief Skips to the start of image marker of the next image of a Motion JPEG stream.
+ *
+ * Anything between two images (e.g. newlines or multipart boundaries) is skipped, so jpeg_read_header() finds the marker right away.
+ * Unlike jpeg_input_stream_fill_input_buffer() no end of image marker is inserted at the end of the stream.
+ *
+ * \param jpg the decompressor, its source has to be set with jpeg_input_stream_src()
+ * \return true if there is another image, false at the end of the stream
+ */
+int jpeg_input_stream_next_image(j_decompress_ptr jpg);
+
+/*!
+ * \brief libjpeg callback: does nothing, the stream is already open.
+ *
+ * \param jpg the decompressor
+ */
+void jpeg_input_stream_init_source(j_decompress_ptr jpg);
+
+/*!
+ * \brief libjpeg callback: reads the next chunk.
+ *
+ * Inserts an end of image marker at the end of the stream, like libjpeg does for jpeg_stdio_src().
+ *
+ * \param jpg the decompressor
+ * \return always TRUE
+ */
+boolean jpeg_input_stream_fill_input_buffer(j_decompress_ptr jpg);
+
+/*!
+ * \brief libjpeg callback: skips data (e.g. markers jp2a is not interested in).
+ *
+ * \param jpg the decompressor
+ * \param num_bytes number of bytes to skip
+ */
+void jpeg_input_stream_skip_input_data(j_decompress_ptr jpg, long num_bytes);
+
+/*!
+ * \brief libjpeg callback: does nothing, the buffer is freed with the decompressor.
+ *
+ * \param jpg the decompressor
+ */
+void jpeg_input_stream_term_source(j_decompress_ptr jpg);
+
+/*!
+ * \brief libpng read function for input streams, see png_set_read_fn().
+ *
+ * \param png_ptr PNG reader, its io pointer has to be the #input_stream
+ * \param data where to store the bytes
+ * \param length number of bytes to read
+ */
+void png_input_stream_read(png_structp png_ptr, png_bytep data, png_size_t length);
+
+#endif
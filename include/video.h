@@ -0,0 +1,209 @@
+/*! \file
+ * \noop Copyright 2026 Christoph Raitzig
+ *
+ * \brief Printing streams with several frames.
+ *
+ * A video is printed frame by frame into the same #Image, its buffers are only allocated again if the output dimensions change (see reuse_image()).
+ * Three kinds of streams are supported:
+ *
+ *  - Motion JPEG: JPEG images one after another, e.g. `cat *.jpg` or the output of a camera, see play_mjpeg()
+ *  - [Y4M](https://wiki.multimedia.cx/index.php/YUV4MPEG2): uncompressed 8-bit YCbCr frames as written by ffmpeg and many other tools, see decompress_y4m()
+ *  - animated WebP, decoded frame by frame by libwebp's animation decoder, see play_webp()
+ *
+ * A #frame_clock limits the output to a number of frames per second, or waits as long as each frame of an animated WebP is shown.
+ * With the dump_frames option the frames are printed one after another without waiting.
+ * With the clear option the screen is only cleared before the first frame, later frames are printed over the previous one without flickering.
+ * Usually only the characters that changed have to be printed, see delta.h.
+ *
+ * \author Christoph Raitzig
+ * \copyright Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#ifndef INC_JP2A_VIDEO_H
+#define INC_JP2A_VIDEO_H
+
+#include <stdio.h>
+
+#include "libjp2a.h"
+#include "image.h"
+#include "stream.h"
+#include "webp/demux.h"
+
+//! maximum length of a line of a Y4M stream header or frame header
+#define Y4M_LINE_MAX 1024
+
+/*! \enum Y4MChroma
+ * \brief Chroma subsampling of a Y4M stream.
+ */
+typedef enum {
+	Y4M_420, //!< one chroma sample per 2x2 pixels
+	Y4M_422, //!< one chroma sample per 2x1 pixels
+	Y4M_444, //!< one chroma sample per pixel
+	Y4M_MONO //!< luma only
+} Y4MChroma;
+
+/*! \struct y4m_stream
+ * \brief Header and frame buffer of a Y4M stream.
+ */
+typedef struct y4m_stream {
+	int width; //!< frame width
+	int height; //!< frame height
+	Y4MChroma chroma; //!< chroma subsampling
+	int chroma_width; //!< width of the chroma planes
+	int chroma_height; //!< height of the chroma planes
+	float fps; //!< frame rate from the header, 0 if unknown
+	size_t frame_size; //!< number of bytes of one frame (all planes)
+	unsigned char *frame; //!< the planes of the current frame
+} y4m_stream;
+/*!
+ * \typedef y4m_stream
+ * \brief See #y4m_stream
+ */
+
+/*! \struct frame_clock
+ * \brief Keeps the time when the next frame is due.
+ */
+typedef struct frame_clock {
+	double interval; //!< seconds between two frames, 0 to print frames as fast as possible
+	double next; //!< time the next frame is due (see frame_clock_now()), 0 before the first frame
+} frame_clock;
+/*!
+ * \typedef frame_clock
+ * \brief See #frame_clock
+ */
+
+/*!
+ * \brief Current time of a monotonic clock.
+ *
+ * \return time in seconds, always 0 if the system has no monotonic clock
+ */
+double frame_clock_now(void);
+
+/*!
+ * \brief Initializes a frame clock.
+ *
+ * \param clock the clock
+ * \param fps frames per second, 0 or less to print frames as fast as possible
+ */
+void frame_clock_init(frame_clock *clock, float fps);
+
+/*!
+ * \brief Frames per second to print a video at.
+ *
+ * \param ctx context
+ * \param rate frame rate of the video, 0 if unknown
+ * \return 0 with the dump_frames option, otherwise `--fps` if given or else rate
+ */
+float video_fps(const jp2a_context *ctx, const float rate);
+
+/*!
+ * \brief Waits until the next frame is due.
+ *
+ * If printing fell behind by more than one frame the clock starts over instead of printing the missed frames as fast as possible.
+ *
+ * \param clock the clock
+ */
+void frame_clock_wait(frame_clock *clock);
+
+/*!
+ * \brief Prints all images of a Motion JPEG stream.
+ *
+ * The stream is decoded with one decompressor and one #Image for all frames.
+ * Prints errors if a frame is not a valid JPEG image, frames printed before remain on the screen.
+ *
+ * \param ctx context
+ * \param in input stream
+ * \param fout stream to print the frames to
+ * \param errors used to save errors
+ */
+void play_mjpeg(const jp2a_context *ctx, input_stream *in, FILE *fout, error_collector *errors);
+
+/*!
+ * \brief Prints the frames of an animated WebP image.
+ *
+ * libwebp's animation decoder composes every frame on a canvas with the size of the image, the canvas is printed like a PNG image with an alpha channel.
+ * With the video option each frame is shown as long as the animation says (or according to `--fps`), the animation is played once.
+ * Otherwise only the first frame is printed.
+ * Prints errors if a frame can not be decoded.
+ *
+ * \param ctx context
+ * \param data the whole WebP file, the animation decoder needs all of it
+ * \param size size of data
+ * \param fout stream to print the frames to
+ * \param image_out stream the first frame is saved to, see print_image(); only used without the video option
+ * \param errors used to save errors
+ */
+void play_webp(const jp2a_context *ctx, const uint8_t *data, const size_t size, FILE *fout, FILE *image_out, error_collector *errors);
+
+/*!
+ * \brief Reads the header of a Y4M stream.
+ *
+ * Only 8-bit streams with 4:2:0, 4:2:2, 4:4:4 or monochrome color spaces are supported.
+ *
+ * \param in input stream
+ * \param y4m where to store the header, the frame buffer is allocated
+ * \param errors used to save errors
+ * \return true if successful, false otherwise
+ */
+int y4m_read_header(input_stream *in, y4m_stream *y4m, error_collector *errors);
+
+/*!
+ * \brief Reads the next frame of a Y4M stream into its frame buffer.
+ *
+ * \param in input stream
+ * \param y4m the stream
+ * \param errors used to save errors if the frame is broken
+ * \return true if a frame was read, false at the end of the stream or on errors
+ */
+int y4m_read_frame(input_stream *in, y4m_stream *y4m, error_collector *errors);
+
+/*!
+ * \brief Converts a line of the current frame to RGB.
+ *
+ * Uses the ITU-R BT.601 conversion for limited range (16 to 235) luma.
+ *
+ * \param y4m the stream
+ * \param y line to convert
+ * \param row where to store the 3 bytes per pixel
+ */
+void y4m_row_to_rgb(const y4m_stream *y4m, const int y, unsigned char *row);
+
+/*!
+ * \brief Prints the current frame of a Y4M stream.
+ *
+ * \param ctx context
+ * \param y4m the stream
+ * \param image image whose buffers are reused, see reuse_image()
+ * \param row buffer for one RGB line of the frame
+ * \param fout stream to print the frame to
+ * \param image_out stream the downscaled frame is saved to, see print_image()
+ * \param err stream error messages are printed to
+ * \return true if the frame was printed, false otherwise
+ */
+int y4m_print_frame(const jp2a_context *ctx, const y4m_stream *y4m, Image *image, unsigned char *row, FILE *fout, FILE *image_out, FILE *err);
+
+/*!
+ * \brief Prints some information about the video and how it will be printed.
+ *
+ * \param ctx context
+ * \param y4m the stream
+ * \param width output width
+ * \param height output height
+ */
+void print_info_y4m(const jp2a_context *ctx, const y4m_stream *y4m, const int width, const int height);
+
+/*!
+ * \brief Decompresses and prints a Y4M stream.
+ *
+ * Prints all frames with the video option and only the first frame otherwise.
+ * Prints errors if the stream is not a valid Y4M stream.
+ *
+ * \param ctx context
+ * \param in input stream
+ * \param fout stream to print the frames to
+ * \param image_out stream the first frame is saved to, see print_image(); only used without the video option
+ * \param errors used to save errors
+ */
+void decompress_y4m(const jp2a_context *ctx, input_stream *in, FILE *fout, FILE *image_out, error_collector *errors);
+
+#endif
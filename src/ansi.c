@@ -0,0 +1,139 @@
+/*
+ * Copyright 2026 Christoph Raitzig
+ * Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "ansi.h"
+
+// the two decimal digits of 0 to 99
+static const char DECIMAL_PAIRS[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+void ansi_state_reset(ansi_state *state) {
+	state->fg = ANSI_DEFAULT;
+	state->bg = ANSI_DEFAULT;
+	state->bold = 0;
+}
+
+char *ansi_decimal(char *p, int n) {
+	if ( n < 10 ) {
+		*p++ = '0' + n;
+	} else
+	if ( n < 100 ) {
+		memcpy(p, &DECIMAL_PAIRS[2 * n], 2);
+		p += 2;
+	} else
+	if ( n < 1000 ) {
+		*p++ = '0' + n / 100;
+		memcpy(p, &DECIMAL_PAIRS[2 * (n % 100)], 2);
+		p += 2;
+	} else {
+		// e. g. a cursor position in a very wide image; written backwards, two digits at a time
+		char digits[12];
+		char *d = digits + sizeof(digits);
+		while ( n >= 100 ) {
+			d -= 2;
+			memcpy(d, &DECIMAL_PAIRS[2 * (n % 100)], 2);
+			n /= 100;
+		}
+		if ( n < 10 ) {
+			*--d = '0' + n;
+		} else {
+			d -= 2;
+			memcpy(d, &DECIMAL_PAIRS[2 * n], 2);
+		}
+		p = ansi_copy(p, d, digits + sizeof(digits) - d);
+	}
+	return p;
+}
+
+char *ansi_copy(char *p, const char *s, size_t length) {
+	memcpy(p, s, length);
+	return p + length;
+}
+
+char *ansi_sgr(char *p, int code) {
+	*p++ = '\x1b';
+	*p++ = '[';
+	p = ansi_decimal(p, code);
+	*p++ = 'm';
+	return p;
+}
+
+char *ansi_cursor(char *p, int row, int column) {
+	*p++ = '\x1b';
+	*p++ = '[';
+	p = ansi_decimal(p, row);
+	*p++ = ';';
+	p = ansi_decimal(p, column);
+	*p++ = 'H';
+	return p;
+}
+
+char *ansi_color(char *p, int type, int color, int color_depth) {
+	if ( color_depth == 4 )
+		return ansi_decimal(p, color);
+
+	p = ansi_decimal(p, type);
+	if ( color_depth == 8 ) {
+		p = ansi_copy(p, ";5;", 3);
+		return ansi_decimal(p, color);
+	}
+	p = ansi_copy(p, ";2;", 3);
+	p = ansi_decimal(p, (color >> 16) & 0xff);
+	*p++ = ';';
+	p = ansi_decimal(p, (color >> 8) & 0xff);
+	*p++ = ';';
+	return ansi_decimal(p, color & 0xff);
+}
+
+char *ansi_transition(char *p, const ansi_state *from, const ansi_state *to, int color_depth) {
+	if ( from->fg == to->fg && from->bg == to->bg && from->bold == to->bold )
+		return p;
+
+	ansi_state base = *from;
+	int separator = 0;
+
+	*p++ = '\x1b';
+	*p++ = '[';
+	if ( (base.bold && !to->bold) ||
+	     (base.fg != ANSI_DEFAULT && to->fg == ANSI_DEFAULT) ||
+	     (base.bg != ANSI_DEFAULT && to->bg == ANSI_DEFAULT) ) {
+		*p++ = '0';
+		ansi_state_reset(&base);
+		separator = 1;
+	}
+	if ( to->bold && !base.bold ) {
+		if ( separator ) *p++ = ';';
+		*p++ = '1';
+		separator = 1;
+	}
+	if ( to->fg != base.fg ) {
+		if ( separator ) *p++ = ';';
+		p = ansi_color(p, 38, to->fg, color_depth);
+		separator = 1;
+	}
+	if ( to->bg != base.bg ) {
+		if ( separator ) *p++ = ';';
+		p = ansi_color(p, 48, to->bg, color_depth);
+	}
+	*p++ = 'm';
+	return p;
+}
@@ -4,10 +4,10 @@
  * Distributed under the GNU General Public License (GPL) v2.
  */
 
-#include "options.h"
+#include "aspect_ratio.h"
 #include "round.h"
 
-void aspect_ratio(const int jpeg_width, const int jpeg_height, const int switch_x_y) {
+void aspect_ratio(const jp2a_context *ctx, const int jpeg_width, const int jpeg_height, const int switch_x_y, int *width, int *height) {
 
 	// the 2.0f and 0.5f factors are used for text displays that (usually) have characters
 	// that are taller than they are wide.
@@ -15,36 +15,40 @@ void aspect_ratio(const int jpeg_width, const int jpeg_height, const int switch_
 	const int stored_width = switch_x_y ? jpeg_height : jpeg_width;
 	const int stored_height = switch_x_y ? jpeg_width : jpeg_height;
 
-	#define CALC_WIDTH ROUND(2.0f * (float) height * (float) stored_width / (float) stored_height)
-	#define CALC_HEIGHT ROUND(0.5f * (float) width * (float) stored_height / (float) stored_width)
+	int auto_width = ctx->auto_width;
+	int auto_height = ctx->auto_height;
+	*width = ctx->width;
+	*height = ctx->height;
+
+	#define CALC_WIDTH ROUND(2.0f * (float) *height * (float) stored_width / (float) stored_height)
+	#define CALC_HEIGHT ROUND(0.5f * (float) *width * (float) stored_height / (float) stored_width)
 
 	// calc width
 	if ( auto_width && !auto_height ) {
-		width = CALC_WIDTH;
+		*width = CALC_WIDTH;
 
 		// adjust for too small dimensions	
-		while ( width==0 ) {
-			++height;
-			aspect_ratio(stored_width, stored_height, 0);
+		while ( *width==0 ) {
+			++*height;
+			*width = CALC_WIDTH;
 		}
 		
-		while ( termfit==TERM_FIT_AUTO && (width + use_border*2)>term_width ) {
-			width = term_width - use_border*2;
-			height = 0;
+		if ( ctx->termfit==TERM_FIT_AUTO && (*width + ctx->use_border*2)>ctx->term_width ) {
+			// too wide for the terminal, calculate the height from the terminal width instead
+			*width = ctx->term_width - ctx->use_border*2;
 			auto_height = 1;
 			auto_width = 0;
-			aspect_ratio(stored_width, stored_height, 0);
 		}
 
 	}
 
 	// calc height
 	if ( !auto_width && auto_height ) {
-		height = CALC_HEIGHT;
+		*height = CALC_HEIGHT;
 
 		// adjust for too small dimensions
-		if ( height==0 ) {
-			height = ( stored_height == 1 )? 0 : 1;
+		if ( *height==0 ) {
+			*height = ( stored_height == 1 )? 0 : 1;
 		}
 	}
 }
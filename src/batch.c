@@ -0,0 +1,179 @@
+/*
+ * Copyright 2026 Christoph Raitzig
+ * Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#include "config.h"
+
+#ifdef FEAT_THREADS
+
+#include <stdio.h>
+#include <pthread.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#include "batch.h"
+#include "jp2a.h"
+#include "options.h"
+#include "curl.h"
+
+void *batch_worker(void *arg) {
+	batch *b = (batch*) arg;
+	batch_task *t;
+
+	for ( ;; ) {
+		pthread_mutex_lock(&b->lock);
+		while ( !b->stop && b->next < b->count ) {
+			if ( b->tasks[b->next].serial ) {
+				++b->next;
+				continue;
+			}
+			if ( b->next < b->written + b->window )
+				break;
+			pthread_cond_wait(&b->slot_free, &b->lock);
+		}
+		if ( b->stop || b->next >= b->count ) {
+			pthread_mutex_unlock(&b->lock);
+			break;
+		}
+		t = &b->tasks[b->next++];
+		pthread_mutex_unlock(&b->lock);
+
+		int status;
+		// the verbose messages and the progress bar of one image are not mixed with those of other images
+		if ( b->ctx->verbose )
+			flockfile(stderr);
+		if ( output_dir != NULL ) {
+			status = convert_input(b->ctx, t->name, NULL);
+		} else {
+			FILE *mem = open_memstream(&t->output, &t->output_size);
+			if ( mem == NULL ) {
+				fprintf(stderr, "Not enough memory.\n");
+				status = -1;
+			} else {
+				status = convert_input(b->ctx, t->name, mem);
+				fclose(mem);
+			}
+		}
+		if ( b->ctx->verbose )
+			funlockfile(stderr);
+
+		pthread_mutex_lock(&b->lock);
+		t->status = status;
+		t->done = 1;
+		pthread_cond_broadcast(&b->task_done);
+		pthread_mutex_unlock(&b->lock);
+	}
+
+	return NULL;
+}
+
+int convert_parallel(const jp2a_context *ctx, int argc, char **argv, FILE *fout, int jobs) {
+	batch b;
+	pthread_t *threads;
+	int retval = 0;
+	int started, n, i;
+
+	memset(&b, 0, sizeof(batch));
+	b.ctx = ctx;
+	b.window = jobs * BATCH_WINDOW_PER_JOB;
+	b.tasks = calloc(argc, sizeof(batch_task));
+	threads = malloc(jobs * sizeof(pthread_t));
+	if ( b.tasks == NULL || threads == NULL ) {
+		fprintf(stderr, "Not enough memory.\n");
+		free(b.tasks);
+		free(threads);
+		return 1;
+	}
+
+	for ( n=1; n<argc; ++n ) {
+		// skip options
+		if ( argv[n][0]=='-' && argv[n][1] )
+			continue;
+		batch_task *t = &b.tasks[b.count++];
+		t->name = argv[n];
+		t->serial = argv[n][0]=='-' && !argv[n][1];
+#ifdef FEAT_CURL
+		// downloads fork and use global state in curl.c
+		t->serial |= is_url(argv[n]);
+#endif
+	}
+
+	pthread_mutex_init(&b.lock, NULL);
+	pthread_cond_init(&b.task_done, NULL);
+	pthread_cond_init(&b.slot_free, NULL);
+
+	for ( started = 0; started < jobs; ++started ) {
+		if ( pthread_create(&threads[started], NULL, batch_worker, &b) != 0 )
+			break;
+	}
+	if ( started == 0 ) {
+		// no threads, convert everything in the main thread
+		for ( i = 0; i < b.count; ++i )
+			b.tasks[i].serial = 1;
+	}
+	if ( ctx->debug )
+		fprintf(stderr, "Started %d worker threads\n", started);
+
+	for ( i = 0; i < b.count; ++i ) {
+		batch_task *t = &b.tasks[i];
+
+		if ( t->serial ) {
+			if ( ctx->verbose )
+				flockfile(stderr);
+			t->status = convert_input(ctx, t->name, fout);
+			if ( ctx->verbose )
+				funlockfile(stderr);
+		} else {
+			pthread_mutex_lock(&b.lock);
+			while ( !t->done )
+				pthread_cond_wait(&b.task_done, &b.lock);
+			pthread_mutex_unlock(&b.lock);
+
+			if ( t->output_size != 0 )
+				fwrite(t->output, 1, t->output_size, fout);
+			free(t->output);
+			t->output = NULL;
+		}
+
+		if ( t->status != 0 )
+			retval = 1;
+
+		pthread_mutex_lock(&b.lock);
+		b.written = i + 1;
+		if ( t->status < 0 )
+			b.stop = 1;
+		pthread_cond_broadcast(&b.slot_free);
+		pthread_mutex_unlock(&b.lock);
+
+		if ( t->status < 0 )
+			break;
+	}
+
+	pthread_mutex_lock(&b.lock);
+	b.stop = 1;
+	pthread_cond_broadcast(&b.slot_free);
+	pthread_mutex_unlock(&b.lock);
+
+	for ( n = 0; n < started; ++n )
+		pthread_join(threads[n], NULL);
+
+	for ( i = 0; i < b.count; ++i )
+		free(b.tasks[i].output);
+
+	pthread_cond_destroy(&b.slot_free);
+	pthread_cond_destroy(&b.task_done);
+	pthread_mutex_destroy(&b.lock);
+	free(threads);
+	free(b.tasks);
+
+	return retval;
+}
+
+#endif
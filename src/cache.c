@@ -0,0 +1,318 @@
+/*
+ * Copyright 2026 Christoph Raitzig
+ * Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef FEAT_THREADS
+#include <pthread.h>
+#endif
+
+#include "cache.h"
+#include "image.h"
+#include "stream.h"
+
+int cache_hits = 0;
+int cache_image_hits = 0;
+int cache_misses = 0;
+#ifdef FEAT_THREADS
+pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+uint64_t cache_hash(uint64_t hash, const void *data, const size_t size) {
+	const unsigned char *p = (const unsigned char*) data;
+	for ( size_t n = 0; n < size; ++n ) {
+		hash ^= p[n];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+void cache_hash_observer(void *data, const void *bytes, size_t size) {
+	uint64_t *hash = (uint64_t*) data;
+	*hash = cache_hash(*hash, bytes, size);
+}
+
+int cache_file_key(FILE *f, uint64_t *key) {
+#ifdef HAVE_SYS_STAT_H
+	struct stat st;
+
+	// standard input, named pipes and devices are not cached
+	if ( fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode) )
+		return 0;
+
+	const long long status[] = {
+		st.st_dev, st.st_ino, st.st_size, st.st_mtime, st.st_ctime,
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+		st.st_mtim.tv_nsec, st.st_ctim.tv_nsec
+#endif
+	};
+	*key = cache_hash(CACHE_HASH_INIT, status, sizeof(status));
+	return 1;
+#else
+	(void) f;
+	(void) key;
+	return 0;
+#endif
+}
+
+uint64_t cache_hash_options(const jp2a_context *ctx) {
+	const int options[] = {
+		ctx->auto_width, ctx->auto_height, ctx->width, ctx->height,
+		ctx->use_border, ctx->invert, ctx->flipx, ctx->flipy, ctx->centerx, ctx->centery,
+		ctx->html, ctx->xhtml, ctx->colorfill, ctx->convert_grayscale, ctx->html_rawoutput, ctx->html_bold, ctx->html_classes,
+		ctx->clearscr, ctx->video, ctx->row_step,
+		ctx->edges_only, ctx->ascii_palette_length,
+		ctx->usecolors, ctx->colorDepth, ctx->termfit, ctx->term_width, ctx->term_height
+	};
+	uint64_t hash;
+
+	hash = cache_hash(CACHE_HASH_INIT, PACKAGE_STRING, sizeof(PACKAGE_STRING));
+	hash = cache_hash(hash, options, sizeof(options));
+	hash = cache_hash(hash, &ctx->edge_threshold, sizeof(ctx->edge_threshold));
+	hash = cache_hash(hash, ctx->weights, sizeof(ctx->weights));
+	return cache_hash(hash, ctx->ascii_palette, strlen(ctx->ascii_palette));
+}
+
+uint64_t cache_hash_image_options(const jp2a_context *ctx) {
+	const int options[] = {
+		IMAGE_FILE_VERSION,
+		ctx->auto_width, ctx->auto_height, ctx->width, ctx->height,
+		ctx->use_border, ctx->termfit, ctx->term_width, ctx->term_height,
+		ctx->row_step,
+		ctx->usecolors && !ctx->convert_grayscale
+	};
+	uint64_t hash;
+
+	hash = cache_hash(CACHE_HASH_INIT, PACKAGE_STRING, sizeof(PACKAGE_STRING));
+	hash = cache_hash(hash, options, sizeof(options));
+	return cache_hash(hash, ctx->weights, sizeof(ctx->weights));
+}
+
+char *cache_path(const char *dir, const uint64_t input, const uint64_t options, const char *extension) {
+	char *path = malloc(strlen(dir) + 1 + 32 + strlen(extension) + 1);
+	if ( path == NULL )
+		return NULL;
+	sprintf(path, "%s/%016llx%016llx%s", dir, (unsigned long long) input, (unsigned long long) options, extension);
+	return path;
+}
+
+char *cache_temp_path(const char *path, const int lookup, const char *extension) {
+	long pid = 0;
+#ifdef HAVE_UNISTD_H
+	pid = (long) getpid();
+#endif
+	char *temp = malloc(strlen(path) + strlen(extension) + 48);
+	if ( temp == NULL )
+		return NULL;
+	sprintf(temp, "%s.%ld.%d%s.tmp", path, pid, lookup, extension);
+	return temp;
+}
+
+int cache_copy(FILE *from, FILE *to) {
+	char buffer[CACHE_BUFFER_SIZE];
+	size_t n;
+
+	while ( (n = fread(buffer, 1, sizeof(buffer), from)) > 0 )
+		fwrite(buffer, 1, n, to);
+	return !ferror(from);
+}
+
+int cache_print_output(const char *path, FILE *fout) {
+	FILE *f = fopen(path, "rb");
+	if ( f == NULL )
+		return 0;
+
+	// nothing is printed unless the whole output could be read, otherwise the image is decoded and printed after it
+	char *output = NULL;
+	long size = -1;
+	if ( fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 0 && fseek(f, 0, SEEK_SET) == 0 ) {
+		output = malloc(size);
+		if ( output != NULL && fread(output, 1, size, f) != (size_t) size ) {
+			free(output);
+			output = NULL;
+		}
+	}
+	fclose(f);
+	if ( output == NULL )
+		return 0;
+
+	fwrite(output, 1, size, fout);
+	free(output);
+	return 1;
+}
+
+int cache_load_input_hash(const char *path, uint64_t *input) {
+	unsigned long long hash;
+	FILE *f = fopen(path, "r");
+	if ( f == NULL )
+		return 0;
+	const int status = fscanf(f, "%16llx", &hash) == 1;
+	fclose(f);
+	if ( status )
+		*input = hash;
+	return status;
+}
+
+void cache_save_input_hash(const char *path, const char *temp, const uint64_t input) {
+	FILE *f = fopen(temp, "w");
+	if ( f == NULL )
+		return;
+	fprintf(f, "%016llx\n", (unsigned long long) input);
+	cache_close(f, temp, path, 1);
+}
+
+void cache_close(FILE *f, const char *temp, const char *path, const int keep) {
+	const int status = fflush(f) == 0 && !ferror(f) && ftell(f) > 0;
+	fclose(f);
+	if ( !keep || !status || rename(temp, path) != 0 )
+		remove(temp);
+}
+
+int cache_count(const int result) {
+	int lookups;
+#ifdef FEAT_THREADS
+	pthread_mutex_lock(&cache_lock);
+#endif
+	lookups = cache_hits + cache_image_hits + cache_misses;
+	if ( result == CACHE_HIT )
+		++cache_hits;
+	else if ( result == CACHE_IMAGE_HIT )
+		++cache_image_hits;
+	else
+		++cache_misses;
+#ifdef FEAT_THREADS
+	pthread_mutex_unlock(&cache_lock);
+#endif
+	return lookups;
+}
+
+void cache_print_stats() {
+	fprintf(stderr, "Cache: %d hits, %d downscaled image hits, %d misses\n", cache_hits, cache_image_hits, cache_misses);
+}
+
+int cache_load_image(const jp2a_context *ctx, const char *path, Image *image, FILE *err) {
+	FILE *f = fopen(path, "rb");
+	if ( f == NULL )
+		return 0;
+	const int status = load_image(ctx, image, f, err);
+	fclose(f);
+	return status;
+}
+
+int convert_cached(const jp2a_context *ctx, const char *dir, FILE *fp, FILE *fout, error_collector *errors) {
+	uint64_t key, input;
+	input_stream in;
+	Image image;
+	int loaded = 0;
+	int keep = 1;
+
+	if ( ctx->video || !cache_file_key(fp, &key) )
+		return 0;
+
+	const uint64_t options = cache_hash_options(ctx);
+	const uint64_t image_options = cache_hash_image_options(ctx);
+	char *key_path = cache_path(dir, key, 0, CACHE_KEY_EXTENSION);
+	char *path = NULL;
+	char *image_path = NULL;
+	if ( key_path == NULL )
+		return 0;
+
+	// the hash of a file that was converted before is known without reading it
+	if ( cache_load_input_hash(key_path, &input) ) {
+		path = cache_path(dir, input, options, CACHE_OUTPUT_EXTENSION);
+		image_path = cache_path(dir, input, image_options, CACHE_IMAGE_EXTENSION);
+		if ( path != NULL && cache_print_output(path, fout) ) {
+			cache_count(CACHE_HIT);
+			if ( ctx->verbose )
+				fprintf(stderr, "Cache hit: %s\n", path);
+			free(image_path);
+			free(path);
+			free(key_path);
+			return 1;
+		}
+		// the same image with other characters or colors only has to be printed again
+		loaded = image_path != NULL && cache_load_image(ctx, image_path, &image, errors->err);
+	}
+
+	// several processes and threads can convert the same image, each one writes its own files
+	// until the file is read its hash is not known, so the temporary files are named after the key
+	const int lookup = cache_count(loaded ? CACHE_IMAGE_HIT : CACHE_MISS);
+	char *temp = cache_temp_path(key_path, lookup, CACHE_OUTPUT_EXTENSION);
+	char *image_temp = cache_temp_path(key_path, lookup, CACHE_IMAGE_EXTENSION);
+	char *key_temp = cache_temp_path(key_path, lookup, CACHE_KEY_EXTENSION);
+	FILE *f = temp != NULL ? fopen(temp, "w+b") : NULL;
+	if ( f == NULL ) {
+		fprintf(stderr, "Could not write to the cache directory '%s'.\n", dir);
+		if ( loaded )
+			free_image(&image);
+		free(key_temp);
+		free(image_temp);
+		free(temp);
+		free(image_path);
+		free(path);
+		free(key_path);
+		return 0;
+	}
+
+	if ( loaded ) {
+		if ( ctx->verbose )
+			fprintf(stderr, "Cache hit for the downscaled image: %s\n", image_path);
+		if ( !print_image(ctx, &image, f, NULL, errors->err) ) {
+			errors->output_status = 1;
+			keep = 0;
+		}
+		free_image(&image);
+	} else {
+		if ( ctx->verbose )
+			fprintf(stderr, "Cache miss: %s\n", path != NULL ? path : "the file was not converted before");
+
+		// the file is hashed while it is decoded and print_image() saves the downscaled image
+		FILE *image_out = image_temp != NULL ? fopen(image_temp, "wb") : NULL;
+		input = CACHE_HASH_INIT;
+		input_stream_init_observed(&in, fp, cache_hash_observer, &input);
+		decompress_stream(ctx, &in, f, image_out, errors);
+		keep = input_stream_read_rest(&in) && !decompress_failed(errors);
+
+		free(image_path);
+		free(path);
+		path = cache_path(dir, input, options, CACHE_OUTPUT_EXTENSION);
+		image_path = cache_path(dir, input, image_options, CACHE_IMAGE_EXTENSION);
+		if ( image_out != NULL )
+			cache_close(image_out, image_temp, image_path, keep && image_path != NULL);
+		if ( keep && key_temp != NULL )
+			cache_save_input_hash(key_path, key_temp, input);
+	}
+
+	rewind(f);
+	cache_copy(f, fout);
+	cache_close(f, temp, path, keep && path != NULL);
+
+	free(key_temp);
+	free(image_temp);
+	free(temp);
+	free(image_path);
+	free(path);
+	free(key_path);
+	return 1;
+}
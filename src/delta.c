@@ -0,0 +1,158 @@
+/*
+ * Copyright 2026 Christoph Raitzig
+ * Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#include "ansi.h"
+#include "delta.h"
+#include "image.h"
+
+int uses_delta(const jp2a_context *ctx) {
+	return ctx->clearscr && !ctx->dump_frames && !ctx->html && !ctx->xhtml;
+}
+
+void delta_grid_init(delta_grid *grid) {
+	grid->width = grid->height = 0;
+	grid->cells = grid->next = NULL;
+	grid->allocated = 0;
+	grid->line = NULL;
+	grid->line_size = 0;
+}
+
+void delta_grid_free(delta_grid *grid) {
+	free(grid->cells);
+	free(grid->next);
+	free(grid->line);
+	delta_grid_init(grid);
+}
+
+int delta_cell_equal(const delta_cell *a, const delta_cell *b) {
+	return a->glyph == b->glyph && a->state.fg == b->state.fg && a->state.bg == b->state.bg && a->state.bold == b->state.bold;
+}
+
+int delta_grid_update(const jp2a_context *ctx, const Image* const image, const int chars, delta_grid *grid) {
+	const size_t count = (size_t) image->width * image->height;
+	int changed = 0;
+
+	if ( count > grid->allocated ) {
+		delta_grid_free(grid);
+		grid->cells = (delta_cell*) malloc(count * sizeof(delta_cell));
+		grid->next = (delta_cell*) malloc(count * sizeof(delta_cell));
+		if ( !grid->cells || !grid->next ) {
+			delta_grid_free(grid);
+			return DELTA_REDRAW;
+		}
+		grid->allocated = count;
+	}
+
+	const int comparable = grid->width == image->width && grid->height == image->height;
+
+	for ( int y = 0; y < image->height; ++y ) {
+		ansi_state current;
+		ansi_state_reset(&current);
+
+		for ( int x = 0; x < image->width; ++x ) {
+			const int pixel_index = y * image->width + x;
+			delta_cell *cell = &grid->next[pixel_index];
+
+			cell->glyph = image_glyph(ctx, image, chars, pixel_index);
+			if ( ctx->usecolors )
+				image_ansi_state(ctx, image, pixel_index, &current, &cell->state);
+			else
+				ansi_state_reset(&cell->state);
+
+			if ( comparable && !delta_cell_equal(cell, &grid->cells[pixel_index]) )
+				++changed;
+		}
+	}
+
+	return comparable ? changed : DELTA_REDRAW;
+}
+
+void delta_grid_commit(delta_grid *grid, const int width, const int height) {
+	delta_cell *cells = grid->cells;
+
+	if ( !grid->next )
+		return;
+	grid->cells = grid->next;
+	grid->next = cells;
+	grid->width = width;
+	grid->height = height;
+}
+
+int print_image_delta(const jp2a_context *ctx, const Image* const image, delta_grid *grid, FILE *f) {
+	const int border = ctx->use_border ? 1 : 0;
+	// screen position of the first character of the frame
+	const int top = 1 + margin_top_height(ctx, image) + border;
+	const int left = 1 + margin_start_width(ctx, image) + border;
+	// every character might need a cursor movement, the last line also resets the colors and moves the cursor below the frame
+	const size_t line_size = (size_t) image->width * (ANSI_CURSOR_MAX + ANSI_CELL_MAX) + 4 + ANSI_CURSOR_MAX;
+	ansi_state emitted;
+	int any = 0;
+
+	if ( line_size > grid->line_size ) {
+		free(grid->line);
+		grid->line = (char*) malloc(line_size);
+		grid->line_size = grid->line ? line_size : 0;
+		if ( !grid->line )
+			return 0;
+	}
+
+	// every line of a full frame ends with a reset, and so does this function
+	ansi_state_reset(&emitted);
+
+	for ( int y = 0; y < image->height; ++y ) {
+		const delta_cell *old = &grid->cells[y * image->width];
+		const delta_cell *cells = &grid->next[y * image->width];
+		char *p = grid->line;
+		// column the cursor is at, -1 if it is not on this line
+		int cursor = -1;
+
+		for ( int x = 0; x < image->width; ++x ) {
+			if ( delta_cell_equal(&cells[x], &old[x]) )
+				continue;
+
+			if ( cursor >= 0 && x - cursor <= DELTA_GAP_MAX ) {
+				// printing a few unchanged characters is shorter than moving the cursor
+				for ( ; cursor < x; ++cursor ) {
+					size_t length;
+					const char *text = glyph_text(ctx, cells[cursor].glyph, &length);
+					p = ansi_transition(p, &emitted, &cells[cursor].state, ctx->colorDepth);
+					p = ansi_copy(p, text, length);
+					emitted = cells[cursor].state;
+				}
+			} else if ( cursor != x ) {
+				p = ansi_cursor(p, top + y, left + x);
+			}
+
+			size_t length;
+			const char *text = glyph_text(ctx, cells[x].glyph, &length);
+			p = ansi_transition(p, &emitted, &cells[x].state, ctx->colorDepth);
+			p = ansi_copy(p, text, length);
+			emitted = cells[x].state;
+			cursor = x + 1;
+		}
+
+		if ( p != grid->line ) {
+			fwrite(grid->line, 1, p - grid->line, f);
+			any = 1;
+		}
+	}
+
+	if ( any ) {
+		char *p = grid->line;
+		if ( emitted.fg != ANSI_DEFAULT || emitted.bg != ANSI_DEFAULT || emitted.bold )
+			p = ansi_sgr(p, 0);
+		p = ansi_cursor(p, top + image->height + border + margin_bottom_height(ctx, image), 1);
+		fwrite(grid->line, 1, p - grid->line, f);
+	}
+	return 1;
+}
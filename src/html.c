@@ -10,19 +10,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include "html.h"
-#include "options.h"
 
-void print_html_document_start(const int fontsize, FILE *f) {
+// closest of the color cube levels 0, 95, 135, 175, 215 and 255 of the 256 color palette
+#define CUBE_LEVEL(v) ((v) < 48 ? 0 : (v) < 115 ? 1 : ((v) - 35) / 40)
+
+void print_html_document_start(const jp2a_context *ctx, const int fontsize, FILE *f) {
 
 	fputs("<!DOCTYPE html>\n"
 		"<html>\n"
 		" <head>\n"
 		" <meta charset=\"utf-8\">\n", f);
 	fprintf(f,
-		" <title>%s</title>\n", html_title);
+		" <title>%s</title>\n", ctx->html_title);
 	fputs(
 		"  <style>\n", f);
-	print_css(fontsize, f);
+	print_css(ctx, fontsize, f);
 	fputs(
 		"  </style>\n"
 		" </head>\n"
@@ -41,31 +43,53 @@ void print_html_image_end(FILE *f) {
 	fputs("</pre>\n</div>\n", f);
 }
 
-#if ASCII
-void print_html_char(FILE *f, const char ch,
-	const int r_fg, const int g_fg, const int b_fg,
-	const int r_bg, const int g_bg, const int b_bg)
-#else
-void print_html_char(FILE *f, const char* ch,
-	const int r_fg, const int g_fg, const int b_fg,
-	const int r_bg, const int g_bg, const int b_bg)
-#endif
-{
-	if ( colorfill ) {
-		fprintf(f, "<span style='color:#%02x%02x%02x; background-color:#%02x%02x%02x;'>%s</span>",
-			r_fg, g_fg, b_fg,
-			r_bg, g_bg, b_bg,
-			html_entity(ch));
+void print_html_span_start(const jp2a_context *ctx, FILE *f, const int fg, const int bg) {
+	if ( ctx->html_classes ) {
+		if ( bg != HTML_NO_COLOR )
+			fprintf(f, "<span class='f%d b%d'>", fg, bg);
+		else
+			fprintf(f, "<span class='f%d'>", fg);
 	} else
-		fprintf(f, "<span style='color:#%02x%02x%02x;'>%s</span>",
-			r_fg, g_fg, b_fg, html_entity(ch));
+	if ( bg != HTML_NO_COLOR )
+		fprintf(f, "<span style='color:#%06x; background-color:#%06x;'>", fg, bg);
+	else
+		fprintf(f, "<span style='color:#%06x;'>", fg);
+}
+
+void print_html_span_end(FILE *f) {
+	fputs("</span>", f);
+}
+
+int html_palette_index(const int rgb) {
+	const int r = (rgb >> 16) & 0xff;
+	const int g = (rgb >> 8) & 0xff;
+	const int b = rgb & 0xff;
+
+	if ( r == g && g == b ) {
+		// gray ramp 232 to 255 from 8 to 238, black and white are in the color cube
+		if ( r < 4 ) return 16;
+		if ( r > 246 ) return 231;
+		int gray = (r - 3) / 10;
+		return 232 + (gray > 23 ? 23 : gray);
+	}
+	return 16 + 36 * CUBE_LEVEL(r) + 6 * CUBE_LEVEL(g) + CUBE_LEVEL(b);
+}
+
+int html_palette_color(const int index) {
+	if ( index >= 232 ) {
+		const int gray = 8 + 10 * (index - 232);
+		return gray * 0x010101;
+	}
+	static const int levels[6] = { 0, 95, 135, 175, 215, 255 };
+	const int i = index - 16;
+	return (levels[i / 36] << 16) | (levels[(i / 6) % 6] << 8) | levels[i % 6];
 }
 
 void print_html_newline(FILE *f) {
 	fputs("<br>", f);
 }
 
-void print_xhtml_document_start(const int fontsize, FILE *f) {
+void print_xhtml_document_start(const jp2a_context *ctx, const int fontsize, FILE *f) {
 	
 	fputs(   "<?xml version='1.0' encoding='UTF-8' ?>\n"
 		"<!DOCTYPE html PUBLIC '-//W3C//DTD XHTML 1.0 Strict//EN'"
@@ -73,10 +97,10 @@ void print_xhtml_document_start(const int fontsize, FILE *f) {
 		"<html xmlns='http://www.w3.org/1999/xhtml' lang='en' xml:lang='en'>\n"
 		"<head>\n", f);
 	fprintf(f,
-		"<title>%s</title>\n", html_title);
+		"<title>%s</title>\n", ctx->html_title);
 	fputs(
 		"<style type='text/css'>\n", f);
-	print_css(fontsize, f);
+	print_css(ctx, fontsize, f);
 	fputs(
 		"</style>\n"
 		"</head>\n"
@@ -95,65 +119,52 @@ void print_xhtml_image_end(FILE *f) {
 	fputs("</pre>\n</div>\n", f);
 }
 
-#if ASCII
-void print_xhtml_char(FILE *f, const char ch,
-	const int r_fg, const int g_fg, const int b_fg,
-	const int r_bg, const int g_bg, const int b_bg)
-#else
-void print_xhtml_char(FILE *f, const char* ch,
-	const int r_fg, const int g_fg, const int b_fg,
-	const int r_bg, const int g_bg, const int b_bg)
-#endif
-{
-	if ( colorfill ) {
-		fprintf(f, "<span style='color:#%02x%02x%02x; background-color:#%02x%02x%02x;'>%s</span>",
-			r_fg, g_fg, b_fg,
-			r_bg, g_bg, b_bg,
-			html_entity(ch));
-	} else
-		fprintf(f, "<span style='color:#%02x%02x%02x;'>%s</span>",
-			r_fg, g_fg, b_fg, html_entity(ch));
-}
-
 void print_xhtml_newline(FILE *f) {
 	fputs("<br/>", f);
 }
 
-void print_css(const int fontsize, FILE *f) {
+void print_css(const jp2a_context *ctx, const int fontsize, FILE *f) {
 	fputs("body {\n", f);
-	fputs(!invert?
+	fputs(!ctx->invert?
 		"   background-color: white;\n" : "background-color: black;\n", f);
-	if ( centerx || centery )
+	if ( ctx->centerx || ctx->centery )
 	fputs(  "   margin: 0;\n   padding: 0;\n", f); // only perform CSS reset in these conditions for backward compatibility
 	fputs(  "}\n"
 		".ascii {\n"
 		"   font-family: Courier;\n", f); // should be a monospaced font
-	if ( !usecolors )
-	fputs(!invert?
+	if ( !ctx->usecolors )
+	fputs(!ctx->invert?
 		"   color: black;\n" : "   color: white;\n", f);
 	fprintf(f,
 		"   font-size:%dpt;\n", fontsize);
-	if ( centerx && centery )
+	if ( ctx->centerx && ctx->centery )
 	fprintf(f,
 		"   display: flex;\n   min-height: 100vh;\n   align-items: center;\n   justify-content: center;\n");
-	else if ( centerx )
+	else if ( ctx->centerx )
 	fprintf(f,
 		"   display: flex;\n   justify-content: center;\n");
-	else if ( centery )
+	else if ( ctx->centery )
 	fprintf(f,
 		"   display: flex;\n   min-height: 100vh;\n   align-items: center;\n");
-	if ( html_bold )
+	if ( ctx->html_bold )
 	fputs( 	"   font-weight: bold;\n", f);
 	else
 	fputs(  "   font-weight: normal;\n", f);
 	fputs(
 		"}\n", f);
+	if ( ctx->html_classes && ctx->usecolors ) {
+		for ( int i = 16; i < 256; ++i ) {
+			fprintf(f, ".f%d { color: #%06x; }\n", i, html_palette_color(i));
+			if ( ctx->colorfill )
+				fprintf(f, ".b%d { background-color: #%06x; }\n", i, html_palette_color(i));
+		}
+	}
 }
 
 #if ASCII
 const char* html_entity(const char ch) { // if a html entity is larger than 6
 		// chars, change escape_title accordingly
-	static char s[2];
+	static _Thread_local char s[2];
 	switch ( ch ) {
 #else
 const char* html_entity(const char* ch) {
@@ -172,19 +183,19 @@ const char* html_entity(const char* ch) {
 	}
 }
 
-int escape_title() {
+int escape_title(jp2a_context *ctx) {
+	const char *html_title_raw = ctx->html_title_raw;
 	if ( strlen(html_title_raw)==0 ) {
 		return 1;
 	}
-	html_title = calloc(strlen(html_title_raw)*6 +1, sizeof(char)); // at most
+	char *html_title = calloc(strlen(html_title_raw)*6 +1, sizeof(char)); // at most
 			// 6 characters are returned by html_entity for each character
 	if ( html_title==NULL ) {
 		return 0;
 	}
 	int j = 0;
 	int sizeNew;
-	char* newChar;
-	for (int i = 0; i < strlen(html_title_raw); i++) {
+	for (size_t i = 0; i < strlen(html_title_raw); i++) {
 		if ( html_title_raw[i]=='&' ) { // otherwise HTML entities could not be
 			// used on purpose
 			html_title[j++] = '&';
@@ -204,7 +215,10 @@ int escape_title() {
 		}
 		j += sizeNew;
 	}
-	if ( realloc(html_title, (j+1) * sizeof(char))==NULL )
+	ctx->html_title = realloc(html_title, (j+1) * sizeof(char));
+	if ( ctx->html_title==NULL ) {
+		free(html_title);
 		return 0;
+	}
 	return 1;
 }
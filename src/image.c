@@ -23,66 +23,83 @@
 #include "png.h"
 #include "webp/decode.h"
 #include <libexif/exif-data.h>
-#include <libexif/exif-loader.h>
 #include <setjmp.h>
 
+#include "ansi.h"
 #include "aspect_ratio.h"
 #include "image.h"
-#include "jp2a.h"
-#include "options.h"
+#include "stream.h"
+#include "delta.h"
 #include "html.h"
+#include "render.h"
+#include "video.h"
 #include <math.h>
 
 #define ROUND(x) (int) ( 0.5f + x )
 
 static char DIRECTIONAL_CHARS[4] = "=/|\\";
 
-void print_margin_top(const Image *image, FILE *f) {
-	if ( centery && !( html || xhtml ) ) {
-		int total_margin = term_height - image->height;
-		if ( use_border ) {
+int margin_top_height(const jp2a_context *ctx, const Image *image) {
+	if ( ctx->centery && !( ctx->html || ctx->xhtml ) ) {
+		int total_margin = ctx->term_height - image->height;
+		if ( ctx->use_border ) {
 			total_margin -= 2;
 		}
 		if ( total_margin <= 0 )
-			return;
-		int margin_top = (int) floor(total_margin / 2);
-		for ( size_t i = 0; i < margin_top; i++ ) {
-			fprintf(f, "\n");
-		}
+			return 0;
+		return (int) floor(total_margin / 2);
 	}
+	return 0;
 }
 
-void print_margin_bottom(const Image *image, FILE *f) {
-	if ( centery && !( html || xhtml ) ) {
-		int total_margin = term_height - image->height;
-		if ( use_border ) {
+int margin_bottom_height(const jp2a_context *ctx, const Image *image) {
+	if ( ctx->centery && !( ctx->html || ctx->xhtml ) ) {
+		int total_margin = ctx->term_height - image->height;
+		if ( ctx->use_border ) {
 			total_margin -= 2;
 		}
 		if ( total_margin <= 0 )
-			return;
-		int margin_bottom = (int) ceil(total_margin / 2);
-		for ( size_t i = 0; i < margin_bottom; i++ ) {
-			fprintf(f, "\n");
-		}
+			return 0;
+		return (int) ceil(total_margin / 2);
+	}
+	return 0;
+}
+
+void print_margin_top(const jp2a_context *ctx, const Image *image, FILE *f) {
+	int margin_top = margin_top_height(ctx, image);
+	for ( int i = 0; i < margin_top; i++ ) {
+		fprintf(f, "\n");
 	}
 }
 
-void print_margin_start(const Image *image, FILE *f) {
-	if ( centerx && !( html || xhtml ) ) {
-		int total_margin = term_width - image->width;
-		if ( use_border ) {
+void print_margin_bottom(const jp2a_context *ctx, const Image *image, FILE *f) {
+	int margin_bottom = margin_bottom_height(ctx, image);
+	for ( int i = 0; i < margin_bottom; i++ ) {
+		fprintf(f, "\n");
+	}
+}
+
+int margin_start_width(const jp2a_context *ctx, const Image *image) {
+	if ( ctx->centerx && !( ctx->html || ctx->xhtml ) ) {
+		int total_margin = ctx->term_width - image->width;
+		if ( ctx->use_border ) {
 			total_margin -= 2;
 		}
 		if ( total_margin <= 0 )
-			return;
-		int margin_start = (int) floor(total_margin / 2);
-		for ( size_t i = 0; i < margin_start; i++ ) {
-			fprintf(f, " ");
-		}
+			return 0;
+		return (int) floor(total_margin / 2);
 	}
+	return 0;
 }
 
-void print_border(const int width) {
+void print_margin_start(const jp2a_context *ctx, const Image *image, FILE *f) {
+	int margin_start = margin_start_width(ctx, image);
+	for ( int i = 0; i < margin_start; i++ ) {
+		fprintf(f, " ");
+	}
+}
+
+void print_border(const int width, FILE *f) {
 	#ifndef HAVE_MEMSET
 	int n;
 	#endif
@@ -101,68 +118,110 @@ void print_border(const int width) {
 
 	bord[0] = bord[width+1] = '+';
 	bord[width+2] = 0;
-	puts(bord);
+	fputs(bord, f);
+	fputc('\n', f);
 
 	#ifdef WIN32
 	free(bord);
 	#endif
 }
 
-void print_image(Image *image, FILE *f) {
-	if ( verbose ) {
+int print_image(const jp2a_context *ctx, Image *image, FILE *f, FILE *image_out, FILE *err) {
+	if ( ctx->verbose ) {
 		fprintf(stderr, "\n");
 		fflush(stderr);
 	}
 
-	normalize(image);
+	normalize(ctx, image);
+	if ( image_out )
+		save_image(image, image_out);
+	if ( !orient_image(ctx, image) || !compute_edges(ctx, image) ) {
+		fprintf(err, "Not enough memory for given output dimension\n");
+		return 0;
+	}
 
-	if ( clearscr ) {
-		fprintf(f, "%c[2J", 27); // ansi code for clear
-		fprintf(f, "%c[0;0H", 27); // move to upper left
+	// true if the previous frame of a video is on the screen and gets printed over
+	int redraw = 0;
+	if ( image->delta ) {
+		const int changed = delta_grid_update(ctx, image, ctx->ascii_palette_length - 1, image->delta);
+		if ( changed != DELTA_REDRAW ) {
+			if ( changed <= ctx->redraw_threshold * image->width * image->height ) {
+				if ( !print_image_delta(ctx, image, image->delta, f) ) {
+					fprintf(err, "Not enough memory for given output dimension\n");
+					return 0;
+				}
+				delta_grid_commit(image->delta, image->width, image->height);
+				return 1;
+			}
+			redraw = 1;
+		}
+		delta_grid_commit(image->delta, image->width, image->height);
 	}
 
-	if ( html && !html_rawoutput ) print_html_image_start(f);
-	else if ( xhtml && !html_rawoutput ) print_xhtml_image_start(f);
-	print_margin_top(image, f);
-	if ( use_border ) {
-		print_margin_start(image, f);
-		print_border(image->width);
+	if ( ctx->clearscr ) {
+		if ( redraw ) {
+			fprintf(f, "%c[H", 27); // move to upper left, the frame has the same size as the one on the screen
+		} else {
+			fprintf(f, "%c[2J", 27); // ansi code for clear
+			fprintf(f, "%c[0;0H", 27); // move to upper left
+		}
 	}
 
-	(!usecolors? print_image_no_colors : print_image_colors) (image, ascii_palette_length - 1, f);
+	if ( ctx->html && !ctx->html_rawoutput ) print_html_image_start(f);
+	else if ( ctx->xhtml && !ctx->html_rawoutput ) print_xhtml_image_start(f);
+	print_margin_top(ctx, image, f);
+	if ( ctx->use_border ) {
+		print_margin_start(ctx, image, f);
+		print_border(image->width, f);
+	}
+
+	int printed;
+	if ( !ctx->usecolors )
+		printed = print_image_no_colors(ctx, image, ctx->ascii_palette_length - 1, f);
+	else
+	if ( !ctx->html && !ctx->xhtml )
+		printed = print_image_ansi(ctx, image, ctx->ascii_palette_length - 1, f);
+	else
+		printed = print_image_colors(ctx, image, ctx->ascii_palette_length - 1, f);
+	if ( !printed ) {
+		fprintf(err, "Not enough memory for given output dimension\n");
+		return 0;
+	}
 
-	if ( use_border ) {
-		print_margin_start(image, f);
-		print_border(image->width);
+	if ( ctx->use_border ) {
+		print_margin_start(ctx, image, f);
+		print_border(image->width, f);
 	}
-	print_margin_bottom(image, f);
-	if ( html && !html_rawoutput ) print_html_image_end(f);
-	else if ( xhtml && !html_rawoutput ) print_xhtml_image_end(f);
+	print_margin_bottom(ctx, image, f);
+	if ( ctx->html && !ctx->html_rawoutput ) print_html_image_end(f);
+	else if ( ctx->xhtml && !ctx->html_rawoutput ) print_xhtml_image_end(f);
+	return 1;
 }
 
-int get_pixel_index(const Image* const image, const int x, const int y) {
+int get_pixel_index(const jp2a_context *ctx, const Image* const image, const int x, const int y) {
 	float fx;
 	float fy;
 	switch (image->orientation) {
+		default:
 		case HORIZONTAL:
 		case MIRROR_HORIZONTAL_ROTATE_90:
-			fx = flipx ? image->width - x - 1 : x;
-			fy = flipy ? image->height - y - 1 : y;
+			fx = ctx->flipx ? image->width - x - 1 : x;
+			fy = ctx->flipy ? image->height - y - 1 : y;
 			break;
 		case MIRROR_HORIZONTAL:
 		case ROTATE_270:
-			fx = flipx ? x : image->width - x - 1;
-			fy = flipy ? image->height - y - 1 : y;
+			fx = ctx->flipx ? x : image->width - x - 1;
+			fy = ctx->flipy ? image->height - y - 1 : y;
 			break;
 		case ROTATE_180:
 		case MIRROR_HORIZONTAL_ROTATE_270:
-			fx = flipx ? x : image->width - x - 1;
-			fy = flipy ? y : image->height - y - 1;
+			fx = ctx->flipx ? x : image->width - x - 1;
+			fy = ctx->flipy ? y : image->height - y - 1;
 			break;
 		case MIRROR_VERTICAL:
 		case ROTATE_90:
-			fx = flipx ? image->width - x - 1 : x;
-			fy = flipy ? y : image->height - y - 1;
+			fx = ctx->flipx ? image->width - x - 1 : x;
+			fy = ctx->flipy ? y : image->height - y - 1;
 			break;
 
 	}
@@ -179,7 +238,8 @@ typedef struct {
 	float y;
 } vec2;
 
-vec2 get_image_gradient(const Image* const image, const int x, const int y) {
+vec2 get_image_gradient(const jp2a_context *ctx, const Image* const image, const int x, const int y) {
+	(void) ctx;
 	const float kernel_x[4] = {
 		-1., 0.,
 		 1., 0.
@@ -188,11 +248,15 @@ vec2 get_image_gradient(const Image* const image, const int x, const int y) {
 		-1., 1.,
 		 0., 0.
 	};
+	// the image is in display order (see orient_image()), neighbours past the last column or row are clamped
+	const int row = y * image->width;
+	const int next_row = y + 1 < image->height ? row + image->width : row;
+	const int next_x = x + 1 < image->width ? x + 1 : x;
 	const float patch[4] = {
-		image->pixel[get_pixel_index(image, x  , y  )],
-		image->pixel[get_pixel_index(image, x+1, y  )],
-		image->pixel[get_pixel_index(image, x  , y+1)],
-		image->pixel[get_pixel_index(image, x+1, y+1)],
+		IMAGE_FLOAT(image->pixel[row      + x     ]),
+		IMAGE_FLOAT(image->pixel[row      + next_x]),
+		IMAGE_FLOAT(image->pixel[next_row + x     ]),
+		IMAGE_FLOAT(image->pixel[next_row + next_x]),
 	};
 	vec2 grad = {0., 0.};
 	for( int i = 0; i < 4; ++i ) {
@@ -210,218 +274,338 @@ float direction( const vec2 v ) {
 	return atan(v.y / v.x);
 }
 
-void print_image_colors(const Image* const image, const int chars, FILE* f) {
-
-	for ( int y=0;  y < image->height; ++y ) {
-		float prev_Y = -1.0;
-		float prev_R = -1.0;
-		float prev_G = -1.0;
-		float prev_B = -1.0;
-		float prev_A = -1.0;
+int uses_edges(const jp2a_context *ctx) {
+	return ctx->edges_only || ctx->edge_threshold < EDGE_MAGNITUDE_MAX;
+}
 
-		if ( !html && !xhtml && usecolors )
-			fprintf(f, "\e[0m"); // reset colors
+int compute_edges(const jp2a_context *ctx, Image* i) {
+	if ( !uses_edges(ctx) )
+		return 1;
 
-		print_margin_start(image, f);
+	if ( !i->edges )
+		i->edges = (signed char*) malloc(i->width * i->height);
+	if ( !i->edges )
+		return 0;
 
-		if ( use_border ) fprintf(f, "|");
+	render_edges(ctx, i);
+	return 1;
+}
 
-		for ( int x=0; x < image->width; x += 1 ) {
+void compute_edges_rows(const jp2a_context *ctx, const Image* const i, const int y_begin, const int y_end) {
+	for ( int y = y_begin; y < y_end; ++y ) {
+		for ( int x = 0; x < i->width; ++x ) {
+			const vec2 gradient = get_image_gradient(ctx, i, x, y);
+			const float m = magnitude(gradient);
+			signed char edge = EDGE_NONE;
+			if ( m < ctx->edge_threshold ) {
+				edge = EDGE_BELOW_THRESHOLD;
+			} else
+			if ( m > ctx->edge_threshold && m > 0.0f ) {
+				// scale the gradient direction in the range -2 to 2, then add .5 to offset direction bins to match character directions
+				float direction_scaled = direction(gradient) / M_PI * 4. + .5;
+				// use +4 and fmod to bring the direction into the range 0-4, then use (int) to get an index 0-3 into DIRECTIONAL_CHARS array
+				edge = (int) fmod(direction_scaled + 4., 4.);
+			}
+			i->edges[y * i->width + x] = edge;
+		}
+	}
+}
 
-			const int pixel_index = get_pixel_index(image, x, y);
-			float Y = image->pixel[pixel_index];
-			float R = image->red  [pixel_index];
-			float G = image->green[pixel_index];
-			float B = image->blue [pixel_index];
-			float A = image->alpha[pixel_index];
-			R *= A;
-			G *= A;
-			B *= A;
-			const vec2 gradient = get_image_gradient(image, x, y);
-			int pos = ROUND((float)chars * Y);
+uint16_t image_opacity(const Image* const image, const int pixel_index) {
+	if ( !image->alpha )
+		return IMAGE_ONE;
+	return image->rgba[image->channels * pixel_index + image->channels - 1];
+}
 
-			if( edges_only && magnitude(gradient) < edge_threshold ) {
-				pos = 0;
-			}
+int image_glyph(const jp2a_context *ctx, const Image* const image, const int chars, const int pixel_index) {
+	const int edge = image->edges ? image->edges[pixel_index] : EDGE_NONE;
+	int pos = ROUND((float)chars * IMAGE_FLOAT(image->pixel[pixel_index]));
 
-			int i = invert? pos : chars - pos;
-			i = ROUND((float)i * A);
+	if ( edge >= 0 )
+		return GLYPH_EDGE + edge;
+	if( ctx->edges_only && edge == EDGE_BELOW_THRESHOLD ) {
+		pos = 0;
+	}
 
-			char ch[MB_LEN_MAX + 1];
-#define PRINTF_FORMAT_TYPE "%s"
+	int i = ctx->invert? pos : chars - pos;
+	return ROUND((float)i * IMAGE_FLOAT(image_opacity(image, pixel_index)));
+}
 
+const char *glyph_text(const jp2a_context *ctx, const int glyph, size_t *length) {
+	if ( glyph >= GLYPH_EDGE ) {
+		*length = 1;
+		return &DIRECTIONAL_CHARS[glyph - GLYPH_EDGE];
+	}
 #if ASCII
-			char* char_start = &ascii_palette[i];
-			size_t char_len = 1;
+	*length = 1;
+	return &ctx->ascii_palette[glyph];
 #else
-			char* char_start = &ascii_palette[ascii_palette_indizes[i]];
-			size_t char_len = ascii_palette_lengths[i];
+	*length = ctx->ascii_palette_lengths[glyph];
+	return &ctx->ascii_palette[ctx->ascii_palette_indizes[glyph]];
 #endif
-			if( magnitude(gradient) > edge_threshold ) {
-				// scale the gradient direction in the range -2 to 2, then add .5 to offset direction bins to match character directions
-				float direction_scaled = direction(gradient) / M_PI * 4. + .5;
-				// use +4 and fmod to bring the direction into the range 0-4, then use (int) to get an index 0-3 into DIRECTIONAL_CHARS array
-				char_start = &DIRECTIONAL_CHARS[ (int) fmod(direction_scaled + 4., 4.) ];
-				char_len = 1;
+}
+
+void image_ansi_state(const jp2a_context *ctx, const Image* const image, const int pixel_index, ansi_state *current, ansi_state *state) {
+	float Y = IMAGE_FLOAT(image->pixel[pixel_index]);
+	float R = 0.0f, G = 0.0f, B = 0.0f; // grayscale output has no colors
+	if ( image->colors ) {
+		const uint16_t *rgba = &image->rgba[image->channels * pixel_index];
+		R = IMAGE_FLOAT(rgba[0]);
+		G = IMAGE_FLOAT(rgba[1]);
+		B = IMAGE_FLOAT(rgba[2]);
+	}
+	float A = IMAGE_FLOAT(image_opacity(image, pixel_index));
+	R *= A;
+	G *= A;
+	B *= A;
+
+	const float min = 1.0f / 255.0f;
+
+	// the state this character is printed with and the state the next character starts from
+	ansi_state cell = *current;
+	ansi_state next;
+
+	if ( ctx->colorDepth==4 ) {
+		const float t = 0.1f; // threshold
+		const float i = 1.0f - t;
+
+		int colr = 0;
+		int highl = 0;
+
+		// ANSI highlite, only use in grayscale
+	        if ( Y>=0.95f && R<min && G<min && B<min ) highl = 1; // ANSI highlite
+
+		if ( !ctx->convert_grayscale ) {
+		     if ( R-t>G && R-t>B )            colr = 31; // red
+		else if ( G-t>R && G-t>B )            colr = 32; // green
+		else if ( R-t>B && G-t>B && R+G>i )   colr = 33; // yellow
+		else if ( B-t>R && B-t>G && Y<0.95f ) colr = 34; // blue
+		else if ( R-t>G && B-t>G && R+B>i )   colr = 35; // magenta
+		else if ( G-t>R && B-t>R && B+G>i )   colr = 36; // cyan
+		else if ( R+G+B>=3.0f*Y )             colr = 37; // white
+		} else {
+			if ( Y>=0.7f ) { highl=1; colr = 37; }
+		}
+
+		if ( !colr ) {
+			// uncolored characters keep the previous color, highlighted ones are followed by a reset
+			next = cell;
+			if ( highl ) {
+				cell.bold = 1;
+				ansi_state_reset(&next);
+			}
+		} else {
+			if ( ctx->colorfill ) cell.bg = colr + 10; // set to ANSI background color
+			else                  cell.fg = colr;      // ANSI color
+			next = cell;
+		}
+	} else
+	if ( ctx->colorDepth==8 ) {
+		int fill = ANSI_DEFAULT;
+		int color;
+		if ( ctx->convert_grayscale || (R<min && G<min && B<min && Y>min) ) {
+			if ( Y < 0.15 ) {
+				fill = 0;
+				color = 0;
+			} else
+			if ( Y > 0.965 ) {
+				fill = 244;
+				color = 231;
+			} else {
+				fill = ROUND(24.0f*Y*0.5f) + 232;
+				color = ROUND(24.0f*Y) + 232;
 			}
+		} else {
+			fill = 16 + 36 * ROUND(5.0f*Y*R) + 6 * ROUND(5.0f*Y*G) + ROUND(5.0f*Y*B); // foreground color
+			color = 16 + 36 * ROUND(5.0f*R) + 6 * ROUND(5.0f*G) + ROUND(5.0f*B); // color
+		}
+		if ( ctx->colorfill ) {
+			cell.fg = fill;
+			cell.bg = color;
+		} else {
+			cell.fg = color;
+		}
+		next = cell;
+	} else {
+		int fill;
+		int color;
+		if ( ctx->convert_grayscale || (R<min && G<min && B<min && Y>min) ) {
+			fill = ROUND(255.0f*Y*0.5f) * 0x010101;
+			color = ROUND(255.0f*Y) * 0x010101;
+		} else {
+			fill = (ROUND(255.0f*Y*R) << 16) | (ROUND(255.0f*Y*G) << 8) | ROUND(255.0f*Y*B); // foreground color
+			color = (ROUND(255.0f*R) << 16) | (ROUND(255.0f*G) << 8) | ROUND(255.0f*B); // color
+		}
+		if ( ctx->colorfill ) {
+			cell.fg = fill;
+			cell.bg = color;
+		} else {
+			cell.fg = color;
+		}
+		next = cell;
+	}
 
-			memcpy(ch, char_start, char_len);
-			ch[char_len] = '\0';
+	*state = cell;
+	*current = next;
+}
 
-			if ( !html && !xhtml && Y == prev_Y && R == prev_R && G == prev_G && B == prev_B && A == prev_A) {
-				fprintf(f, PRINTF_FORMAT_TYPE, ch);
-				continue;
+int print_image_ansi(const jp2a_context *ctx, const Image* const image, const int chars, FILE *f) {
+	return render_rows(ctx, image, chars, print_image_ansi_rows, f);
+}
+
+int print_image_ansi_rows(const jp2a_context *ctx, const Image* const image, const int chars, const int y_begin, const int y_end, FILE *f) {
+	const int margin = margin_start_width(ctx, image);
+	// reset, margin, borders, reset and newline plus the characters
+	const size_t line_size = 4 + margin + 2 + 4 + 1 + (size_t) image->width * ANSI_CELL_MAX;
+	char *line = (char*) malloc(line_size);
+	if ( !line )
+		return 0;
+
+	for ( int y=y_begin; y < y_end; ++y ) {
+		// state the terminal is in and state the colors of the previous character asked for
+		ansi_state emitted;
+		ansi_state current;
+		ansi_state_reset(&emitted);
+		ansi_state_reset(&current);
+
+		char *p = ansi_sgr(line, 0); // reset colors
+		memset(p, ' ', margin);
+		p += margin;
+
+		if ( ctx->use_border ) *p++ = '|';
+
+		for ( int x=0; x < image->width; x += 1 ) {
+
+			const int pixel_index = y * image->width + x;
+			size_t char_len;
+			const char *char_start = glyph_text(ctx, image_glyph(ctx, image, chars, pixel_index), &char_len);
+			ansi_state cell;
+			image_ansi_state(ctx, image, pixel_index, &current, &cell);
+
+			p = ansi_transition(p, &emitted, &cell, ctx->colorDepth);
+			p = ansi_copy(p, char_start, char_len);
+			emitted = cell;
+		}
+
+		if ( emitted.fg != ANSI_DEFAULT || emitted.bg != ANSI_DEFAULT || emitted.bold )
+			p = ansi_sgr(p, 0);
+
+		if ( ctx->use_border )
+			*p++ = '|';
+		*p++ = '\n';
+
+		fwrite(line, 1, p - line, f);
+	}
+
+	free(line);
+	return 1;
+}
+
+int print_image_colors(const jp2a_context *ctx, const Image* const image, const int chars, FILE *f) {
+	return render_rows(ctx, image, chars, print_image_colors_rows, f);
+}
+
+int print_image_colors_rows(const jp2a_context *ctx, const Image* const image, const int chars, const int y_begin, const int y_end, FILE *f) {
+
+	for ( int y=y_begin; y < y_end; ++y ) {
+		// characters with the same colors share a span
+		int span_open = 0;
+		int span_fg = 0;
+		int span_bg = HTML_NO_COLOR;
+
+		print_margin_start(ctx, image, f);
+
+		if ( ctx->use_border ) fprintf(f, "|");
+
+		for ( int x=0; x < image->width; x += 1 ) {
+
+			const int pixel_index = y * image->width + x;
+			float Y = IMAGE_FLOAT(image->pixel[pixel_index]);
+			float R = 0.0f, G = 0.0f, B = 0.0f; // grayscale output has no colors
+			if ( image->colors ) {
+				const uint16_t *rgba = &image->rgba[image->channels * pixel_index];
+				R = IMAGE_FLOAT(rgba[0]);
+				G = IMAGE_FLOAT(rgba[1]);
+				B = IMAGE_FLOAT(rgba[2]);
 			}
-			prev_Y = Y;
-			prev_R = R;
-			prev_G = G;
-			prev_B = B;
-			prev_A = A;
+			float A = IMAGE_FLOAT(image_opacity(image, pixel_index));
+			R *= A;
+			G *= A;
+			B *= A;
 
-			const float min = 1.0f / 255.0f;
+			char ch[MB_LEN_MAX + 1];
+			size_t char_len;
+			const char *char_start = glyph_text(ctx, image_glyph(ctx, image, chars, pixel_index), &char_len);
 
-			if ( !html && !xhtml ) {
-				if ( colorDepth==4 ) {
-					const float t = 0.1f; // threshold
-					const float i = 1.0f - t;
-
-					int colr = 0;
-					int highl = 0;
-
-					// ANSI highlite, only use in grayscale
-				        if ( Y>=0.95f && R<min && G<min && B<min ) highl = 1; // ANSI highlite
-
-					if ( !convert_grayscale ) {
-					     if ( R-t>G && R-t>B )            colr = 31; // red
-					else if ( G-t>R && G-t>B )            colr = 32; // green
-					else if ( R-t>B && G-t>B && R+G>i )   colr = 33; // yellow
-					else if ( B-t>R && B-t>G && Y<0.95f ) colr = 34; // blue
-					else if ( R-t>G && B-t>G && R+B>i )   colr = 35; // magenta
-					else if ( G-t>R && B-t>R && B+G>i )   colr = 36; // cyan
-					else if ( R+G+B>=3.0f*Y )             colr = 37; // white
-					} else {
-						if ( Y>=0.7f ) { highl=1; colr = 37; }
-					}
+			memcpy(ch, char_start, char_len);
+			ch[char_len] = '\0';
 
-					if ( !colr ) {
-						if ( !highl ) fprintf(f, PRINTF_FORMAT_TYPE, ch);
-						else          fprintf(f, "\e[1m" PRINTF_FORMAT_TYPE "\e[0m", ch);
-					} else {
-						if ( colorfill ) colr += 10;          // set to ANSI background color
-						fprintf(f, "\e[%dm" PRINTF_FORMAT_TYPE, colr, ch); // ANSI color
-					}
+			const float min = 1.0f / 255.0f;
+			int fg;
+			int bg = HTML_NO_COLOR;
+
+			// either --grayscale is specified (convert_grayscale)
+			// or we can see that the image is inherently a grayscale image
+			if ( ctx->convert_grayscale || (R<min && G<min && B<min && Y>min) ) {
+				// Grayscale image
+				if ( ctx->colorfill ) {
+					fg = ROUND(255.0f*Y*0.5f) * 0x010101;
+					bg = ROUND(255.0f*Y) * 0x010101;
 				} else
-				if ( colorDepth==8 ) {
-					int type = 38;                        // 38 = foreground; 48 = background
-					if ( colorfill ) type += 10;          // set to background color
-					if ( convert_grayscale || (R<min && G<min && B<min && Y>min) ) {
-						if ( Y < 0.15 ) {
-							if ( colorfill )
-								fprintf(f, "\e[38;5;%dm", 0);
-							fprintf(f, "\e[%d;5;0%dm" PRINTF_FORMAT_TYPE, type, 0, ch);
-						} else
-						if ( Y > 0.965 ) {
-							if ( colorfill )
-								fprintf(f, "\e[38;5;%dm", 244);
-							fprintf(f, "\e[%d;5;%dm" PRINTF_FORMAT_TYPE, type, 231, ch);
-						} else {
-							if ( colorfill )
-								fprintf(f, "\e[38;5;%dm", ROUND(24.0f*Y*0.5f) + 232);
-							fprintf(f, "\e[%d;5;%dm" PRINTF_FORMAT_TYPE, type, ROUND(24.0f*Y) + 232, ch);
-						}
-					} else {
-						if ( colorfill )
-							fprintf(f, "\e[38;5;%dm", 16 + 36 * ROUND(5.0f*Y*R) + 6 * ROUND(5.0f*Y*G) + ROUND(5.0f*Y*B)); // foreground color
-						fprintf(f, "\e[%d;5;%dm" PRINTF_FORMAT_TYPE, type, 16 + 36 * ROUND(5.0f*R) + 6 * ROUND(5.0f*G) + ROUND(5.0f*B), ch); // color
-					}
+					fg = ROUND(255.0f*Y) * 0x010101;
+			} else {
+				if ( ctx->colorfill ) {
+					fg = (ROUND(255.0f*Y*R) << 16) | (ROUND(255.0f*Y*G) << 8) | ROUND(255.0f*Y*B);
+					bg = (ROUND(255.0f*R) << 16) | (ROUND(255.0f*G) << 8) | ROUND(255.0f*B);
 				} else
-				if ( colorDepth==24 ) {
-					int type = 38;                        // 38 = foreground; 48 = background
-					if ( colorfill ) type += 10;          // set to background color
-					if ( convert_grayscale || (R<min && G<min && B<min && Y>min) ) {
-						if ( colorfill )
-							fprintf(f, "\x1b[38;2;%d;%d;%dm", ROUND(255.0f*Y*0.5f), ROUND(255.0f*Y*0.5f), ROUND(255.0f*Y*0.5f));
-						fprintf(f, "\x1b[%d;2;%d;%d;%dm" PRINTF_FORMAT_TYPE, type, ROUND(255.0f*Y), ROUND(255.0f*Y), ROUND(255.0f*Y), ch);
-					} else {
-						if ( colorfill )
-							fprintf(f, "\x1b[38;2;%d;%d;%dm", ROUND(255.0f*Y*R), ROUND(255.0f*Y*G), ROUND(255.0f*Y*B)); // foreground color
-						fprintf(f, "\x1b[%d;2;%d;%d;%dm" PRINTF_FORMAT_TYPE, type, ROUND(255.0f*R), ROUND(255.0f*G), ROUND(255.0f*B), ch); // color
-					}
-				}
+					fg = (ROUND(255.0f*R) << 16) | (ROUND(255.0f*G) << 8) | ROUND(255.0f*B);
+			}
 
-			} else
-			if ( html ) {  // HTML output
-			
-				// either --grayscale is specified (convert_grayscale)
-				// or we can see that the image is inherently a grayscale image	
-				if ( convert_grayscale || (R<min && G<min && B<min && Y>min) ) {
-					// Grayscale image
-					if ( colorfill )
-						print_html_char(f, ch,
-							ROUND(255.0f*Y*0.5f), ROUND(255.0f*Y*0.5f), ROUND(255.0f*Y*0.5f),
-							ROUND(255.0f*Y),      ROUND(255.0f*Y),      ROUND(255.0f*Y));
-					else
-						print_html_char(f, ch,
-							ROUND(255.0f*Y), ROUND(255.0f*Y), ROUND(255.0f*Y),
-							255, 255, 255);
-				} else {
-					if ( colorfill )
-						print_html_char(f, ch,
-							ROUND(255.0f*Y*R), ROUND(255.0f*Y*G), ROUND(255.0f*Y*B),
-							ROUND(255.0f*R),   ROUND(255.0f*G),   ROUND(255.0f*B));
-					else
-						print_html_char(f, ch,
-							ROUND(255.0f*R), ROUND(255.0f*G), ROUND(255.0f*B),
-							255, 255, 255);
-				}
-			} else 
-			if ( xhtml ) {  // XHTML output
-			
-				// either --grayscale is specified (convert_grayscale)
-				// or we can see that the image is inherently a grayscale image	
-				if ( convert_grayscale || (R<min && G<min && B<min && Y>min) ) {
-					// Grayscale image
-					if ( colorfill )
-						print_xhtml_char(f, ch,
-							ROUND(255.0f*Y*0.5f), ROUND(255.0f*Y*0.5f), ROUND(255.0f*Y*0.5f),
-							ROUND(255.0f*Y),      ROUND(255.0f*Y),      ROUND(255.0f*Y));
-					else
-						print_xhtml_char(f, ch,
-							ROUND(255.0f*Y), ROUND(255.0f*Y), ROUND(255.0f*Y),
-							255, 255, 255);
-				} else {
-					if ( colorfill )
-						print_xhtml_char(f, ch,
-							ROUND(255.0f*Y*R), ROUND(255.0f*Y*G), ROUND(255.0f*Y*B),
-							ROUND(255.0f*R),   ROUND(255.0f*G),   ROUND(255.0f*B));
-					else
-						print_xhtml_char(f, ch,
-							ROUND(255.0f*R), ROUND(255.0f*G), ROUND(255.0f*B),
-							255, 255, 255);
-				}
+			if ( ctx->html_classes ) {
+				fg = html_palette_index(fg);
+				if ( bg != HTML_NO_COLOR )
+					bg = html_palette_index(bg);
 			}
+
+			if ( !span_open || fg != span_fg || bg != span_bg ) {
+				if ( span_open )
+					print_html_span_end(f);
+				print_html_span_start(ctx, f, fg, bg);
+				span_open = 1;
+				span_fg = fg;
+				span_bg = bg;
+			}
+#if ASCII
+			fputs(html_entity(ch[0]), f);
+#else
+			fputs(html_entity(ch), f);
+#endif
 		}
 
-		if ( usecolors && !html && !xhtml )
-			fprintf(f, "\e[0m");
+		if ( span_open )
+			print_html_span_end(f);
 
-		if ( use_border )
+		if ( ctx->use_border )
 			fputc('|', f);
 
-		if ( html )
+		if ( ctx->html )
 			print_html_newline(f);
 		else
-		if ( xhtml )
 			print_xhtml_newline(f);
-		else
-			fputc('\n', f);
 	}
+	return 1;
+}
+
+int print_image_no_colors(const jp2a_context *ctx, const Image* const image, const int chars, FILE *f) {
+	return render_rows(ctx, image, chars, print_image_no_colors_rows, f);
 }
 
-void print_image_no_colors(const Image* const image, const int chars, FILE *f) {
+int print_image_no_colors_rows(const jp2a_context *ctx, const Image* const image, const int chars, const int y_begin, const int y_end, FILE *f) {
 #if ASCII
 	#ifdef WIN32
 	char *line = (char*) malloc(image->width + 1);
+	if ( !line )
+		return 0;
 	#else
 	char line[image->width + 1];
 	#endif
@@ -429,127 +613,122 @@ void print_image_no_colors(const Image* const image, const int chars, FILE *f) {
 #else
 	#ifdef WIN32
 	char *line = (char*) malloc(image->width * MB_LEN_MAX + 1);
+	if ( !line )
+		return 0;
 	#else
 	char line[image->width * MB_LEN_MAX + 1];
 	#endif
 	line[image->width * MB_LEN_MAX] = 0;
 #endif
 
-	for ( int y=0; y < image->height; ++y ) {
-		print_margin_start(image, f);
+	for ( int y=y_begin; y < y_end; ++y ) {
+		print_margin_start(ctx, image, f);
 
 		int curLinePos = 0;
 		for ( int x=0; x < image->width; ++x ) {
 
-			const int pixel_index = get_pixel_index(image, x, y);
-			const float lum = image->pixel[pixel_index];
-			const float opacity = image->alpha[pixel_index];
-			const vec2 gradient = get_image_gradient(image, x, y);
-			int pos = ROUND((float)chars * lum);
-
-			if( edges_only && magnitude(gradient) < edge_threshold ) {
-				pos = 0;
-			}
-
-			int i = invert? pos : chars - pos;
-			i = ROUND((float)i * opacity);
-
+			const int pixel_index = y * image->width + x;
 			char* char_dest = &line[curLinePos];
-#if ASCII
-			char* char_start = &ascii_palette[i];
-			size_t char_len = 1;
-#else
-			char* char_start = &ascii_palette[ascii_palette_indizes[i]];
-			size_t char_len = ascii_palette_lengths[i];
-#endif
-			if( magnitude(gradient) > edge_threshold ) {
-				// scale the gradient direction in the range -2 to 2, then add .5 to offset direction bins to match character directions
-				float direction_scaled = direction(gradient) / M_PI * 4. + .5;
-				// use +4 and fmod to bring the direction into the range 0-4, then use (int) to get an index 0-3 into DIRECTIONAL_CHARS array
-				char_start = &DIRECTIONAL_CHARS[ (int) fmod(direction_scaled + 4., 4.) ];
-				char_len = 1;
-			}
+			size_t char_len;
+			const char *char_start = glyph_text(ctx, image_glyph(ctx, image, chars, pixel_index), &char_len);
 			memcpy(char_dest, char_start, char_len);
 			curLinePos += char_len;
 			line[curLinePos] = '\0';
 		}
-		fprintf(f, !use_border? "%s\n" : "|%s|\n", line);
+		fprintf(f, !ctx->use_border? "%s\n" : "|%s|\n", line);
 	}
 
 #ifdef WIN32
 	free(line);
 #endif
+	return 1;
 }
 
-void clear(Image* i) {
-	memset(i->yadds, 0, i->src_height * sizeof(int) );
-	memset(i->pixel, 0, i->width * i->height * sizeof(float));
-	for ( int j = 0; j < i->width * i->height; ++j ) {
-		i->alpha[j] = 1.0;
+void clear(const jp2a_context *ctx, Image* i) {
+	(void) ctx;
+	const size_t size = (size_t) i->width * i->height;
+	memset(i->pixel, 0, size * sizeof(uint16_t));
+	if ( i->channels > 0 )
+		memset(i->rgba, 0, size * i->channels * sizeof(uint16_t));
+	// only images with an alpha channel store their opacity
+	if ( i->alpha ) {
+		for ( size_t j = i->channels - 1; j < size * i->channels; j += i->channels )
+			i->rgba[j] = IMAGE_ONE;
 	}
 	memset(i->lookup_resx, 0, (1 + i->src_width) * sizeof(int) );
-
-	if ( usecolors ) {
-		memset(i->red,   0, i->width * i->height * sizeof(float));
-		memset(i->green, 0, i->width * i->height * sizeof(float));
-		memset(i->blue,  0, i->width * i->height * sizeof(float));
-	}
 }
 
-void normalize(Image* i) {
-
-	float *pixel = i->pixel;
-	float *red   = i->red;
-	float *green = i->green;
-	float *blue  = i->blue;
-
-	int x, y;
-
-	for ( y=0; y < i->src_height; ++y ) {
+void normalize(const jp2a_context *ctx, Image* i) {
+	resample_finish(ctx, i);
+}
 
-		if ( i->yadds[y] > 1 ) {
+int orient_image(const jp2a_context *ctx, Image* i) {
+	const int size = i->width * i->height;
 
-			for ( x=0; x < i->src_width; ++x ) {
-				pixel[x] /= i->yadds[y];
+	if ( i->orientation == HORIZONTAL && !i->switch_x_y && !ctx->flipx && !ctx->flipy )
+		return 1;
 
-				if ( usecolors ) {
-					red  [x] /= i->yadds[y];
-					green[x] /= i->yadds[y];
-					blue [x] /= i->yadds[y];
-				}
-			}
-		}
+	// the transformation is linear, so three lookups give the index of the first pixel and the steps along x and y
+	const int start = get_pixel_index(ctx, i, 0, 0);
+	const int step_x = i->width > 1 ? get_pixel_index(ctx, i, 1, 0) - start : 0;
+	const int step_y = i->height > 1 ? get_pixel_index(ctx, i, 0, 1) - start : 0;
 
-		pixel += i->src_width;
+	const int channels = i->channels;
+	uint16_t *pixel = (uint16_t*) malloc(size * sizeof(uint16_t));
+	uint16_t *rgba = channels > 0 ? (uint16_t*) malloc(channels * size * sizeof(uint16_t)) : NULL;
+	if ( !pixel || (channels > 0 && !rgba) ) {
+		free(pixel);
+		free(rgba);
+		return 0;
+	}
 
-		if ( usecolors ) {
-			red   += i->src_width;
-			green += i->src_width;
-			blue  += i->src_width;
+	uint16_t *dst = pixel;
+	uint16_t *dst_rgba = rgba;
+	for ( int y = 0; y < i->height; ++y ) {
+		int index = start + y * step_y;
+		for ( int x = 0; x < i->width; ++x ) {
+			*dst++ = i->pixel[index];
+			for ( int c = 0; c < channels; ++c )
+				*dst_rgba++ = i->rgba[channels * index + c];
+			index += step_x;
 		}
 	}
+	free(i->pixel);
+	free(i->rgba);
+	i->pixel = pixel;
+	i->rgba = rgba;
+
+	i->orientation = HORIZONTAL;
+	i->switch_x_y = 0;
+	i->src_width = i->width;
+	i->src_height = i->height;
+	return 1;
 }
 
 void print_progress(float progress) {
 	int pos;
 	#define BARLEN 56
 
-	static char s[BARLEN];
-	s[BARLEN-1] = 0;
+	char s[BARLEN];
 
 	pos = ROUND( (float) (BARLEN-2) * progress );
+	if ( pos > BARLEN-2 )
+		pos = BARLEN-2;
 
 	memset(s, '.', BARLEN-2);
 	memset(s, '#', pos);
+	s[BARLEN-2] = 0;
 
 	fprintf(stderr, "Decompressing image [%s]\r", s);
 	fflush(stderr);
 }
 
-void print_info_jpeg(const struct jpeg_decompress_struct* jpg, const Orientation orientation) {
-	fprintf(stderr, "Source width: %d\n", jpg->output_width);
-	fprintf(stderr, "Source height: %d\n", jpg->output_height);
+void print_info_jpeg(const jp2a_context *ctx, const struct jpeg_decompress_struct* jpg, const Orientation orientation, const int width, const int height) {
+	fprintf(stderr, "Source width: %d\n", jpg->image_width);
+	fprintf(stderr, "Source height: %d\n", jpg->image_height);
 	fprintf(stderr, "Source color components: %d\n", jpg->output_components);
+	if ( jpg->scale_denom > jpg->scale_num )
+		fprintf(stderr, "Decompressed at: %dx%d (scale %d/%d)\n", jpg->output_width, jpg->output_height, jpg->scale_num, jpg->scale_denom);
 	switch ( orientation ) {
 		case HORIZONTAL:
 			fprintf(stderr, "Orientation: 1 (Horizontal/normal)\n");
@@ -578,10 +757,10 @@ void print_info_jpeg(const struct jpeg_decompress_struct* jpg, const Orientation
 	}
 	fprintf(stderr, "Output width: %d\n", width);
 	fprintf(stderr, "Output height: %d\n", height);
-	fprintf(stderr, "Output palette (%d chars): '%s'\n", ascii_palette_length, ascii_palette);
+	fprintf(stderr, "Output palette (%d chars): '%s'\n", ctx->ascii_palette_length, ctx->ascii_palette);
 }
 
-void print_info_png(const png_structp png_ptr, const png_infop info_ptr) {
+void print_info_png(const jp2a_context *ctx, const png_structp png_ptr, const png_infop info_ptr, const int width, const int height) {
 	fprintf(stderr, "Source width: %d\n", png_get_image_width(png_ptr, info_ptr));
 	fprintf(stderr, "Source height: %d\n", png_get_image_height(png_ptr, info_ptr));
 	fprintf(stderr, "Source channel count: %d ", png_get_channels(png_ptr, info_ptr));
@@ -613,10 +792,10 @@ void print_info_png(const png_structp png_ptr, const png_infop info_ptr) {
 	fprintf(stderr, "Source bit depth: %d\n", png_get_bit_depth(png_ptr, info_ptr));
 	fprintf(stderr, "Output width: %d\n", width);
 	fprintf(stderr, "Output height: %d\n", height);
-	fprintf(stderr, "Output palette (%d chars): '%s'\n", ascii_palette_length, ascii_palette);
+	fprintf(stderr, "Output palette (%d chars): '%s'\n", ctx->ascii_palette_length, ctx->ascii_palette);
 }
 
-void print_info_webp(WebPDecoderConfig* config) {
+void print_info_webp(const jp2a_context *ctx, WebPDecoderConfig* config, const int width, const int height) {
 	fprintf(stderr, "Source width: %d\n", config->input.width);
 	fprintf(stderr, "Source height: %d\n", config->input.height);
 	if ( config->input.has_alpha ) {
@@ -631,254 +810,197 @@ void print_info_webp(WebPDecoderConfig* config) {
 	}
 	fprintf(stderr, "Output width: %d\n", width);
 	fprintf(stderr, "Output height: %d\n", height);
-	fprintf(stderr, "Output palette (%d chars): '%s'\n", ascii_palette_length, ascii_palette);
+	fprintf(stderr, "Output palette (%d chars): '%s'\n", ctx->ascii_palette_length, ctx->ascii_palette);
 }
 
-void process_scanline_jpeg(const struct jpeg_decompress_struct *jpg, const JSAMPLE* scanline, Image* i) {
-	static int lasty = 0;
-	const int y = ROUND( i->resize_y * (float) (jpg->output_scanline-1) );
-
-	// include all scanlines since last call
-
-	float *pixel, *red, *green, *blue, *alpha;
-
-	pixel  = &i->pixel[lasty * i->src_width];
-	red = green = blue = NULL;
-	alpha  = &i->alpha[lasty * i->src_width];
-
-	if ( usecolors ) {
-		int offset = lasty * i->src_width;
-		red   = &i->red  [offset];
-		green = &i->green[offset];
-		blue  = &i->blue [offset];
-	}
-
-	while ( lasty <= y ) {
-
-		const int components = jpg->out_color_components;
-
-		int x;
-		for ( x=0; x < i->src_width; ++x ) {
-			const JSAMPLE *src     = &scanline[i->lookup_resx[x] * jpg->out_color_components];
-			const JSAMPLE *src_end = &scanline[i->lookup_resx[x+1] * jpg->out_color_components];
-
-			int adds = 0;
-
-			float v, r, g, b;
-			v = r = g = b = 0.0f;
-
-			while ( src <= src_end ) {
-
-				if ( components != 3 )
-					v += GRAY[src[0]];
-				else {
-					v += RED[src[0]] + GREEN[src[1]] + BLUE[src[2]];
-
-					if ( usecolors ) {
-						r += (float) src[0]/255.0f;
-						g += (float) src[1]/255.0f;
-						b += (float) src[2]/255.0f;
-					}
-				}
-
-				++adds;
-				src += components;
-			}
-
-			pixel[x] += adds>1 ? v / (float) adds : v;
-			alpha[x] = 1.0;
-
-			if ( usecolors ) {
-				red  [x] += adds>1 ? r / (float) adds : r;
-				green[x] += adds>1 ? g / (float) adds : g;
-				blue [x] += adds>1 ? b / (float) adds : b;
-			}
-		}
-
-		++i->yadds[lasty++];
-
-		pixel += i->src_width;
-		alpha += i->src_width;
-
-		if ( usecolors ) {
-			red   += i->src_width;
-			green += i->src_width;
-			blue  += i->src_width;
-		}
-	}
-
-	lasty = y;
+void process_scanline_jpeg(const jp2a_context *ctx, const struct jpeg_decompress_struct *jpg, const void* scanline, Image* i) {
+	resample_format format;
+	format.components = jpg->out_color_components;
+	format.gray = jpg->out_color_components != 3;
+	format.alpha = -1;
+	// 12-bit samples are J12SAMPLE values
+	format.wide = jpg->data_precision > 8;
+	format.big_endian = 0;
+	format.max = (1 << jpg->data_precision) - 1;
+	resample_row(ctx, i, &format, (const unsigned char*) scanline, jpg->output_scanline - 1);
 }
 
-void process_scanline_png(const png_bytep row, const int current_y, const int color_components, Image* i) {
-	static int lasty = 0;
-	const int y = ROUND( i->resize_y * (float) current_y );
-
-	// include all scanlines since last call
-
-	float *pixel, *red, *green, *blue, *alpha;
-
-	pixel  = &i->pixel[lasty * i->src_width];
-	red = green = blue = NULL;
-	alpha = &i->alpha[lasty * i->src_width];
-
-	if ( usecolors ) {
-		int offset = lasty * i->src_width;
-		red   = &i->red  [offset];
-		green = &i->green[offset];
-		blue  = &i->blue [offset];
-	}
-
-	while ( lasty <= y ) {
-
-		int x;
-		for ( x=0; x < i->src_width; ++x ) {
-
-			int adds = 0;
-
-			float v, r, g, b, a;
-			v = r = g = b = a = 0.0f;
-
-			for ( int j = i->lookup_resx[x] ; j < i->lookup_resx[x+1]; ++j ) {
-				png_byte* src_pixel = &(row[j * color_components]);
-
-				if ( color_components < 3 ) {
-					v += GRAY[src_pixel[0]];
-					if ( color_components == 2 )
-						a += ALPHA[src_pixel[1]];
-				} else {
-					v += RED[src_pixel[0]] + GREEN[src_pixel[1]] + BLUE[src_pixel[2]];
-
-					if ( usecolors ) {
-						r += (float) src_pixel[0]/255.0f;
-						g += (float) src_pixel[1]/255.0f;
-						b += (float) src_pixel[2]/255.0f;
-					}
-					if ( color_components == 4 )
-						a += ALPHA[src_pixel[3]];
-				}
-
-				++adds;
-			}
-
-			pixel[x] += adds>1 ? v / (float) adds : v;
-
-			if ( usecolors ) {
-				red  [x] += adds>1 ? r / (float) adds : r;
-				green[x] += adds>1 ? g / (float) adds : g;
-				blue [x] += adds>1 ? b / (float) adds : b;
-			}
-			if ( color_components == 1 || color_components == 3 ) {
-				alpha[x] = 1.0;
-			} else {
-				if ( a == 0.0 )
-					alpha[x] = 0.0;
-				else
-					alpha[x] = adds>1 ? a / (float) adds : a;
-			}
-		}
-
-		++i->yadds[lasty++];
-
-		pixel += i->src_width;
-		alpha += i->src_width;
-
-		if ( usecolors ) {
-			red   += i->src_width;
-			green += i->src_width;
-			blue  += i->src_width;
-		}
-	}
+void png_resample_format(const int color_components, const int bit_depth, resample_format *format) {
+	format->components = color_components;
+	format->gray = color_components < 3;
+	format->alpha = color_components == 2 ? 1 : color_components == 4 ? 3 : -1;
+	format->wide = bit_depth == 16;
+	format->big_endian = 1;
+	format->max = (1 << bit_depth) - 1;
+}
 
-	lasty = y;
+void process_scanline_png(const jp2a_context *ctx, const png_bytep row, const int current_y, const int color_components, Image* i) {
+	resample_format format;
+	png_resample_format(color_components, 8, &format);
+	resample_row(ctx, i, &format, row, current_y);
 }
 
 void free_image(Image* i) {
 	if ( i->pixel ) free(i->pixel);
-	if ( i->alpha ) free(i->alpha);
-	if ( i->red ) free(i->red);
-	if ( i->green ) free(i->green);
-	if ( i->blue ) free(i->blue);
-	if ( i->yadds ) free(i->yadds);
+	if ( i->rgba ) free(i->rgba);
 	if ( i->lookup_resx ) free(i->lookup_resx);
+	if ( i->edges ) free(i->edges);
+	resampler_free(&i->resample);
 }
 
-void malloc_image(Image* i, int switch_x_y) {
+int malloc_image(const jp2a_context *ctx, Image* i, const int width, const int height, int switch_x_y, const int alpha, FILE *err) {
 	i->orientation = HORIZONTAL;
 	i->switch_x_y = switch_x_y;
-	i->pixel = i->red = i->green = i->blue = i->alpha = NULL;
-	i->yadds = NULL;
+	i->pixel = i->rgba = NULL;
 	i->lookup_resx = NULL;
+	i->edges = NULL;
+	i->delta = NULL;
+	resampler_init(&i->resample);
 
 	i->width = width;
 	i->height = height;
 	i->src_width = switch_x_y ? height : width;
 	i->src_height = switch_x_y ? width : height;
 
-	i->yadds = (int*) malloc(i->src_height * sizeof(int));
-	i->pixel = (float*) malloc(width*height*sizeof(float));
-	i->alpha = (float*) malloc(width*height*sizeof(float));
+	// grayscale output only needs the luminosity
+	i->colors = ctx->usecolors && !ctx->convert_grayscale;
+	i->alpha = alpha;
+	i->channels = (i->colors ? 3 : 0) + (i->alpha ? 1 : 0);
 
-	if ( usecolors ) {
-		i->red   = (float*) malloc(width*height*sizeof(float));
-		i->green = (float*) malloc(width*height*sizeof(float));
-		i->blue  = (float*) malloc(width*height*sizeof(float));
-	}
+	// the pixels are indexed with int, so all channels of the image have to fit
+	if ( width > 0 && height > 0 && (int64_t) width * height * 4 <= INT_MAX ) {
+		i->pixel = (uint16_t*) malloc((size_t) width * height * sizeof(uint16_t));
+		if ( i->channels > 0 )
+			i->rgba = (uint16_t*) malloc((size_t) i->channels * width * height * sizeof(uint16_t));
 
-	// we allocate one extra pixel for resx because of the src .. src_end stuff in process_scanline_jpeg and the equivalent in for PNG
-	i->lookup_resx = (int*) malloc( (1 + i->src_width) * sizeof(int));
+		// we allocate one extra pixel for resx because resample_flush() looks up where the columns of the last pixel end
+		i->lookup_resx = (int*) malloc( (1 + (size_t) i->src_width) * sizeof(int));
+	}
 
-	if ( !(i->pixel && i->alpha && i->yadds && i->lookup_resx) ||
-	     (usecolors && !(i->red && i->green && i->blue)) )
+	if ( !(i->pixel && i->lookup_resx) || (i->channels > 0 && !i->rgba) )
 	{
-		fprintf(stderr, "Not enough memory for given output dimension\n");
+		fprintf(err, "Not enough memory for given output dimension\n");
 		free_image(i);
-		exit(1);
+		i->pixel = i->rgba = NULL;
+		i->lookup_resx = NULL;
+		return 0;
 	}
+	i->allocated_width = width;
+	i->allocated_height = height;
+	i->allocated_switch_x_y = switch_x_y;
+	return 1;
 }
 
-void init_image(Image *i, int src_width, int src_height) {
-	int dst_x;
+int save_image(const Image* i, FILE *f) {
+	const int32_t header[8] = {
+		IMAGE_FILE_VERSION, i->width, i->height, i->orientation, i->switch_x_y, i->colors, i->alpha, i->channels
+	};
+	const size_t size = (size_t) i->width * i->height;
+
+	fwrite(IMAGE_FILE_MAGIC, 1, sizeof(IMAGE_FILE_MAGIC), f);
+	fwrite(header, sizeof(int32_t), 8, f);
+	fwrite(i->pixel, sizeof(uint16_t), size, f);
+	if ( i->channels > 0 )
+		fwrite(i->rgba, sizeof(uint16_t), size * i->channels, f);
+	return !ferror(f);
+}
 
-	if ( src_height > 1 )
-		i->resize_y = (float) (i->src_height - 1) / (float) (src_height - 1);
-	else
-		i->resize_y = 1;
-	i->resize_x = (float) (src_width - 1) / (float) (i->src_width );
+int load_image(const jp2a_context *ctx, Image* i, FILE *f, FILE *err) {
+	char magic[sizeof(IMAGE_FILE_MAGIC)];
+	int32_t header[8];
+
+	if ( fread(magic, 1, sizeof(magic), f) != sizeof(magic) || memcmp(magic, IMAGE_FILE_MAGIC, sizeof(magic)) != 0 )
+		return 0;
+	if ( fread(header, sizeof(int32_t), 8, f) != 8 || header[0] != IMAGE_FILE_VERSION )
+		return 0;
+	if ( header[1] <= 0 || header[2] <= 0 || header[3] < HORIZONTAL || header[3] > ROTATE_90 )
+		return 0;
+	// the saved channels have to be the ones malloc_image() allocates for this context
+	if ( header[5] != (ctx->usecolors && !ctx->convert_grayscale) || header[7] != (header[5] ? 3 : 0) + (header[6] ? 1 : 0) )
+		return 0;
+
+	if ( !malloc_image(ctx, i, header[1], header[2], header[4], header[6], err) )
+		return 0;
+	i->orientation = (Orientation) header[3];
+	i->row_width = i->src_width;
+	i->row_height = i->src_height;
+	// all output rows are written, resample_finish() does nothing
+	i->lasty = i->src_height;
+
+	const size_t size = (size_t) i->width * i->height;
+	if ( fread(i->pixel, sizeof(uint16_t), size, f) != size
+			|| (i->channels > 0 && fread(i->rgba, sizeof(uint16_t), size * i->channels, f) != size * i->channels) ) {
+		free_image(i);
+		return 0;
+	}
+	return 1;
+}
+
+void empty_image(Image* i) {
+	memset(i, 0, sizeof(Image));
+}
+
+int reuse_image(const jp2a_context *ctx, Image* i, const int width, const int height, int switch_x_y, const int alpha, FILE *err) {
+	if ( !i->pixel || i->allocated_width != width || i->allocated_height != height || i->allocated_switch_x_y != switch_x_y || i->alpha != alpha ) {
+		struct delta_grid *delta = i->delta;
+		int success;
+		free_image(i);
+		success = malloc_image(ctx, i, width, height, switch_x_y, alpha, err);
+		i->delta = delta;
+		return success;
+	}
 
+	// orient_image() changes these, the buffers themselves keep their size
+	i->orientation = HORIZONTAL;
+	i->switch_x_y = switch_x_y;
+	i->src_width = switch_x_y ? height : width;
+	i->src_height = switch_x_y ? width : height;
+	return 1;
+}
+
+int init_image(Image *i, int src_width, int src_height, const int wide, FILE *err) {
+	int dst_x;
 
+	// the widest rows have 4 components
+	if ( !resampler_reset(&i->resample, (size_t) src_width * 4, wide) ) {
+		fprintf(err, "Not enough memory for the source image width\n");
+		return 0;
+	}
+	i->row_width = src_width;
+	i->row_height = src_height;
+	i->lasty = 0;
+
+	// output pixel x uses the source columns from lookup_resx[x] up to lookup_resx[x + 1]
 	for ( dst_x=0; dst_x <= i->src_width; ++dst_x ) {
-		i->lookup_resx[dst_x] = ROUND( (float) dst_x * i->resize_x );
+		i->lookup_resx[dst_x] = (int) ((int64_t) dst_x * src_width / i->src_width);
 	}
+	return 1;
 }
 
 
-Orientation get_orientation(FILE *imageFP) {
-	char orientationTag[13] = "Top-left";  // default to horizontal/normal
+Orientation get_orientation_jpeg(const struct jpeg_decompress_struct *jpg) {
+	jpeg_saved_marker_ptr marker;
 
-	size_t size;
-	unsigned char data[1024];
-	ExifData *edata;
-	ExifLoader *loader;
-	loader = exif_loader_new();
-	while ( 1 ) {
-		size = fread(data, 1, sizeof(data), imageFP);
-		if (size <= 0) {
-			break;
-		}
-		if (!exif_loader_write(loader, data, size)) {
-			break;
-		}
+	for ( marker = jpg->marker_list; marker != NULL; marker = marker->next ) {
+		if ( marker->marker != JPEG_APP0 + 1 || marker->data_length < 6 || memcmp(marker->data, "Exif\0\0", 6) != 0 )
+			continue;
+		ExifData *edata = exif_data_new_from_data(marker->data, marker->data_length);
+		Orientation orientation = get_orientation_exif(edata);
+		if ( edata )
+			exif_data_unref(edata);
+		return orientation;
 	}
-	rewind(imageFP);
-	edata = exif_loader_get_data(loader);
-	exif_loader_unref(loader);
+	return HORIZONTAL;
+}
+
+Orientation get_orientation_exif(ExifData *edata) {
+	char orientationTag[13] = "Top-left";  // default to horizontal/normal
+
 	if ( edata ) {
 		ExifEntry *entry = exif_content_get_entry(edata->ifd[EXIF_IFD_0], EXIF_TAG_ORIENTATION);
 		if ( entry ) {
 			exif_entry_get_value(entry, orientationTag, sizeof(orientationTag));
 		}
-		exif_data_unref(edata);
 	}
 
 	if ( strcmp(orientationTag, "Top-left" ) == 0) {
@@ -901,14 +1023,107 @@ Orientation get_orientation(FILE *imageFP) {
 	return HORIZONTAL;
 }
 
-void decompress_jpeg(FILE *fp, FILE *fout, error_collector *errors) {
-	if ( errors->jpeg_status ) {
-		print_errors(errors);
+void set_jpeg_scale(struct jpeg_decompress_struct *jpg, const int width, const int height, const int switch_x_y) {
+	const int needed_width = switch_x_y ? height : width;
+	const int needed_height = switch_x_y ? width : height;
+	int denom;
+
+	jpg->scale_num = 1;
+	jpg->scale_denom = 1;
+	if ( needed_width <= 0 || needed_height <= 0 )
+		return;
+
+	for ( denom = 8; denom > 1; denom /= 2 ) {
+		// libjpeg rounds the scaled dimensions up
+		if ( (jpg->image_width + denom - 1) / denom >= (JDIMENSION) needed_width &&
+		     (jpg->image_height + denom - 1) / denom >= (JDIMENSION) needed_height ) {
+			jpg->scale_denom = denom;
+			return;
+		}
+	}
+}
+
+int jpeg_idct_frequencies(const int scaled_size) {
+#if defined(LIBJPEG_TURBO_VERSION) || JPEG_LIB_VERSION < 70
+	// the reduced IDCTs of jidctred.c compute the 8-point IDCT at fewer points and leave out the frequencies that vanish there
+	switch ( scaled_size ) {
+	case 1: return 0x01;
+	case 2: return 0xab; // 0, 1, 3, 5, 7
+	case 4: return 0xef; // all but 4
+	default: return 0xff;
+	}
+#else
+	// libjpeg 7 and later compute a k-point IDCT from the k lowest frequencies
+	return scaled_size >= DCTSIZE ? 0xff : (1 << scaled_size) - 1;
+#endif
+}
+
+int jpeg_scans_complete(const struct jpeg_decompress_struct *jpg) {
+	// libjpeg only tracks the coefficients of progressive images
+	if ( jpg->coef_bits == NULL )
+		return 0;
+	for ( int c = 0; c < jpg->num_components; ++c ) {
+		const jpeg_component_info *component = &jpg->comp_info[c];
+#if JPEG_LIB_VERSION >= 70
+		const int horizontal = jpeg_idct_frequencies(component->DCT_h_scaled_size);
+		const int vertical = jpeg_idct_frequencies(component->DCT_v_scaled_size);
+#else
+		const int horizontal = jpeg_idct_frequencies(component->DCT_scaled_size);
+		const int vertical = horizontal;
+#endif
+		// coef_bits is in natural order, row by row
+		for ( int k = 0; k < DCTSIZE2; ++k )
+			if ( (vertical >> (k / DCTSIZE) & 1) && (horizontal >> (k % DCTSIZE) & 1) && jpg->coef_bits[c][k] != 0 )
+				return 0;
+	}
+	return 1;
+}
+
+int consume_jpeg_scans(struct jpeg_decompress_struct *jpg) {
+	int status;
+
+	do {
+		status = jpeg_consume_input(jpg);
+	} while ( status != JPEG_REACHED_EOI && status != JPEG_SUSPENDED && !(status == JPEG_SCAN_COMPLETED && jpeg_scans_complete(jpg)) );
+
+	return jpg->input_scan_number;
+}
+
+void read_jpeg_scanline(struct jpeg_decompress_struct *jpg, JSAMPARRAY buffer) {
+#ifdef HAVE_JPEG12_READ_SCANLINES
+	if ( jpg->data_precision == 12 ) {
+		jpeg12_read_scanlines(jpg, (J12SAMPARRAY) buffer, 1);
+		return;
+	}
+#endif
+	jpeg_read_scanlines(jpg, buffer, 1);
+}
+
+#ifdef HAVE_JPEG_SKIP_SCANLINES
+void skip_jpeg_scanlines(struct jpeg_decompress_struct *jpg, const int lines) {
+#ifdef HAVE_JPEG12_READ_SCANLINES
+	if ( jpg->data_precision == 12 ) {
+		jpeg12_skip_scanlines(jpg, lines);
 		return;
 	}
+#endif
+	jpeg_skip_scanlines(jpg, lines);
+}
+#endif
 
-	Orientation orientation = get_orientation(fp);
+int decompress_jpeg_frame(const jp2a_context *ctx, struct jpeg_decompress_struct *jpg, Image *image, FILE *fout, FILE *image_out, FILE *err) {
+	Orientation orientation;
 	int switch_x_y = 0;
+	int scan = 0;
+	int next = 0;
+
+	int row_stride;
+	JSAMPARRAY buffer;
+	int width, height;
+
+	jpeg_read_header(jpg, TRUE);
+
+	orientation = get_orientation_jpeg(jpg);
 	if (
 			orientation == MIRROR_HORIZONTAL_ROTATE_90 ||
 			orientation == ROTATE_270 ||
@@ -918,62 +1133,144 @@ void decompress_jpeg(FILE *fp, FILE *fout, error_collector *errors) {
 		switch_x_y = 1;
 	}
 
-	int row_stride;
+	// the output dimensions are calculated from the full size, so downscaling does not change them
+	aspect_ratio(ctx, jpg->image_width, jpg->image_height, switch_x_y, &width, &height);
+	set_jpeg_scale(jpg, width, height, switch_x_y);
+	// a downscaled progressive image does not need the highest frequencies, the scans that refine only them might not have to be read
+	jpg->buffered_image = jpg->progressive_mode && jpeg_has_multiple_scans(jpg) && jpg->scale_denom > 1;
+
+	jpeg_start_decompress(jpg);
+
+#ifdef HAVE_JPEG12_READ_SCANLINES
+	if ( jpg->data_precision != 8 && jpg->data_precision != 12 ) {
+		fprintf(err,
+			"Image has %d bits color channels, we only support 8-bit and 12-bit.\n",
+			jpg->data_precision);
+		return 0;
+	}
+#else
+	if ( jpg->data_precision != 8 ) {
+		fprintf(err,
+			"Image has %d bits color channels, we only support 8-bit.\n",
+			jpg->data_precision);
+		return 0;
+	}
+#endif
+
+	row_stride = jpg->output_width * jpg->output_components;
+
+	// with libjpeg-turbo 3 the rows of 12-bit images are allocated with J12SAMPLE values
+	buffer = (*jpg->mem->alloc_sarray)((j_common_ptr) jpg, JPOOL_IMAGE, row_stride, 1);
+
+	if ( ctx->verbose ) print_info_jpeg(ctx, jpg, orientation, width, height);
+
+	if ( height != 0 && width != 0 ) {
+		if ( !reuse_image(ctx, image, width, height, switch_x_y, 0, err) )
+			return 0;
+		clear(ctx, image);
+
+		if ( !init_image(image, jpg->output_width, jpg->output_height, jpg->data_precision > 8, err) ) {
+			jpeg_abort_decompress(jpg);
+			return 0;
+		}
+		image->orientation = orientation;
+
+		if ( jpg->buffered_image ) {
+			scan = consume_jpeg_scans(jpg);
+			jpeg_start_output(jpg, scan);
+		}
+
+		while ( jpg->output_scanline < jpg->output_height ) {
+			if ( (int) jpg->output_scanline < next ) {
+				// with --row-step the scanlines up to next are not used
+#ifdef HAVE_JPEG_SKIP_SCANLINES
+				// libjpeg-turbo can skip them without color conversion and upsampling, but not in buffered image mode
+				if ( !jpg->buffered_image ) {
+					skip_jpeg_scanlines(jpg, next - jpg->output_scanline);
+					continue;
+				}
+#endif
+				read_jpeg_scanline(jpg, buffer);
+				continue;
+			}
+			read_jpeg_scanline(jpg, buffer);
+			process_scanline_jpeg(ctx, jpg, buffer[0], image);
+			next = resample_next_row(ctx, image, jpg->output_scanline - 1);
+			if ( ctx->verbose ) print_progress((float) (jpg->output_scanline + 1.0f) / (float) jpg->output_height);
+		}
+
+		if ( !print_image(ctx, image, fout, image_out, err) ) {
+			jpeg_abort_decompress(jpg);
+			return 0;
+		}
+	} else {
+		// nothing to print, the rest of the image is not read
+		jpeg_abort_decompress(jpg);
+		return 0;
+	}
+
+	if ( jpg->buffered_image ) {
+		jpeg_finish_output(jpg);
+		if ( !jpeg_input_complete(jpg) ) {
+			if ( ctx->verbose ) fprintf(stderr, "\nSkipped the scans after scan %d, they do not change the output\n", scan);
+			// the remaining scans are not read, a Motion JPEG stream continues at the next start of image marker
+			jpeg_abort_decompress(jpg);
+			return 1;
+		}
+	}
+
+	jpeg_finish_decompress(jpg);
+	return 1;
+}
+
+void decompress_jpeg(const jp2a_context *ctx, input_stream *in, FILE *fout, FILE *image_out, error_collector *errors) {
 	my_jpeg_error_mgr jerr;
 	struct jpeg_decompress_struct jpg;
-	JSAMPARRAY buffer;
 	Image image;
 
+	empty_image(&image);
 	jpg.err = jpeg_std_error(&jerr.pub);
 	jerr.pub.error_exit = jpeg_error_exit;
+	jerr.pub.output_message = jpeg_output_message;
+	jerr.err = errors->err;
 	if ( setjmp(jerr.setjmp_buffer) ) {
 		errors->jpeg_error = &jerr;
 		errors->jpeg_status = 1;
 		jpeg_destroy_decompress(&jpg);
-		rewind(fp);
-		decompress_webp(fp, fout, errors);
+		free_image(&image);
+		print_errors(errors);
 		return;
 	}
 	jpeg_create_decompress(&jpg);
-	jpeg_stdio_src(&jpg, fp);
-	jpeg_read_header(&jpg, TRUE);
-	jpeg_start_decompress(&jpg);
-
-	if ( jpg.data_precision != 8 ) {
-		fprintf(stderr,
-			"Image has %d bits color channels, we only support 8-bit.\n",
-			jpg.data_precision);
-		exit(1);
-	}
-
-	row_stride = jpg.output_width * jpg.output_components;
-
-	buffer = (*jpg.mem->alloc_sarray)((j_common_ptr) &jpg, JPOOL_IMAGE, row_stride, 1);
-
-	aspect_ratio(jpg.output_width, jpg.output_height, switch_x_y);
+	jpeg_input_stream_src(&jpg, in);
+	// libjpeg reads the Exif marker anyway, keep it so the file does not have to be read twice
+	jpeg_save_markers(&jpg, JPEG_APP0 + 1, 0xffff);
 
-	if ( verbose ) print_info_jpeg(&jpg, orientation);
-
-	if ( height != 0 && width != 0 ) {
-		malloc_image(&image, switch_x_y);
-		clear(&image);
+	// the messages of these errors were printed already
+	if ( !decompress_jpeg_frame(ctx, &jpg, &image, fout, image_out, errors->err) )
+		errors->jpeg_status = 1;
 
-		init_image(&image, jpg.output_width, jpg.output_height);
-		image.orientation = orientation;
+	free_image(&image);
+	jpeg_destroy_decompress(&jpg);
+}
 
-		while ( jpg.output_scanline < jpg.output_height ) {
-			jpeg_read_scanlines(&jpg, buffer, 1);
-			process_scanline_jpeg(&jpg, buffer[0], &image);
-			if ( verbose ) print_progress((float) (jpg.output_scanline + 1.0f) / (float) jpg.output_height);
-		}
+void jpeg_output_message(j_common_ptr jerr) {
+	my_jpeg_error_ptr myerr = (my_jpeg_error_ptr)jerr->err;
+	char message[JMSG_LENGTH_MAX];
 
-		print_image(&image, fout);
+	(*jerr->err->format_message)(jerr, message);
+	fprintf(myerr->err, "%s\n", message);
+}
 
-		free_image(&image);
-		jpeg_finish_decompress(&jpg);
-	}
+void png_error_handler(png_structp png_ptr, png_const_charp message) {
+	error_collector *errors = (error_collector*) png_get_error_ptr(png_ptr);
+	fprintf(errors->err, "libpng error: %s\n", message);
+	png_longjmp(png_ptr, 1);
+}
 
-	jpeg_destroy_decompress(&jpg);
+void png_warning_handler(png_structp png_ptr, png_const_charp message) {
+	error_collector *errors = (error_collector*) png_get_error_ptr(png_ptr);
+	fprintf(errors->err, "libpng warning: %s\n", message);
 }
 
 void jpeg_error_exit(j_common_ptr jerr) {
@@ -981,56 +1278,54 @@ void jpeg_error_exit(j_common_ptr jerr) {
 	longjmp(myerr->setjmp_buffer, 1);
 }
 
-void decompress_png(FILE *fp, FILE *fout, error_collector *errors) {
-	if ( errors->png_status ) {
-		print_errors(errors);
-		return;
-	}
+void decompress_png(const jp2a_context *ctx, input_stream *in, FILE *fout, FILE *image_out, error_collector *errors) {
 	Image image;
+	int width, height;
 	int number_bytes_to_check = 8;
-	char header[number_bytes_to_check];
-	if ( fread(&header, 1, number_bytes_to_check, fp) != number_bytes_to_check || png_sig_cmp(header, 0, number_bytes_to_check) ) {
+	unsigned char header[number_bytes_to_check];
+	if ( input_stream_read(in, header, number_bytes_to_check) != (size_t) number_bytes_to_check || png_sig_cmp(header, 0, number_bytes_to_check) ) {
 		errors->png_error_msg = "Not a PNG file: Wrong signature";
 		errors->png_status = 1;
-		rewind(fp);
-		decompress_jpeg(fp, fout, errors);
+		print_errors(errors);
 		return;
 	}
-	png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, errors, png_error_handler, png_warning_handler);
 	if ( !png_ptr ) {
-		fprintf(stderr, "Unable to setup PNG reading, skipping file.\n");
+		fprintf(errors->err, "Unable to setup PNG reading, skipping file.\n");
 		return;
 	}
 	png_infop info_ptr = png_create_info_struct(png_ptr);
 	if ( !info_ptr ) {
-		fprintf(stderr, "Unable to setup PNG reading, skipping file.\n");
+		fprintf(errors->err, "Unable to setup PNG reading, skipping file.\n");
 		png_destroy_read_struct(&png_ptr, NULL, NULL);
 		return;
 	}
+	// libpng jumps back here from any of its calls below, these have to be volatile to keep their values
+	volatile int image_allocated = 0;
+	png_bytep volatile row_pointer = NULL;
 	if ( setjmp(png_jmpbuf(png_ptr)) ) {
 		errors->png_error_msg = "Not a valid PNG file.";
 		errors->png_status = 1;
+		if ( row_pointer )
+			png_free(png_ptr, row_pointer);
+		if ( image_allocated )
+			free_image(&image);
 		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-		rewind(fp);
-		decompress_webp(fp, fout, errors);
+		print_errors(errors);
 		return;
 	}
-	png_init_io(png_ptr, fp);
+	png_set_read_fn(png_ptr, in, png_input_stream_read);
 	png_set_sig_bytes(png_ptr, number_bytes_to_check);
 	png_read_info(png_ptr, info_ptr);
 
 	int png_width = png_get_image_width(png_ptr, info_ptr);
 	int png_height = png_get_image_height(png_ptr, info_ptr);
 
-	aspect_ratio(png_width, png_height, 0);
+	aspect_ratio(ctx, png_width, png_height, 0, &width, &height);
 
-	if ( verbose ) print_info_png(png_ptr, info_ptr);
+	if ( ctx->verbose ) print_info_png(ctx, png_ptr, info_ptr, width, height);
 
 	if ( height != 0 && width != 0 ) {
-		malloc_image(&image, 0);
-		clear(&image);
-
-
 		// peform transformations (after printing the info):
 		if ( png_get_color_type(png_ptr, info_ptr) == PNG_COLOR_TYPE_PALETTE )
 			png_set_palette_to_rgb(png_ptr);
@@ -1043,48 +1338,80 @@ void decompress_png(FILE *fp, FILE *fout, error_collector *errors) {
 		}
 		if ( png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS) )
 			png_set_tRNS_to_alpha(png_ptr);
-		if ( png_get_bit_depth(png_ptr, info_ptr) == 16 )
-			png_set_strip_16(png_ptr);
-		int number_of_passes = png_set_interlace_handling(png_ptr);
+		// 16-bit samples are downscaled as they are, without stripping them to 8 bits first
+		// interlaced images are read pass by pass, libpng does not have to combine the passes
 		png_read_update_info(png_ptr, info_ptr);
 
-		init_image(&image, png_width, png_height);
+		// gray and RGB images without tRNS chunk are opaque
+		const int png_channels = png_get_channels(png_ptr, info_ptr);
+		if ( !malloc_image(ctx, &image, width, height, 0, png_channels == 2 || png_channels == 4, errors->err) ) {
+			errors->png_status = 1;
+			png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+			return;
+		}
+		image_allocated = 1;
+		clear(ctx, &image);
+
+		const int bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+		resample_format format;
+		png_resample_format(png_channels, bit_depth, &format);
+		if ( !init_image(&image, png_width, png_height, format.wide, errors->err) ) {
+			errors->png_status = 1;
+			free_image(&image);
+			png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+			return;
+		}
 
-		if ( verbose )
+		if ( ctx->verbose )
 			print_progress(0.0);
 		if ( png_get_interlace_type(png_ptr, info_ptr) == PNG_INTERLACE_NONE ) {
-			png_bytep row_pointer = png_malloc(png_ptr, png_width * png_get_channels(png_ptr, info_ptr) * 1);
+			row_pointer = png_malloc(png_ptr, png_get_rowbytes(png_ptr, info_ptr));
+			int next = 0;
 			for ( int y = 0; y < png_height; y++ ) {
+				// every row has to be decompressed, but with --row-step not every row is used
 				png_read_row(png_ptr, row_pointer, NULL);
-				process_scanline_png(row_pointer, y, png_get_channels(png_ptr, info_ptr), &image);
-				if ( verbose )
+				if ( y == next ) {
+					resample_row(ctx, &image, &format, row_pointer, y);
+					next = resample_next_row(ctx, &image, y);
+				}
+				if ( ctx->verbose )
 					print_progress((float) y/png_height);
 			}
 			png_free(png_ptr, row_pointer);
+			row_pointer = NULL;
 		} else {
-			png_bytepp row_pointers = png_malloc(png_ptr, png_height * sizeof(png_bytep));
-			for ( int i = 0; i < png_height; ++i )
-				row_pointers[i] = NULL;
-			for ( int i = 0; i < png_height; ++i )
-				row_pointers[i] = png_malloc(png_ptr, png_width * png_get_channels(png_ptr, info_ptr) * 1);
-			// png_read_image would do the same thing, but progress could not be displayed
-			for ( int passes = 0; passes < number_of_passes; ++passes ) {
-				png_read_rows(png_ptr, row_pointers, NULL, png_height);
-				if ( verbose )
-					print_progress((float) (passes + 1)/number_of_passes);
+			// the pixels of each Adam7 pass are added to the output pixels right away
+			if ( !resample_grid_init(ctx, &image, errors->err) ) {
+				errors->png_status = 1;
+				free_image(&image);
+				png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+				return;
 			}
-			for ( int y = 0; y < png_height; y++ ) {
-				process_scanline_png(row_pointers[y], y, png_get_channels(png_ptr, info_ptr), &image);
+			row_pointer = png_malloc(png_ptr, png_get_rowbytes(png_ptr, info_ptr));
+			for ( int pass = 0; pass < PNG_INTERLACE_ADAM7_PASSES; ++pass ) {
+				const int columns = PNG_PASS_COLS(png_width, pass);
+				const int rows = PNG_PASS_ROWS(png_height, pass);
+				// libpng skips empty passes
+				if ( columns == 0 || rows == 0 )
+					continue;
+				for ( int y = 0; y < rows; ++y ) {
+					png_read_row(png_ptr, row_pointer, NULL);
+					resample_grid_add(&image, &format, row_pointer, PNG_PASS_START_COL(pass), PNG_PASS_COL_OFFSET(pass),
+						columns, PNG_PASS_START_ROW(pass) + y * PNG_PASS_ROW_OFFSET(pass));
+				}
+				if ( ctx->verbose )
+					print_progress((float) (pass + 1)/PNG_INTERLACE_ADAM7_PASSES);
 			}
-			for ( int i = 0; i < png_height; ++i )
-				png_free(png_ptr, row_pointers[i]);
-			png_free(png_ptr, row_pointers);
+			png_free(png_ptr, row_pointer);
+			row_pointer = NULL;
+			resample_grid_finish(ctx, &image, &format);
 		}
-		if ( verbose )
+		if ( ctx->verbose )
 			print_progress(1.0);
 		png_read_end(png_ptr, NULL);
 
-		print_image(&image, fout);
+		if ( !print_image(ctx, &image, fout, image_out, errors->err) )
+			errors->png_status = 1;
 
 		free_image(&image);
 	}
@@ -1092,131 +1419,177 @@ void decompress_png(FILE *fp, FILE *fout, error_collector *errors) {
 	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 }
 
-webp_data* get_webp_data(FILE *fp) {
-	webp_data* data_struct = malloc(sizeof(webp_data));
-	uint8_t buffer[1024];
-	size_t bytes_read;
-	size_t data_size = 0;
-	size_t data_allocated_size = 16384;
-	uint8_t* data = malloc(data_allocated_size);
-	
-	while ( 1 ) {
-		bytes_read = fread(buffer, 1, sizeof(buffer), fp);
-		if ( bytes_read <= 0 ) {
-			break;
-		}
-		size_t new_data_size = data_size + bytes_read;
-		if ( new_data_size > data_allocated_size ) {
-			data_allocated_size *= 2;
-			data = realloc(data, data_allocated_size);
-		}
-		uint8_t* dest = data + data_size;
-		memcpy(dest, buffer, bytes_read);
-		data_size = new_data_size;
-	}
-
-	data_struct->data = data;
-	data_struct->size = data_size;
-
-	return data_struct;
-}
-
-void free_webp_data(webp_data* data) {
-	free(data->data);
-	free(data);
-}
-
-void decompress_webp(FILE *fp, FILE *fout, error_collector *errors) {
-	if ( errors->webp_status ) {
-		print_errors(errors);
-		return;
-	}
-
-	Orientation orientation = get_orientation(fp);
+void decompress_webp(const jp2a_context *ctx, input_stream *in, FILE *fout, FILE *image_out, error_collector *errors) {
+	// libexif's loader only understands JPEG markers and never found Exif data in WebP files
+	Orientation orientation = HORIZONTAL;
 	int switch_x_y = 0;
-	if (
-			orientation == MIRROR_HORIZONTAL_ROTATE_90 ||
-			orientation == ROTATE_270 ||
-			orientation == MIRROR_HORIZONTAL_ROTATE_270 ||
-			orientation == ROTATE_90
-	) {
-		switch_x_y = 1;
-	}
 
 	Image image;
+	int width, height;
 
 	WebPDecoderConfig config;
 	WebPInitDecoderConfig(&config);
 
-	webp_data* img_data = get_webp_data(fp);
+	// read until the features can be determined, the buffer is reused for the rest of the image
+	size_t buffer_size = INPUT_STREAM_CHUNK_SIZE;
+	size_t data_size = 0;
+	size_t bytes_read;
+	VP8StatusCode status;
+	uint8_t *buffer = malloc(buffer_size);
+	if ( buffer == NULL ) {
+		fprintf(errors->err, "Not enough memory. Skipping an image.\n");
+		errors->webp_status = 1;
+		return;
+	}
+	while ( 1 ) {
+		bytes_read = input_stream_read(in, buffer + data_size, buffer_size - data_size);
+		data_size += bytes_read;
+		status = WebPGetFeatures(buffer, data_size, &config.input);
+		if ( status != VP8_STATUS_NOT_ENOUGH_DATA || bytes_read == 0 )
+			break;
+		if ( data_size == buffer_size ) {
+			uint8_t *larger = realloc(buffer, buffer_size * 2);
+			if ( larger == NULL )
+				break;
+			buffer = larger;
+			buffer_size *= 2;
+		}
+	}
 
-	if ( WebPGetFeatures(img_data->data, img_data->size, &config.input) != VP8_STATUS_OK ) {
+	if ( status != VP8_STATUS_OK ) {
 		errors->webp_error_msg = "Unable to determine WebP features, possibly not a WebP";
 		errors->webp_status = 1;
-		free_webp_data(img_data);
-		rewind(fp);
-		decompress_png(fp, fout, errors);
+		free(buffer);
+		print_errors(errors);
 		return;
 	}
 
-	aspect_ratio(config.input.width, config.input.height, switch_x_y);
+	aspect_ratio(ctx, config.input.width, config.input.height, switch_x_y, &width, &height);
 	
-	if ( verbose ) print_info_webp(&config);
+	if ( ctx->verbose ) print_info_webp(ctx, &config, width, height);
+
+	if ( config.input.has_animation ) {
+		// the animation decoder needs the whole file in memory
+		while ( (bytes_read = input_stream_read(in, buffer + data_size, buffer_size - data_size)) > 0 ) {
+			data_size += bytes_read;
+			if ( data_size == buffer_size ) {
+				uint8_t *larger = realloc(buffer, buffer_size * 2);
+				if ( larger == NULL ) {
+					fprintf(errors->err, "Not enough memory. Skipping an image.\n");
+					errors->webp_status = 1;
+					free(buffer);
+					return;
+				}
+				buffer = larger;
+				buffer_size *= 2;
+			}
+		}
+		play_webp(ctx, buffer, data_size, fout, image_out, errors);
+		free(buffer);
+		return;
+	}
 
 	if ( height != 0 && width != 0 ) {
-		malloc_image(&image, switch_x_y);
-		clear(&image);
-
-		init_image(&image, image.src_width, image.src_height);
-		image.orientation = orientation;
-		if ( image.src_width != config.input.width || image.src_height != config.input.height ) {
-			// scale the image using the webp library instead of by jp2a
-			// this should provide smoother and faster scaling
-			config.options.use_scaling = 1;
-			config.options.scaled_width = image.src_width;
-			config.options.scaled_height = image.src_height;
+		if ( !malloc_image(ctx, &image, width, height, switch_x_y, config.input.has_alpha, errors->err) ) {
+			errors->webp_status = 1;
+			free(buffer);
+			return;
 		}
-		config.output.colorspace = MODE_RGBA;
-		image.resize_x = 1.0f;
-		image.resize_y = 1.0f;
+		clear(ctx, &image);
 
-		if ( WebPDecode(img_data->data, img_data->size, &config) != VP8_STATUS_OK) {
-
-			errors->webp_error_msg = "Error decoding WebP image";
+		if ( !init_image(&image, config.input.width, config.input.height, 0, errors->err) ) {
 			errors->webp_status = 1;
 			free_image(&image);
-			free_webp_data(img_data);
-			rewind(fp);
-			decompress_png(fp, fout, errors);
+			free(buffer);
 			return;
 		}
+		image.orientation = orientation;
+		// decode at full size, the rows are downscaled like the rows of all other images
+		config.output.colorspace = MODE_RGBA;
 
-		WebPRGBABuffer* u = (WebPRGBABuffer*) &config.output.u;
-		uint8_t* rgba = u->rgba;
-
-		for ( size_t i = 0; i < image.width * image.height; i++ ) {
-			if ( usecolors ) {
-				image.red[i] = rgba[i * 4] / 255.0f;
-				image.green[i] = rgba[i * 4 + 1] / 255.0f;
-				image.blue[i] = rgba[i * 4 + 2] / 255.0f;
+		// feed the decoder chunk by chunk so the whole file never has to be in memory
+		// and process the rows as soon as they are decoded
+		int rows_done = 0, next = 0;
+		WebPIDecoder *idec = WebPIDecode(NULL, 0, &config);
+		status = idec != NULL ? WebPIAppend(idec, buffer, data_size) : VP8_STATUS_OUT_OF_MEMORY;
+		while ( 1 ) {
+			int last_y, stride;
+			uint8_t *rgba = status == VP8_STATUS_OK || status == VP8_STATUS_SUSPENDED ?
+				WebPIDecGetRGB(idec, &last_y, NULL, NULL, &stride) : NULL;
+			if ( rgba != NULL ) {
+				for ( ; rows_done < last_y; ++rows_done ) {
+					if ( rows_done == next ) {
+						process_scanline_png(ctx, rgba + (size_t) rows_done * stride, rows_done, 4, &image);
+						next = resample_next_row(ctx, &image, rows_done);
+					}
+				}
 			}
-			image.pixel[i] = RED[rgba[i * 4]] + GREEN[rgba[i * 4 + 1]] + BLUE[rgba[i * 4 + 2]];
-			image.alpha[i] = rgba[i * 4 + 3] / 255.0f;
+			if ( status != VP8_STATUS_SUSPENDED )
+				break;
+			bytes_read = input_stream_read(in, buffer, buffer_size);
+			if ( bytes_read == 0 )
+				break;
+			status = WebPIAppend(idec, buffer, bytes_read);
 		}
-		for ( size_t i = 0; i < image.src_height; i++ ) {
-			image.yadds[i] = 1;
+		if ( idec != NULL )
+			WebPIDelete(idec);
+
+		if ( status != VP8_STATUS_OK ) {
+			errors->webp_error_msg = "Error decoding WebP image";
+			errors->webp_status = 1;
+			WebPFreeDecBuffer(&config.output);
+			free_image(&image);
+			free(buffer);
+			print_errors(errors);
+			return;
 		}
 
-		print_image(&image, fout);
+		if ( !print_image(ctx, &image, fout, image_out, errors->err) )
+			errors->webp_status = 1;
 
 		free_image(&image);
 		WebPFreeDecBuffer(&config.output);
 	}
 
-	free_webp_data(img_data);
+	free(buffer);
+}
+
+void decompress_stream(const jp2a_context *ctx, input_stream *in, FILE *fout, FILE *image_out, error_collector *errors) {
+	ImageFormat format = input_stream_format(in);
+
+	if ( ctx->verbose )
+		fprintf(stderr, "Format: %s (detected from the first %d bytes)\n", image_format_name(format), (int) in->header_size);
+
+	switch ( format ) {
+		case FORMAT_JPEG:
+			if ( ctx->video )
+				play_mjpeg(ctx, in, fout, errors);
+			else
+				decompress_jpeg(ctx, in, fout, image_out, errors);
+			break;
+		case FORMAT_PNG:
+			decompress_png(ctx, in, fout, image_out, errors);
+			break;
+		case FORMAT_WEBP:
+			decompress_webp(ctx, in, fout, image_out, errors);
+			break;
+		case FORMAT_Y4M:
+			decompress_y4m(ctx, in, fout, image_out, errors);
+			break;
+		default:
+			errors->unknown_format = 1;
+			print_errors(errors);
+	}
+}
+
+int decompress_failed(const error_collector *errors) {
+	return errors->unknown_format || errors->jpeg_status || errors->png_status || errors->webp_status || errors->y4m_status || errors->output_status;
 }
 
 void print_errors(error_collector *errors) {
+	if ( errors->unknown_format ) {
+		fprintf(errors->err, "Unknown image format, only JPEG, PNG and WebP images and Y4M videos are supported\n");
+	}
 	if ( errors->jpeg_status ) {
 		my_jpeg_error_mgr *jerr = errors->jpeg_error;
 		struct jpeg_common_struct cinfo;
@@ -1224,9 +1597,12 @@ void print_errors(error_collector *errors) {
 		(jerr->pub.output_message) ((j_common_ptr)&cinfo);
 	}
 	if ( errors->png_status ) {
-		fprintf(stderr, "%s\n", errors->png_error_msg);
+		fprintf(errors->err, "%s\n", errors->png_error_msg);
 	}
 	if ( errors->webp_status ) {
-		fprintf(stderr, "%s\n", errors->webp_error_msg);
+		fprintf(errors->err, "%s\n", errors->webp_error_msg);
+	}
+	if ( errors->y4m_status ) {
+		fprintf(errors->err, "%s\n", errors->y4m_error_msg);
 	}
 }
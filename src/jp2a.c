@@ -1,6 +1,6 @@
 /*
  * Copyright 2006-2016 Christian Stigen Larsen
- * Copyright 2020 Christoph Raitzig
+ * Copyright 2020-2026 Christoph Raitzig
  * Distributed under the GNU General Public License (GPL) v2.
  */
 
@@ -22,6 +22,10 @@
 #include "options.h"
 #include "image.h"
 #include "curl.h"
+#include "batch.h"
+#include "cache.h"
+#include "serve.h"
+#include "render.h"
 
 #ifdef WIN32
 #include <windows.h>
@@ -31,225 +35,278 @@
 #endif
 
 int main(int argc, char** argv) {
-	int store_width, store_height, store_autow, store_autoh;
+	jp2a_context ctx;
 	FILE *fout = stdout;
-	// FILEs from downloads and pipes are not seekable.
-	// Solution: Copy in a buffer and use fmemopen.
-	char *buffer = NULL;
-	size_t buffer_size = 0;
 
-	error_collector errors;
 	int retval = 0;
-#ifdef FEAT_CURL
-	FILE *fr;
-	int fd;
-#endif
-	FILE *fp;
 	int n;
 
 #if ! ASCII
 	setlocale(LC_ALL, "");
 #endif
 
-	parse_options(argc, argv);
+	jp2a_context_init(&ctx);
+	parse_options(argc, argv, &ctx);
 
-	store_width = width;
-	store_height = height;
-	store_autow = auto_width;
-	store_autoh = auto_height;
+#ifdef FEAT_SERVE
+	if ( serve_path != NULL ) {
+		retval = serve(serve_path, argc, argv, jobs);
+		jp2a_context_free(&ctx);
+		return retval;
+	}
+#endif
 
 	if ( strcmp(fileout, "-") ) {
 		if ( (fout = fopen(fileout, "wb")) == NULL ) {
 			fprintf(stderr, "Could not open '%s' for writing.\n", fileout);
-			free(html_title);
+			jp2a_context_free(&ctx);
 			return 1;
 		}
 	}
 
-	if ( html && !html_rawoutput ) print_html_document_start(html_fontsize, fout);
-	else if ( xhtml && !html_rawoutput ) print_xhtml_document_start(html_fontsize, fout);
-	free(html_title);
+#ifdef FEAT_SERVE
+	// the server prints whole HTML/XHTML documents
+	if ( connect_path != NULL ) {
+		retval = connect_convert(connect_path, argc, argv, fout);
+		if ( fout != stdout )
+			fclose(fout);
+		jp2a_context_free(&ctx);
+		return retval;
+	}
+#endif
+
+	// every image needs its own output file, especially when several are written at the same time
+	if ( output_dir != NULL && !check_output_files(&ctx, argc, argv) ) {
+		if ( fout != stdout )
+			fclose(fout);
+		jp2a_context_free(&ctx);
+		return 1;
+	}
 
-	for ( n=1; n<argc; ++n ) {
+	if ( output_dir == NULL ) {
+		if ( ctx.html && !ctx.html_rawoutput ) print_html_document_start(&ctx, ctx.html_fontsize, fout);
+		else if ( ctx.xhtml && !ctx.html_rawoutput ) print_xhtml_document_start(&ctx, ctx.html_fontsize, fout);
+	}
 
-		width = store_width;
-		height = store_height;
-		auto_width = store_autow;
-		auto_height = store_autoh;
+#ifdef FEAT_THREADS
+	if ( jobs > 1 ) {
+		retval = convert_parallel(&ctx, argc, argv, fout, jobs);
+	} else
+#endif
+	for ( n=1; n<argc; ++n ) {
 
 		// skip options
 		if ( argv[n][0]=='-' && argv[n][1] )
 			continue;
 
-		errors.jpeg_status = 0;
-		errors.png_status = 0;
-		errors.webp_status = 0;
-
-		// read from stdin
-		if ( argv[n][0]=='-' && !argv[n][1] ) {
-			#ifdef _WIN32
-			// Good news, everyone!
-			_setmode( _fileno( stdin ), _O_BINARY );
-			#endif
-
-			size_t actual_size = 0;
-			if ( read_into_buffer(stdin, &buffer, &buffer_size, &actual_size) ) {
-#ifndef _WIN32
-				FILE *buffer_f = fmemopen(buffer, actual_size, "rb");
-#else
-				HANDLE handle = fmemopen(buffer, actual_size, "rb");
-				FILE *buffer_f = NULL;
-				if ( handle != NULL )
-					buffer_f = _fdopen(_open_osfhandle(handle, _O_RDONLY), "rb");
+		int status = convert_input(&ctx, argv[n], fout);
+		if ( status < 0 ) {
+			retval = 1;
+			break;
+		}
+		if ( status > 0 )
+			retval = 1;
+	}
+
+	if ( output_dir == NULL ) {
+		if ( ctx.html && !ctx.html_rawoutput ) print_html_document_end(fout);
+		else if ( ctx.xhtml && !ctx.html_rawoutput ) print_xhtml_document_end(fout);
+	}
+
+	if ( cache_dir != NULL && ctx.verbose )
+		cache_print_stats();
+
+#ifdef FEAT_THREADS
+	render_pool_stop(&jp2a_render_pool);
 #endif
-				if ( buffer_f != NULL ) {
-					decompress_jpeg(buffer_f, fout, &errors);
-					fclose(buffer_f);
-				}
-#ifdef _WIN32
-				CloseHandle(handle);
+
+	if ( fout != stdout )
+		fclose(fout);
+	jp2a_context_free(&ctx);
+
+	return retval;
+}
+
+int convert_input(const jp2a_context *ctx, const char *name, FILE *fout) {
+	error_collector errors;
+	input_stream in;
+	FILE *fp;
+#ifdef FEAT_CURL
+	FILE *fr;
+	int fd;
 #endif
-			}
 
-			if ( errors.jpeg_status && errors.png_status && errors.webp_status )
-				retval = 1;
-			continue;
-		}
+	errors.err = stderr;
+	errors.unknown_format = 0;
+	errors.jpeg_status = 0;
+	errors.png_status = 0;
+	errors.webp_status = 0;
+	errors.y4m_status = 0;
+	errors.output_status = 0;
+
+	if ( output_dir != NULL ) {
+		FILE *fdir = open_output_file(ctx, name);
+		if ( fdir == NULL )
+			return -1;
+		if ( ctx->html && !ctx->html_rawoutput ) print_html_document_start(ctx, ctx->html_fontsize, fdir);
+		else if ( ctx->xhtml && !ctx->html_rawoutput ) print_xhtml_document_start(ctx, ctx->html_fontsize, fdir);
+		fout = fdir;
+	}
 
-		#ifdef FEAT_CURL
-		if ( is_url(argv[n]) ) {
+	// read from stdin
+	if ( name[0]=='-' && !name[1] ) {
+		#ifdef _WIN32
+		// Good news, everyone!
+		_setmode( _fileno( stdin ), _O_BINARY );
+		#endif
 
-			if ( verbose )
-				fprintf(stderr, "URL: %s\n", argv[n]);
+		input_stream_init(&in, stdin);
+		decompress_stream(ctx, &in, fout, NULL, &errors);
+	}
 
-			fd = curl_download(argv[n], debug);
+	#ifdef FEAT_CURL
+	else if ( is_url(name) ) {
 
-			if ( (fr = fdopen(fd, "rb")) == NULL ) {
-				fputs("Could not fdopen read pipe\n", stderr);
-				return 1;
-			}
+		if ( ctx->verbose )
+			fprintf(stderr, "URL: %s\n", name);
 
-			size_t actual_size = 0;
-			if ( read_into_buffer(fr, &buffer, &buffer_size, &actual_size) ) {
-#ifndef _WIN32
-				FILE *buffer_f = fmemopen(buffer, actual_size, "rb");
-#else
-				HANDLE handle = fmemopen(buffer, actual_size, "rb");
-				FILE *buffer_f = NULL;
-				if ( handle != NULL )
-					buffer_f = _fdopen(_open_osfhandle(handle, _O_RDONLY), "rb");
-#endif
-				if ( buffer_f != NULL ) {
-					int urllen = strlen(argv[n]);
-					if ( urllen > 4 && strcmp(".png", argv[n] + (urllen - 4)) == 0 )
-						decompress_png(buffer_f, fout, &errors);
-					else if ( urllen > 5 && strcmp(".webp", argv[n] + (urllen - 5)) == 0 )
-						decompress_webp(buffer_f, fout, &errors);
-					else
-						decompress_jpeg(buffer_f, fout, &errors);
-					fclose(buffer_f);
-				}
-#ifdef _WIN32
-				CloseHandle(handle);
-#endif
-			}
-			fclose(fr);
-			close(fd);
-			
-			if ( errors.jpeg_status && errors.png_status && errors.webp_status )
-				retval = 1;
-			continue;
+		fd = curl_download(name, ctx->debug);
+
+		if ( (fr = fdopen(fd, "rb")) == NULL ) {
+			fputs("Could not fdopen read pipe\n", stderr);
+			close_output_file(ctx, fout);
+			return -1;
 		}
-		#endif
 
-		// read files
-		if ( (fp = fopen(argv[n], "rb")) != NULL ) {
-			if ( verbose )
-				fprintf(stderr, "File: %s\n", argv[n]);
-
-			int namelen = strlen(argv[n]);
-			if ( namelen > 4 && strcmp(".png", argv[n] + (namelen - 4)) == 0 )
-				decompress_png(fp, fout, &errors);
-			else if ( namelen > 5 && strcmp(".webp", argv[n] + (namelen - 5)) == 0 )
-				decompress_webp(fp, fout, &errors);
-			else
-				decompress_jpeg(fp, fout, &errors);
-			fclose(fp);
-
-			if ( errors.jpeg_status && errors.png_status && errors.webp_status )
-				retval = 1;
-			continue;
+		input_stream_init(&in, fr);
+		decompress_stream(ctx, &in, fout, NULL, &errors);
+		fclose(fr);
+	}
+	#endif
 
-		} else {
-			fprintf(stderr, "Can't open %s\n", argv[n]);
-			return 1;
+	// read files
+	else if ( (fp = fopen(name, "rb")) != NULL ) {
+		if ( ctx->verbose )
+			fprintf(stderr, "File: %s\n", name);
+
+		if ( cache_dir == NULL || !convert_cached(ctx, cache_dir, fp, fout, &errors) ) {
+			input_stream_init(&in, fp);
+			decompress_stream(ctx, &in, fout, NULL, &errors);
 		}
+		fclose(fp);
+
+	} else {
+		fprintf(stderr, "Can't open %s\n", name);
+		close_output_file(ctx, fout);
+		return -1;
 	}
 
-	if ( html && !html_rawoutput ) print_html_document_end(fout);
-	else if ( xhtml && !html_rawoutput ) print_xhtml_document_end(fout);
+	close_output_file(ctx, fout);
+	return decompress_failed(&errors);
+}
 
-	if ( buffer_size != 0 ) {
-		free(buffer);
+char *output_file_path(const jp2a_context *ctx, const char *name) {
+	const char *base = name;
+	const char *s;
+	const char *ext = ".txt";
+	size_t baselen;
+
+	if ( name[0]=='-' && !name[1] )
+		base = "stdin";
+	for ( s = name; *s; ++s )
+		if ( (*s == '/' || *s == '\\') && s[1] )
+			base = s + 1;
+	baselen = strlen(base);
+	if ( baselen > 0 && base[baselen - 1] == '/' )
+		--baselen;
+	for ( s = base + baselen - 1; s > base; --s ) {
+		if ( *s == '.' ) {
+			baselen = s - base;
+			break;
+		}
+	}
+	if ( baselen == 0 ) {
+		fprintf(stderr, "Can not name the output file for '%s'.\n", name);
+		return NULL;
 	}
-	if ( fout != stdout )
-		fclose(fout);
 
-	return retval;
+	if ( ctx->html || ctx->xhtml )
+		ext = ".html";
+
+	char *path = malloc(strlen(output_dir) + 1 + baselen + strlen(ext) + 1);
+	if ( path == NULL ) {
+		fprintf(stderr, "Not enough memory. Skipping an image.\n");
+		return NULL;
+	}
+	sprintf(path, "%s/%.*s%s", output_dir, (int) baselen, base, ext);
+	return path;
 }
 
-int read_into_buffer(FILE *fp, char **buffer, size_t *buffer_size, size_t *actual_size) {
-#define BUFFER_ALLOC_INCREMENTS 16384
-	*actual_size = 0;
-	if ( *buffer_size == 0 ) {
-		*buffer_size = BUFFER_ALLOC_INCREMENTS;
-		*buffer = malloc(*buffer_size);
-		if ( *buffer == NULL ) {
-			fprintf(stderr, "Not enough memory. Skipping an image.\n");
-			*buffer_size = 0;
-			return 0;
+int compare_output_files(const void *a, const void *b) {
+	const output_file *fa = (const output_file*) a;
+	const output_file *fb = (const output_file*) b;
+	const int c = strcmp(fa->path, fb->path);
+	// keep the order of the arguments for the error message
+	return c ? c : (fa->arg > fb->arg) - (fa->arg < fb->arg);
+}
+
+int check_output_files(const jp2a_context *ctx, int argc, char **argv) {
+	output_file *files = malloc(argc * sizeof(output_file));
+	int count = 0;
+	int status = 1;
+
+	if ( files == NULL ) {
+		fprintf(stderr, "Not enough memory.\n");
+		return 0;
+	}
+
+	for ( int n = 1; n < argc; ++n ) {
+		// skip options
+		if ( argv[n][0]=='-' && argv[n][1] )
+			continue;
+		files[count].path = output_file_path(ctx, argv[n]);
+		files[count].arg = n;
+		if ( files[count].path == NULL ) {
+			status = 0;
+			break;
 		}
+		++count;
 	}
-	char *current = *buffer;
-	while ( !feof(fp) ) {
-		*actual_size += fread(current, 1, BUFFER_ALLOC_INCREMENTS, fp);
-		if ( *actual_size == *buffer_size ) {
-			*buffer_size += BUFFER_ALLOC_INCREMENTS;
-			if ( debug )
-				fprintf(stdout, "Reallocating to: %ld\n", *buffer_size);
-			current = realloc(*buffer, *buffer_size);
-			if ( current == NULL ) {
-				fprintf(stderr, "Not enough memory. Skipping an image.\n");
-				*buffer_size -= BUFFER_ALLOC_INCREMENTS;
-				return 0;
+
+	if ( status ) {
+		qsort(files, count, sizeof(output_file), compare_output_files);
+		for ( int n = 1; n < count; ++n ) {
+			if ( !strcmp(files[n - 1].path, files[n].path) ) {
+				fprintf(stderr, "'%s' and '%s' would both be written to '%s'.\n",
+					argv[files[n - 1].arg], argv[files[n].arg], files[n].path);
+				status = 0;
+				break;
 			}
-			*buffer = current;
 		}
-		current = *buffer + *actual_size;
 	}
-	if ( debug )
-		fprintf(stderr, "Size: %ld\n", *actual_size);
-	return 1;
+
+	for ( int n = 0; n < count; ++n )
+		free(files[n].path);
+	free(files);
+	return status;
 }
 
-#ifdef _WIN32
-HANDLE fmemopen(void *buf, size_t size, const char *mode) {
-	TCHAR temp_path[1024];
-	DWORD temp_path_len = GetTempPathA(1024, temp_path);
-	if ( temp_path_len == 0 || temp_path_len > 1024 )
-		return NULL;
-	TCHAR temp_file_name[MAX_PATH];
-	UINT unique = GetTempFileNameA(temp_path, "jp2a", 0, temp_file_name);
-	if ( unique == 0 )
-		return NULL;
-	HANDLE outputf = CreateFileA(temp_file_name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-	DWORD bytes_written = 0;
-	BOOL written = WriteFile(outputf, buf, size, &bytes_written, NULL);
-	if ( written == FALSE )
-		return NULL;
-	DWORD retval = SetFilePointer(outputf, 0, NULL, FILE_BEGIN);
-	if ( retval == INVALID_SET_FILE_POINTER )
+FILE *open_output_file(const jp2a_context *ctx, const char *name) {
+	char *path = output_file_path(ctx, name);
+	if ( path == NULL )
 		return NULL;
-	return outputf;
+
+	FILE *f = fopen(path, "wb");
+	if ( f == NULL )
+		fprintf(stderr, "Could not open '%s' for writing.\n", path);
+	free(path);
+	return f;
+}
+
+void close_output_file(const jp2a_context *ctx, FILE *f) {
+	if ( output_dir == NULL )
+		return;
+	if ( ctx->html && !ctx->html_rawoutput ) print_html_document_end(f);
+	else if ( ctx->xhtml && !ctx->html_rawoutput ) print_xhtml_document_end(f);
+	fclose(f);
 }
-#endif
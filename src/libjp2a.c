@@ -0,0 +1,98 @@
+/*
+ * Copyright 2006-2016 Christian Stigen Larsen
+ * Copyright 2020-2026 Christoph Raitzig
+ * Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#include "libjp2a.h"
+#include "image.h"
+#include "html.h"
+#include "stream.h"
+
+void jp2a_context_init(jp2a_context *ctx) {
+	memset(ctx, 0, sizeof(jp2a_context));
+
+	ctx->auto_height = 1;
+#ifdef FEAT_TERMLIB
+	ctx->width = 0;
+	ctx->termfit = TERM_FIT_AUTO;
+#else
+	ctx->width = 78;
+#endif
+	ctx->invert = 1;
+	ctx->html_fontsize = 8;
+	ctx->html_bold = 1;
+	ctx->html_title_raw = HTML_DEFAULT_TITLE;
+	ctx->edge_threshold = EDGE_THRESHOLD_DEFAULT;
+	ctx->redraw_threshold = REDRAW_THRESHOLD_DEFAULT;
+	ctx->row_step = 1;
+	ctx->threads = 1;
+
+	strcpy(ctx->ascii_palette, ASCII_PALETTE_DEFAULT);
+	ctx->ascii_palette_length = strlen(ASCII_PALETTE_DEFAULT);
+	for ( int i = 0; i < ctx->ascii_palette_length; ++i ) {
+		ctx->ascii_palette_indizes[i] = i;
+		ctx->ascii_palette_lengths[i] = 1;
+	}
+
+	// default weights
+	ctx->redweight = 0.2989f;
+	ctx->greenweight = 0.5866f;
+	ctx->blueweight = 0.1145f;
+}
+
+void precalc_rgb(jp2a_context *ctx) {
+	const double sum = (double) ctx->redweight + ctx->greenweight + ctx->blueweight;
+	ctx->weights[0] = (uint32_t) (ctx->redweight / sum * 65536.0 + 0.5);
+	ctx->weights[1] = (uint32_t) (ctx->greenweight / sum * 65536.0 + 0.5);
+	// rounding must not make the sum larger than 1
+	if ( ctx->weights[0] + ctx->weights[1] > 65536 )
+		ctx->weights[1] = 65536 - ctx->weights[0];
+	ctx->weights[2] = 65536 - ctx->weights[0] - ctx->weights[1];
+}
+
+int jp2a_context_prepare(jp2a_context *ctx) {
+	precalc_rgb(ctx);
+
+	if ( ctx->html || ctx->xhtml ) {
+		free(ctx->html_title);
+		ctx->html_title = NULL;
+		if ( !escape_title(ctx) )
+			return 0;
+	}
+	return 1;
+}
+
+void jp2a_context_free(jp2a_context *ctx) {
+	free(ctx->html_title);
+	ctx->html_title = NULL;
+}
+
+int jp2a_render(const jp2a_context *ctx, FILE *fin, FILE *fout, FILE *err) {
+	error_collector errors;
+	input_stream in;
+	errors.err = err;
+	errors.unknown_format = 0;
+	errors.jpeg_status = 0;
+	errors.png_status = 0;
+	errors.webp_status = 0;
+	errors.y4m_status = 0;
+	errors.output_status = 0;
+
+	input_stream_init(&in, fin);
+	decompress_stream(ctx, &in, fout, NULL, &errors);
+
+	return !decompress_failed(&errors);
+}
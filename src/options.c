@@ -1,6 +1,6 @@
 /*
  * Copyright 2006-2016 Christian Stigen Larsen
- * Copyright 2020-2024 Christoph Raitzig
+ * Copyright 2020-2026 Christoph Raitzig
  * Distributed under the GNU General Public License (GPL) v2.
  */
 
@@ -33,68 +33,12 @@
 #include "terminal.h"
 #include "html.h"
 
-// Default options
-int verbose = 0;
-int auto_height = 1;
-int auto_width = 0;
-
-int width =
-#ifdef FEAT_TERMLIB
- 0;
-#else
- 78;
-#endif
-
-int height = 0;
-int use_border = 0;
-int invert = 1;
-int flipx = 0;
-int flipy = 0;
-int centerx = 0;
-int centery = 0;
-int html = 0;
-int xhtml = 0;
-int colorfill = 0;
-int convert_grayscale = 0;
-int html_fontsize = 8;
-int html_bold = 1;
-const char* html_title_raw = HTML_DEFAULT_TITLE;
-char* html_title = NULL;
-int html_rawoutput = 0;
-int debug = 0;
-int clearscr = 0;
-float edge_threshold = EDGE_THRESHOLD_DEFAULT;
-int edges_only = 0;
-int term_width = 0;
-int term_height = 0;
-int usecolors = 0;
-int colorDepth = 0;
-
-int termfit =
-#ifdef FEAT_TERMLIB
- TERM_FIT_AUTO;
-#else
- 0;
-#endif
-
-int ascii_palette_length = 23;
-#if ASCII
-char ascii_palette[ASCII_PALETTE_SIZE + 1] = ASCII_PALETTE_DEFAULT;
-#else
-char ascii_palette[ASCII_PALETTE_SIZE * MB_LEN_MAX + 1] = ASCII_PALETTE_DEFAULT;
-unsigned char ascii_palette_indizes[ASCII_PALETTE_SIZE] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22};
-char ascii_palette_lengths[ASCII_PALETTE_SIZE] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
-#endif
-
-// Default weights
-float redweight = 0.2989f;
-float greenweight = 0.5866f;
-float blueweight = 0.1145f;
-
-// calculated in parse_options
-float RED[256], GREEN[256], BLUE[256], ALPHA[256], GRAY[256];
-
 const char *fileout = "-";
+const char *output_dir = NULL;
+const char *cache_dir = NULL;
+const char *serve_path = NULL;
+const char *connect_path = NULL;
+int jobs = 1;
 
 const char* version   = PACKAGE_STRING;
 const char* copyright = "Copyright 2006-2016 Christian Stigen Larsen\n"
@@ -124,10 +68,17 @@ void help() {
 "  -                 Read images from standard input.\n"
 "      --blue=N.N    Set RGB to grayscale conversion weight, default is 0.1145\n"
 "  -b, --border      Print a border around the output image.\n"
+"      --cache-dir=...   Save the output and the downscaled image of image\n"
+"                    files in this directory, converting the same file again\n"
+"                    does not decode it.\n"
 "      --chars=...   Select character palette used to paint the image.\n"
 "                    Leftmost character corresponds to black pixel, right-\n"
 "                    most to white.  Minimum two characters must be specified.\n"
 "      --clear       Clears screen before drawing each output image.\n"
+#ifdef FEAT_SERVE
+"      --connect=... Send the images to the server listening on this socket\n"
+"                    and print its output, see --serve.\n"
+#endif
 "      --colors      Use true colors or, if true color is not supported, ANSI\n"
 "                    in output.\n"
 "      --color-depth=N   Use a specific color-depth for terminal output. Valid\n"
@@ -157,6 +108,8 @@ void help() {
 "      --html        Produce strict XHTML 1.0 output (will produce HTML output\n"
 "                    from version 2.0.0 onward).\n"
 "      --xhtml       Produce strict XHTML 1.0 output.\n" // Obsoletely Fabulous
+"      --html-classes      Use the 256 color palette and CSS classes in the\n"
+"                          document head for colored HTML output.\n"
 "      --html-fill   Same as --fill (will be phased out).\n"
 "      --html-fontsize=N   Set fontsize to N pt, default is 4.\n"
 "      --html-no-bold      Do not use bold characters with HTML output\n"
@@ -168,10 +121,34 @@ void help() {
 "      --background=dark   These are just mnemonics whether to use --invert\n"
 "      --background=light  or not.  If your console has light characters on\n"
 "                    a dark background, use --background=dark.\n"
+#ifdef FEAT_THREADS
+"  -jN, --jobs=N     Convert N images at the same time. The output is still\n"
+"                    printed in the order of the arguments.\n"
+#endif
 "      --output=...  Write output to file.\n"
+"      --output-dir=...  Write the output for each image to its own file in\n"
+"                    this directory.\n"
 "      --red=N.N     Set RGB to grayscale conversion weight, default 0.2989f.\n"
+"      --row-step=N  Only use every Nth source row for a line of output,\n"
+"                    faster for large images. Default 1 uses all rows.\n"
+#ifdef FEAT_SERVE
+"      --serve=...   Listen on this Unix domain socket and convert the images\n"
+"                    clients send, with --jobs connections at the same time.\n"
+"                    The options given are the defaults of every request.\n"
+#endif
 "      --size=WxH    Set output width and height.\n"
+#ifdef FEAT_THREADS
+"      --threads=N   Format the characters of an image with N threads, 0 uses\n"
+"                    one thread per processor. Default is 1.\n"
+#endif
 "  -v, --verbose     Verbose output.\n"
+"      --video       Print all frames of Motion JPEG, Y4M and animated WebP.\n"
+"      --dump-frames Print all frames one after another without waiting,\n"
+"                    implies --video.\n"
+"      --fps=N.N     Print at most N.N frames per second, implies --video.\n"
+"      --redraw-threshold=N.N  With --video and --clear, print a frame as a\n"
+"                    whole if more than this fraction of its characters\n"
+"                    changed, otherwise only the changed ones. Default 0.25.\n"
 "  -V, --version     Print program version.\n"
 "      --width=N     Set output width, calculate height from ratio.\n"
 "\n"
@@ -187,205 +164,189 @@ void help() {
 	fprintf(stderr, "Report bugs to <%s>\n", PACKAGE_BUGREPORT);
 }
 
-void precalc_rgb(float red, float green, float blue) {
-	int n;
-	float sum = red + green + blue;
-	red /= sum;
-	green /= sum;
-	blue /= sum;
-	for ( n=0; n<256; ++n ) {
-		RED[n]   = ((float) n) * red / 255.0f;
-		GREEN[n] = ((float) n) * green / 255.0f;
-		BLUE[n]  = ((float) n) * blue / 255.0f;
-		ALPHA[n] = ((float) n) / 255.0f;
-		GRAY[n]  = ((float) n) / 255.0f;
-	}
-}
-
-void parse_options(int argc, char** argv) {
-	// make code more readable
-	#define IF_OPTS(sopt, lopt)     if ( !strcmp(s, sopt) || !strcmp(s, lopt) )
-	#define IF_OPT(sopt)            if ( !strcmp(s, sopt) )
-	#define IF_VARS(format, v1, v2) if ( sscanf(s, format, v1, v2) == 2 )
-	#define IF_VAR(format, v1)      if ( sscanf(s, format, v1) == 1 )
-
-	int n, files, fit_to_use;
-
-	for ( n=1, files=0; n<argc; ++n ) {
-		const char *s = argv[n];
-
-		if ( *s != '-' ) { // count files to read
-			++files; continue;
+// make code more readable
+#define IF_OPTS(sopt, lopt)     if ( !strcmp(s, sopt) || !strcmp(s, lopt) )
+#define IF_OPT(sopt)            if ( !strcmp(s, sopt) )
+#define IF_VARS(format, v1, v2) if ( sscanf(s, format, v1, v2) == 2 )
+#define IF_VAR(format, v1)      if ( sscanf(s, format, v1) == 1 )
+
+int parse_context_option(const char *s, jp2a_context *ctx, FILE *err) {
+	IF_OPTS("-v", "--verbose")               { ctx->verbose = 1; return PARSE_OK; }
+	IF_OPTS("-d", "--debug")                 { ctx->debug = 1; return PARSE_OK; }
+	IF_OPT ("--clear")                       { ctx->clearscr = 1; return PARSE_OK; }
+	IF_OPT ("--video")                       { ctx->video = 1; return PARSE_OK; }
+	IF_OPT ("--dump-frames")                 { ctx->video = ctx->dump_frames = 1; return PARSE_OK; }
+	IF_VAR ("--fps=%f", &ctx->fps)           { ctx->video = 1; return PARSE_OK; }
+	IF_VAR ("--redraw-threshold=%f",
+		&ctx->redraw_threshold)     { return PARSE_OK; }
+	IF_VAR ("--row-step=%d", &ctx->row_step) { return PARSE_OK; }
+	IF_VAR ("--threads=%d", &ctx->threads)   { return PARSE_OK; }
+	IF_OPTS("--color", "--colors")           { ctx->usecolors = 1;
+	if ( ctx->debug ) {
+		char *colorterm = getenv("COLORTERM");
+		if ( colorterm==NULL ) {
+			fprintf(stderr, "Environment variable COLORTERM not set.\n");
+		} else {
+			fprintf(stderr, "Environment variable COLORTERM: %s\n", colorterm);
 		}
-	
-		IF_OPT ("-")                             { ++files; continue; }
-		IF_OPTS("-h", "--help")                  { help(); exit(0); }
-		IF_OPTS("-v", "--verbose")               { verbose = 1; continue; }
-		IF_OPTS("-d", "--debug")                 { debug = 1; continue; }
-		IF_OPT ("--clear")                       { clearscr = 1; continue; }
-		IF_OPTS("--color", "--colors")           { usecolors = 1;
-		if ( debug ) {
-			char *colorterm = getenv("COLORTERM");
-			if ( colorterm==NULL ) {
-				fprintf(stderr, "Environment variable COLORTERM not set.\n");
-			} else {
-				fprintf(stderr, "Environment variable COLORTERM: %s\n", colorterm);
-			}
-		}
-		colorDepth = ( supports_true_color() )? 24 : 4; continue; }
-		IF_VAR ("--color-depth=%d", &colorDepth) {
-			switch(colorDepth) {
-				case 4:
-				case 8:
-				case 24:
-					usecolors = 1;
-					break;
-				default:
-					colorDepth = 0;
-					usecolors = 0;
-			}
-			continue; }
-		IF_OPT ("--fill")                        { colorfill = 1; continue; }
-		IF_OPT ("--grayscale")                   { usecolors = 1; convert_grayscale = 1; continue; }
-		IF_OPT ("--htmlls")                      { html = 1; continue; }
-		IF_OPT ("--html")                        { xhtml = 1; continue; }
-		IF_OPT ("--xhtml")                       { xhtml = 1; continue; }
-		IF_OPT ("--html-fill")                   { colorfill = 1; fputs("warning: --html-fill has changed to --fill\n", stderr); continue; } // TODO: phase out
-		IF_OPT ("--html-no-bold")                { html_bold = 0; continue; }	
-		IF_OPT ("--html-raw")                    { xhtml = 1; html_rawoutput = 1; continue; }
-		IF_OPTS("-b", "--border")                { use_border = 1; continue; }
-		IF_OPTS("-i", "--invert")                { invert = !invert; continue; }
-		IF_OPT("--background=dark")              { invert = 1; continue; }
-		IF_OPT("--background=light")             { invert = 0; continue; }
-		IF_OPTS("-x", "--flipx")                 { flipx = 1; continue; }
-		IF_OPTS("-y", "--flipy")                 { flipy = 1; continue; }
-		IF_OPTS("-V", "--version")               { print_version(); exit(0); }
-		IF_OPT("--edges-only")                   { edges_only = 1; continue; }
-		IF_VAR ("--width=%d", &width)            { auto_height += 1; continue; }
-		IF_VAR ("--height=%d", &height)          { auto_width += 1; continue; }
-		IF_VAR ("--red=%f", &redweight)          { continue; }
-		IF_VAR ("--green=%f", &greenweight)      { continue; }
-		IF_VAR ("--blue=%f", &blueweight)        { continue; }
-		IF_VAR ("--html-fontsize=%d",
-			&html_fontsize)             { continue; }
-		IF_VAR ("--edge-threshold=%f",
-			&edge_threshold)            { continue; }
-
-		IF_VARS("--size=%dx%d",&width, &height) {
-			auto_width = auto_height = 0; continue;
+	}
+	ctx->colorDepth = ( supports_true_color() )? 24 : 4; return PARSE_OK; }
+	IF_VAR ("--color-depth=%d", &ctx->colorDepth) {
+		switch(ctx->colorDepth) {
+			case 4:
+			case 8:
+			case 24:
+				ctx->usecolors = 1;
+				break;
+			default:
+				ctx->colorDepth = 0;
+				ctx->usecolors = 0;
 		}
+		return PARSE_OK; }
+	IF_OPT ("--fill")                        { ctx->colorfill = 1; return PARSE_OK; }
+	IF_OPT ("--grayscale")                   { ctx->usecolors = 1; ctx->convert_grayscale = 1; return PARSE_OK; }
+	IF_OPT ("--htmlls")                      { ctx->html = 1; return PARSE_OK; }
+	IF_OPT ("--html")                        { ctx->xhtml = 1; return PARSE_OK; }
+	IF_OPT ("--xhtml")                       { ctx->xhtml = 1; return PARSE_OK; }
+	IF_OPT ("--html-fill")                   { ctx->colorfill = 1; fputs("warning: --html-fill has changed to --fill\n", err); return PARSE_OK; } // TODO: phase out
+	IF_OPT ("--html-no-bold")                { ctx->html_bold = 0; return PARSE_OK; }	
+	IF_OPT ("--html-classes")                { ctx->html_classes = 1; return PARSE_OK; }
+	IF_OPT ("--html-raw")                    { ctx->xhtml = 1; ctx->html_rawoutput = 1; return PARSE_OK; }
+	IF_OPTS("-b", "--border")                { ctx->use_border = 1; return PARSE_OK; }
+	IF_OPTS("-i", "--invert")                { ctx->invert = !ctx->invert; return PARSE_OK; }
+	IF_OPT("--background=dark")              { ctx->invert = 1; return PARSE_OK; }
+	IF_OPT("--background=light")             { ctx->invert = 0; return PARSE_OK; }
+	IF_OPTS("-x", "--flipx")                 { ctx->flipx = 1; return PARSE_OK; }
+	IF_OPTS("-y", "--flipy")                 { ctx->flipy = 1; return PARSE_OK; }
+	IF_OPT("--edges-only")                   { ctx->edges_only = 1; return PARSE_OK; }
+	IF_VAR ("--width=%d", &ctx->width)       { ctx->auto_height += 1; return PARSE_OK; }
+	IF_VAR ("--height=%d", &ctx->height)     { ctx->auto_width += 1; return PARSE_OK; }
+	IF_VAR ("--red=%f", &ctx->redweight)     { return PARSE_OK; }
+	IF_VAR ("--green=%f", &ctx->greenweight) { return PARSE_OK; }
+	IF_VAR ("--blue=%f", &ctx->blueweight)   { return PARSE_OK; }
+	IF_VAR ("--html-fontsize=%d",
+		&ctx->html_fontsize)        { return PARSE_OK; }
+	IF_VAR ("--edge-threshold=%f",
+		&ctx->edge_threshold)       { return PARSE_OK; }
+
+	IF_VARS("--size=%dx%d",&ctx->width, &ctx->height) {
+		ctx->auto_width = ctx->auto_height = 0; return PARSE_OK;
+	}
 
 #ifdef FEAT_TERMLIB
-		IF_OPTS("-c", "--term-center")      { centerx = 1; centery = 1; continue; }
-		IF_OPTS("-z", "--term-zoom")        { termfit = TERM_FIT_ZOOM; continue; }
-		IF_OPT ("--term-height")            { termfit = TERM_FIT_HEIGHT; continue; }
-		IF_OPT ("--term-width")             { termfit = TERM_FIT_WIDTH; continue; }
-		IF_OPTS("-f", "--term-fit")         { termfit = TERM_FIT_AUTO; continue; }
+	IF_OPTS("-c", "--term-center")      { ctx->centerx = 1; ctx->centery = 1; return PARSE_OK; }
+	IF_OPTS("-z", "--term-zoom")        { ctx->termfit = TERM_FIT_ZOOM; return PARSE_OK; }
+	IF_OPT ("--term-height")            { ctx->termfit = TERM_FIT_HEIGHT; return PARSE_OK; }
+	IF_OPT ("--term-width")             { ctx->termfit = TERM_FIT_WIDTH; return PARSE_OK; }
+	IF_OPTS("-f", "--term-fit")         { ctx->termfit = TERM_FIT_AUTO; return PARSE_OK; }
 #endif
 
-		if ( !strncmp(s, "--output=", 9) ) {
-			fileout = s+9;
-			continue;
-		}
-
-		if ( !strncmp(s, "--html-title=", 13) ) {
-			html_title_raw = s + 13;
-			continue;
-		}
+	if ( !strncmp(s, "--html-title=", 13) ) {
+		ctx->html_title_raw = s + 13;
+		return PARSE_OK;
+	}
 
-		if ( !strncmp(s, "--chars=", 8) ) {
+	if ( !strncmp(s, "--chars=", 8) ) {
 
 #if ASCII
-			if ( strlen(s)-8 > ASCII_PALETTE_SIZE ) {
-				fprintf(stderr,
-					"Too many ascii characters specified (max %d)\n",
-					ASCII_PALETTE_SIZE);
-				exit(1);
-			}
+		if ( strlen(s)-8 > ASCII_PALETTE_SIZE ) {
+			fprintf(err,
+				"Too many ascii characters specified (max %d)\n",
+				ASCII_PALETTE_SIZE);
+			return PARSE_ERROR;
+		}
 #else
-			if ( strlen(s)-8 > ASCII_PALETTE_SIZE * MB_LEN_MAX ) {
-				fprintf(stderr,
-					"Too many characters specified (max %d)\n",
-					ASCII_PALETTE_SIZE);
-				exit(1);
-			}
+		if ( strlen(s)-8 > ASCII_PALETTE_SIZE * MB_LEN_MAX ) {
+			fprintf(err,
+				"Too many characters specified (max %d)\n",
+				ASCII_PALETTE_SIZE);
+			return PARSE_ERROR;
+		}
 #endif
-	
-			// don't use sscanf, we need to read spaces as well
-			strcpy(ascii_palette, s+8);
+
+		// don't use sscanf, we need to read spaces as well
+		strcpy(ctx->ascii_palette, s+8);
 #if ASCII
-			ascii_palette_length = strlen(ascii_palette);
+		ctx->ascii_palette_length = strlen(ctx->ascii_palette);
 #else
-			int i = 0;
-			int count = 0;
-			size_t curCharlen;
-			while ( ascii_palette[i] != '\0' ) {
-				ascii_palette_indizes[count] = i;
-				curCharlen = mbrlen(ascii_palette + i, MB_LEN_MAX, NULL);
-				ascii_palette_lengths[count] = curCharlen;
-				if ( curCharlen == -1 ) {
-					fprintf(stderr, "Error with custom chars: %s\n", strerror(errno));
-					exit(1);
-				} else
-				if ( curCharlen == -2 ) {
-					fprintf(stderr, "Error while parsing custom chars.");
-					exit(1);
-				}
-				i += curCharlen;
-				count++;
-			}
-			if ( count > ASCII_PALETTE_SIZE ) {
-				fprintf(stderr,
+		int i = 0;
+		int count = 0;
+		size_t curCharlen;
+		mbstate_t state;
+		memset(&state, 0, sizeof(state));
+		while ( ctx->ascii_palette[i] != '\0' ) {
+			// checked before storing the character, the palette can hold more single byte characters than the lookup tables
+			if ( count == ASCII_PALETTE_SIZE ) {
+				fprintf(err,
 					"Too many characters specified (max %d)\n",
 					ASCII_PALETTE_SIZE);
-				exit(1);
+				return PARSE_ERROR;
 			}
-			ascii_palette_length = count;
-#endif
-			continue;
+			ctx->ascii_palette_indizes[count] = i;
+			curCharlen = mbrlen(ctx->ascii_palette + i, MB_LEN_MAX, &state);
+			ctx->ascii_palette_lengths[count] = curCharlen;
+			if ( curCharlen == (size_t) -1 ) {
+				fprintf(err, "Error with custom chars: %s\n", strerror(errno));
+				return PARSE_ERROR;
+			} else
+			if ( curCharlen == (size_t) -2 ) {
+				fprintf(err, "Error while parsing custom chars.");
+				return PARSE_ERROR;
+			}
+			i += curCharlen;
+			count++;
 		}
+		ctx->ascii_palette_length = count;
+#endif
+		return PARSE_OK;
+	}
 
-		fprintf(stderr, "Unknown option %s\n\n", s);
-		help();
-		exit(1);
+	return PARSE_UNKNOWN;
+}
 
-	} // args ...
+int finish_options(jp2a_context *ctx, const int terminal, FILE *err) {
+	int fit_to_use;
 
-	if ( !files ) {
-		fputs("No files specified.\n\n", stderr);
-		help();
-		exit(1);
+	if ( !terminal ) {
+		if ( ctx->termfit || ctx->centerx || ctx->centery ) {
+			fputs("Terminal options can not be used without a terminal.\n", err);
+			return 0;
+		}
+		if ( !ctx->width && !ctx->height ) {
+			// the default of builds without terminal support
+			ctx->width = 78;
+		}
 	}
 
 #ifdef FEAT_TERMLIB
-	if ( (width || height) && termfit==TERM_FIT_AUTO ) {
+	if ( (ctx->width || ctx->height) && ctx->termfit==TERM_FIT_AUTO ) {
 		// disable default --term-fit if dimensions are given
-		termfit = 0;
+		ctx->termfit = 0;
 	}
 #endif
 
-	if ( termfit || centerx || centery ) {
-		char* err = "";
+	if ( ctx->termfit || ctx->centerx || ctx->centery ) {
+		char* error = "";
 
-		if ( get_termsize(&term_width, &term_height, &err) <= 0 ) {
-			fputs(err, stderr);
-			fputc('\n', stderr);
-			exit(1);
+		if ( get_termsize(&ctx->term_width, &ctx->term_height, &error) <= 0 ) {
+			fputs(error, err);
+			fputc('\n', err);
+			return 0;
 		}
 
 #ifdef __CYGWIN__
 	// On Cygwin, if I don't decrement term_width, then you'll get extra
 	// blank lines for some window sizes, hence we decrease by one.
-	--term_width;
+	--ctx->term_width;
 #endif
 
-		fit_to_use = termfit;
+		fit_to_use = ctx->termfit;
 
-		if ( termfit == TERM_FIT_AUTO ) {
+		if ( ctx->termfit == TERM_FIT_AUTO ) {
 			// use the smallest of terminal width or height 
 			// to guarantee that image fits in display.
 
-			if ( term_width <= term_height )
+			if ( ctx->term_width <= ctx->term_height )
 				fit_to_use = TERM_FIT_WIDTH;
 			else
 				fit_to_use = TERM_FIT_HEIGHT;
@@ -393,79 +354,209 @@ void parse_options(int argc, char** argv) {
 
 		switch ( fit_to_use ) {
 		case TERM_FIT_ZOOM:
-			auto_width = auto_height = 0;
-			width = term_width - use_border*2;
-			height = term_height - 1 - use_border*2;
+			ctx->auto_width = ctx->auto_height = 0;
+			ctx->width = ctx->term_width - ctx->use_border*2;
+			ctx->height = ctx->term_height - 1 - ctx->use_border*2;
 			break;
 
 		case TERM_FIT_WIDTH:
-			width = term_width - use_border*2;
-			height = 0;
-			auto_height += 1;
+			ctx->width = ctx->term_width - ctx->use_border*2;
+			ctx->height = 0;
+			ctx->auto_height += 1;
 			break;
 
 		case TERM_FIT_HEIGHT:
-			width = 0;
-			height = term_height - 1 - use_border*2;
-			auto_width += 1;
+			ctx->width = 0;
+			ctx->height = ctx->term_height - 1 - ctx->use_border*2;
+			ctx->auto_width += 1;
 			break;
 		}
 	}
 
 	// only --width specified, calc width
-	if ( auto_width==1 && auto_height == 1 )
-		auto_height = 0;
+	if ( ctx->auto_width==1 && ctx->auto_height == 1 )
+		ctx->auto_height = 0;
 
 	// --width and --height is the same as using --size
-	if ( auto_width==2 && auto_height==1 )
-		auto_width = auto_height = 0;
+	if ( ctx->auto_width==2 && ctx->auto_height==1 )
+		ctx->auto_width = ctx->auto_height = 0;
 
-	if ( ascii_palette_length < 2 ) {
+	if ( ctx->ascii_palette_length < 2 ) {
 		fputs("You must specify at least two characters in --chars.\n",
-			stderr);
-		exit(1);
+			err);
+		return 0;
 	}
 	
-	if ( (width < 1 && !auto_width) || (height < 1 && !auto_height) ) {
-		fputs("Invalid width or height specified\n", stderr);
-		exit(1);
+	if ( (ctx->width < 1 && !ctx->auto_width) || (ctx->height < 1 && !ctx->auto_height) ) {
+		fputs("Invalid width or height specified\n", err);
+		return 0;
 	}
 
-	if ( redweight < 0 || greenweight < 0 || blueweight < 0 ) {
-		fputs("Weights can't be negative.\n", stderr);
-		exit(1);
+	if ( ctx->redweight < 0 || ctx->greenweight < 0 || ctx->blueweight < 0 ) {
+		fputs("Weights can't be negative.\n", err);
+		return 0;
 	}
-	if ( !isfinite(redweight) || !isfinite(greenweight) || !isfinite(blueweight) ) {
+	if ( !isfinite(ctx->redweight) || !isfinite(ctx->greenweight) || !isfinite(ctx->blueweight) ) {
 		// This can happen if a number can not be represented as floating point, e.g. 3e400.
-		fputs("Did not understand a weight - possibly to large.\n", stderr);
+		fputs("Did not understand a weight - possibly to large.\n", err);
+		return 0;
+	}
+	if ( (ctx->redweight + ctx->greenweight + ctx->blueweight) == 0.0 ) {
+		fputs("At least one weight must be non-zero.\n", err);
+		return 0;
+	}
+
+	if ( ctx->fps < 0 || !isfinite(ctx->fps) ) {
+		fputs("Invalid number of frames per second specified.\n", err);
+		return 0;
+	}
+
+	if ( ctx->redraw_threshold < 0 || !isfinite(ctx->redraw_threshold) ) {
+		fputs("Invalid redraw threshold specified.\n", err);
+		return 0;
+	}
+
+	if ( ctx->row_step < 1 ) {
+		fputs("Invalid row step specified.\n", err);
+		return 0;
+	}
+
+	if ( ctx->threads < 0 ) {
+		fputs("Invalid number of threads specified.\n", err);
+		return 0;
+	}
+	if ( ctx->threads > JP2A_MAX_THREADS )
+		ctx->threads = JP2A_MAX_THREADS;
+
+	if ( ctx->html && ctx->xhtml ) {
+		fputs("Only HTML or XHTML possible, using HTML.\n", err);
+		ctx->xhtml = 0;
+	}
+
+	if ( ctx->edges_only && ctx->edge_threshold == EDGE_THRESHOLD_DEFAULT ) {
+		fputs("If you pass the --edges-only option, you must also pass the --edge-threshold= option.\n", err);
+		return 0;
+	}
+
+	if ( !jp2a_context_prepare(ctx) ) {
+		fputs("Not enough memory.\n", err);
+		return 0;
+	}
+	return 1;
+}
+
+void parse_options(int argc, char** argv, jp2a_context *ctx) {
+	int n, files;
+
+	for ( n=1, files=0; n<argc; ++n ) {
+		const char *s = argv[n];
+
+		if ( *s != '-' ) { // count files to read
+			++files; continue;
+		}
+	
+		IF_OPT ("-")                             { ++files; continue; }
+		IF_OPTS("-h", "--help")                  { help(); exit(0); }
+		IF_OPTS("-V", "--version")               { print_version(); exit(0); }
+
+#ifdef FEAT_THREADS
+		IF_VAR ("--jobs=%d", &jobs)              { continue; }
+		IF_VAR ("-j%d", &jobs)                   { continue; }
+#endif
+
+		if ( !strncmp(s, "--output=", 9) ) {
+			fileout = s+9;
+			continue;
+		}
+
+		if ( !strncmp(s, "--output-dir=", 13) ) {
+			output_dir = s+13;
+			continue;
+		}
+
+		if ( !strncmp(s, "--cache-dir=", 12) ) {
+			cache_dir = s+12;
+			continue;
+		}
+
+#ifdef FEAT_SERVE
+		if ( !strncmp(s, "--serve=", 8) ) {
+			serve_path = s+8;
+			continue;
+		}
+
+		if ( !strncmp(s, "--connect=", 10) ) {
+			connect_path = s+10;
+			continue;
+		}
+#endif
+
+		switch ( parse_context_option(s, ctx, stderr) ) {
+			case PARSE_OK:
+				continue;
+			case PARSE_ERROR:
+				exit(1);
+		}
+
+		fprintf(stderr, "Unknown option %s\n\n", s);
+		help();
+		exit(1);
+
+	} // args ...
+
+	if ( serve_path != NULL ) {
+		if ( files ) {
+			fputs("Files can not be converted with --serve.\n", stderr);
+			exit(1);
+		}
+		if ( *serve_path == 0 ) {
+			fputs("Empty socket path.\n", stderr);
+			exit(1);
+		}
+	} else if ( !files ) {
+		fputs("No files specified.\n\n", stderr);
+		help();
 		exit(1);
 	}
-	if ( (redweight + greenweight + blueweight) == 0.0 ) {
-		fputs("At least one weight must be non-zero.\n", stderr);
+
+	if ( connect_path != NULL && serve_path != NULL ) {
+		fputs("Only one of --serve and --connect possible.\n", stderr);
 		exit(1);
 	}
 
+	if ( (connect_path != NULL || serve_path != NULL) && (output_dir != NULL || cache_dir != NULL) ) {
+		fputs("--output-dir and --cache-dir can not be used with --serve or --connect.\n", stderr);
+		exit(1);
+	}
+
+	// the server checks the options of every request itself
+	if ( connect_path == NULL && serve_path == NULL && !finish_options(ctx, 1, stderr) )
+		exit(1);
+
 	if ( *fileout == 0 ) {
 		fputs("Empty output filename.\n", stderr);
 		exit(1);
 	}
 
-	if ( html && xhtml ) {
-		fputs("Only HTML or XHTML possible, using HTML.\n", stderr);
-		xhtml = 0;
+	if ( jobs < 1 ) {
+		fputs("Invalid number of jobs specified.\n", stderr);
+		exit(1);
 	}
 
-	if ( html || xhtml ) {
-		if ( !escape_title() ) {
-			fprintf(stderr, "Not enough memory.");
+	if ( output_dir != NULL ) {
+		if ( *output_dir == 0 ) {
+			fputs("Empty output directory.\n", stderr);
+			exit(1);
+		}
+		if ( strcmp(fileout, "-") ) {
+			fputs("Only one of --output and --output-dir possible.\n", stderr);
 			exit(1);
 		}
 	}
 
-	if ( edges_only && edge_threshold == EDGE_THRESHOLD_DEFAULT ) {
-		fputs("If you pass the --edges-only option, you must also pass the --edge-threshold= option.\n", stderr);
+	if ( cache_dir != NULL && *cache_dir == 0 ) {
+		fputs("Empty cache directory.\n", stderr);
 		exit(1);
 	}
 
-	precalc_rgb(redweight, greenweight, blueweight);
 }
@@ -0,0 +1,246 @@
+/*
+ * Copyright 2026 Christoph Raitzig
+ * Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef FEAT_THREADS
+#include <pthread.h>
+#endif
+
+#include "image.h"
+#include "render.h"
+
+#ifdef FEAT_THREADS
+render_pool jp2a_render_pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, 0 };
+#endif
+
+int render_threads(const jp2a_context *ctx) {
+#ifdef FEAT_THREADS
+	int threads = ctx->threads;
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+	if ( threads == 0 ) {
+		const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = processors > JP2A_MAX_THREADS ? JP2A_MAX_THREADS : (int) processors;
+	}
+#endif
+	if ( threads > 0 )
+		return threads < JP2A_MAX_THREADS ? threads : JP2A_MAX_THREADS;
+#else
+	(void) ctx;
+#endif
+	return 1;
+}
+
+void *render_band_worker(void *arg) {
+	render_band *b = (render_band*) arg;
+
+	if ( !b->print_rows ) {
+		compute_edges_rows(b->ctx, b->image, b->y_begin, b->y_end);
+		b->status = 1;
+		return NULL;
+	}
+
+	b->status = 0;
+#ifdef FEAT_THREADS
+	FILE *mem = open_memstream(&b->output, &b->output_size);
+	if ( mem == NULL )
+		return NULL;
+	const int printed = b->print_rows(b->ctx, b->image, b->chars, b->y_begin, b->y_end, mem);
+	b->status = fclose(mem) == 0 && printed;
+#endif
+	return NULL;
+}
+
+#ifdef FEAT_THREADS
+void *render_pool_worker(void *arg) {
+	render_pool *pool = (render_pool*) arg;
+
+	pthread_mutex_lock(&pool->lock);
+	for ( ;; ) {
+		render_band *b = render_pool_take(pool);
+		if ( b == NULL ) {
+			if ( pool->stopping )
+				break;
+			pthread_cond_wait(&pool->work, &pool->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&pool->lock);
+		render_band_worker(b);
+		pthread_mutex_lock(&pool->lock);
+		b->finished = 1;
+		pthread_cond_broadcast(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+int render_pool_start(render_pool *pool, int threads) {
+	if ( threads > JP2A_MAX_THREADS )
+		threads = JP2A_MAX_THREADS;
+
+	pthread_mutex_lock(&pool->lock);
+	if ( pool->threads == NULL )
+		pool->threads = (pthread_t*) malloc(JP2A_MAX_THREADS * sizeof(pthread_t));
+	if ( pool->threads == NULL )
+		fprintf(stderr, "Not enough memory for the formatting threads, formatting with one thread.\n");
+	else
+		while ( pool->thread_count < threads && pthread_create(&pool->threads[pool->thread_count], NULL, render_pool_worker, pool) == 0 )
+			++pool->thread_count;
+	threads = pool->thread_count;
+	pthread_mutex_unlock(&pool->lock);
+	return threads;
+}
+
+void render_pool_stop(render_pool *pool) {
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for ( int n = 0; n < pool->thread_count; ++n )
+		pthread_join(pool->threads[n], NULL);
+
+	free(pool->threads);
+	pool->threads = NULL;
+	pool->thread_count = 0;
+	pool->stopping = 0;
+}
+
+render_band *render_pool_take(render_pool *pool) {
+	render_band *b = pool->queue;
+	if ( b != NULL )
+		pool->queue = b->next;
+	return b;
+}
+#endif
+
+void render_bands(render_band *bands, const int count) {
+#ifdef FEAT_THREADS
+	render_pool *pool = &jp2a_render_pool;
+
+	if ( count > 1 )
+		render_pool_start(pool, count - 1);
+
+	// the bands are queued in reverse order, so each one is taken from the front of the queue in order
+	pthread_mutex_lock(&pool->lock);
+	for ( int n = count - 1; n > 0; --n ) {
+		bands[n].finished = 0;
+		bands[n].next = pool->queue;
+		pool->queue = &bands[n];
+	}
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	render_band_worker(&bands[0]);
+
+	// until the pool has finished the other bands the calling thread helps with any queued band, even of other images
+	pthread_mutex_lock(&pool->lock);
+	for ( int n = 1; n < count; ) {
+		if ( bands[n].finished ) {
+			++n;
+			continue;
+		}
+		render_band *b = render_pool_take(pool);
+		if ( b == NULL ) {
+			pthread_cond_wait(&pool->done, &pool->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&pool->lock);
+		render_band_worker(b);
+		pthread_mutex_lock(&pool->lock);
+		b->finished = 1;
+		pthread_cond_broadcast(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+#else
+	for ( int n = 0; n < count; ++n )
+		render_band_worker(&bands[n]);
+#endif
+}
+
+void render_edges(const jp2a_context *ctx, const Image *image) {
+	const int threads = render_threads(ctx);
+	if ( threads <= 1 || image->height < 2 ) {
+		compute_edges_rows(ctx, image, 0, image->height);
+		return;
+	}
+
+	// the edges are kept in memory anyway, so every thread gets one band
+	const int count = threads < image->height ? threads : image->height;
+	render_band *bands = (render_band*) malloc(count * sizeof(render_band));
+	if ( bands == NULL ) {
+		fprintf(stderr, "Not enough memory for %d threads, computing the edges with one thread.\n", count);
+		compute_edges_rows(ctx, image, 0, image->height);
+		return;
+	}
+	for ( int n = 0; n < count; ++n ) {
+		bands[n].ctx = ctx;
+		bands[n].image = image;
+		bands[n].print_rows = NULL;
+		bands[n].y_begin = (int) ((int64_t) n * image->height / count);
+		bands[n].y_end = (int) ((int64_t) (n + 1) * image->height / count);
+	}
+	render_bands(bands, count);
+	free(bands);
+}
+
+int render_rows(const jp2a_context *ctx, const Image *image, const int chars, render_rows_fn print_rows, FILE *f) {
+	int threads = render_threads(ctx);
+	if ( threads <= 1 || image->height < 2 )
+		return print_rows(ctx, image, chars, 0, image->height, f);
+	// more threads than lines would have nothing to do
+	if ( threads > image->height )
+		threads = image->height;
+
+	int band_rows = (image->height + threads - 1) / threads;
+	if ( band_rows > RENDER_BAND_ROWS )
+		band_rows = RENDER_BAND_ROWS;
+	render_band *bands = (render_band*) malloc(threads * sizeof(render_band));
+	if ( bands == NULL ) {
+		fprintf(stderr, "Not enough memory for %d threads, formatting with one thread.\n", threads);
+		return print_rows(ctx, image, chars, 0, image->height, f);
+	}
+
+	int success = 1;
+
+	for ( int y = 0; y < image->height; ) {
+		int count = 0;
+		for ( ; count < threads && y < image->height; ++count, y += band_rows ) {
+			render_band *b = &bands[count];
+			b->ctx = ctx;
+			b->image = image;
+			b->chars = chars;
+			b->print_rows = print_rows;
+			b->y_begin = y;
+			b->y_end = y + band_rows < image->height ? y + band_rows : image->height;
+			b->output = NULL;
+			b->output_size = 0;
+		}
+		render_bands(bands, count);
+
+		// the lines are written in order, bands without memory are printed here
+		for ( int n = 0; n < count; ++n ) {
+			render_band *b = &bands[n];
+			if ( b->status )
+				fwrite(b->output, 1, b->output_size, f);
+			else if ( !print_rows(ctx, image, chars, b->y_begin, b->y_end, f) )
+				success = 0;
+			free(b->output);
+		}
+	}
+	free(bands);
+	return success;
+}
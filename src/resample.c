@@ -0,0 +1,395 @@
+/*
+ * Copyright 2026 Christoph Raitzig
+ * Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef FEAT_SIMD
+#include <immintrin.h>
+#endif
+
+#include "image.h"
+#include "resample.h"
+
+void resampler_init(resampler *r) {
+	r->sums = NULL;
+	r->wide_sums = NULL;
+	r->allocated = 0;
+	r->rows = 0;
+	r->last_row = -1;
+	r->grid = NULL;
+	r->grid_cols = NULL;
+	r->grid_rows = NULL;
+	r->grid_used = NULL;
+}
+
+void resampler_free(resampler *r) {
+	free(r->sums);
+	free(r->wide_sums);
+	free(r->grid);
+	free(r->grid_cols);
+	free(r->grid_rows);
+	free(r->grid_used);
+	resampler_init(r);
+}
+
+int resampler_reset(resampler *r, const size_t row_size, const int wide) {
+	if ( row_size > r->allocated || (wide ? !r->wide_sums : !r->sums) ) {
+		resampler_free(r);
+		if ( wide )
+			r->wide_sums = (uint64_t*) malloc(row_size * sizeof(uint64_t));
+		else
+			r->sums = (uint32_t*) malloc(row_size * sizeof(uint32_t));
+		if ( !(wide ? (void*) r->wide_sums : (void*) r->sums) )
+			return 0;
+		r->allocated = row_size;
+	}
+	if ( wide )
+		memset(r->wide_sums, 0, row_size * sizeof(uint64_t));
+	else
+		memset(r->sums, 0, row_size * sizeof(uint32_t));
+	// no row was added yet, so there are no sums to clear
+	r->format.components = 0;
+	r->format.wide = wide;
+	r->rows = 0;
+	r->last_row = -1;
+	return 1;
+}
+
+void resample_accumulate_scalar(uint32_t *sums, const unsigned char *row, const size_t n) {
+	for ( size_t j = 0; j < n; ++j )
+		sums[j] += row[j];
+}
+
+#ifdef FEAT_SIMD
+void resample_accumulate_sse2(uint32_t *sums, const unsigned char *row, const size_t n) {
+	const __m128i zero = _mm_setzero_si128();
+	size_t j = 0;
+
+	// widen 16 bytes to 16 32-bit integers
+	for ( ; j + 16 <= n; j += 16 ) {
+		const __m128i bytes = _mm_loadu_si128((const __m128i*) (row + j));
+		const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+		const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+		__m128i *s = (__m128i*) (sums + j);
+		_mm_storeu_si128(s + 0, _mm_add_epi32(_mm_loadu_si128(s + 0), _mm_unpacklo_epi16(low, zero)));
+		_mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1), _mm_unpackhi_epi16(low, zero)));
+		_mm_storeu_si128(s + 2, _mm_add_epi32(_mm_loadu_si128(s + 2), _mm_unpacklo_epi16(high, zero)));
+		_mm_storeu_si128(s + 3, _mm_add_epi32(_mm_loadu_si128(s + 3), _mm_unpackhi_epi16(high, zero)));
+	}
+	resample_accumulate_scalar(sums + j, row + j, n - j);
+}
+
+__attribute__((target("avx2")))
+void resample_accumulate_avx2(uint32_t *sums, const unsigned char *row, const size_t n) {
+	size_t j = 0;
+
+	for ( ; j + 32 <= n; j += 32 ) {
+		for ( int k = 0; k < 32; k += 8 ) {
+			const __m256i widened = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (row + j + k)));
+			__m256i *s = (__m256i*) (sums + j + k);
+			_mm256_storeu_si256(s, _mm256_add_epi32(_mm256_loadu_si256(s), widened));
+		}
+	}
+	resample_accumulate_sse2(sums + j, row + j, n - j);
+}
+#endif
+
+void resample_accumulate(uint32_t *sums, const unsigned char *row, const size_t n) {
+#ifdef FEAT_SIMD
+	if ( __builtin_cpu_supports("avx2") )
+		resample_accumulate_avx2(sums, row, n);
+	else
+		resample_accumulate_sse2(sums, row, n);
+#else
+	resample_accumulate_scalar(sums, row, n);
+#endif
+}
+
+void resample_accumulate_wide_scalar(uint64_t *sums, const unsigned char *row, const size_t n, const int big_endian) {
+	if ( big_endian ) {
+		for ( size_t j = 0; j < n; ++j )
+			sums[j] += (unsigned int) row[2 * j] << 8 | row[2 * j + 1];
+	} else {
+		for ( size_t j = 0; j < n; ++j ) {
+			uint16_t sample;
+			memcpy(&sample, row + 2 * j, sizeof(sample));
+			sums[j] += sample;
+		}
+	}
+}
+
+#ifdef FEAT_SIMD
+void resample_accumulate_wide_sse2(uint64_t *sums, const unsigned char *row, const size_t n, const int big_endian) {
+	const __m128i zero = _mm_setzero_si128();
+	size_t j = 0;
+
+	// widen 8 samples to 8 64-bit integers, x86 is little endian so only PNG samples have to be swapped
+	for ( ; j + 8 <= n; j += 8 ) {
+		__m128i samples = _mm_loadu_si128((const __m128i*) (row + 2 * j));
+		if ( big_endian )
+			samples = _mm_or_si128(_mm_slli_epi16(samples, 8), _mm_srli_epi16(samples, 8));
+		const __m128i low = _mm_unpacklo_epi16(samples, zero);
+		const __m128i high = _mm_unpackhi_epi16(samples, zero);
+		__m128i *s = (__m128i*) (sums + j);
+		_mm_storeu_si128(s + 0, _mm_add_epi64(_mm_loadu_si128(s + 0), _mm_unpacklo_epi32(low, zero)));
+		_mm_storeu_si128(s + 1, _mm_add_epi64(_mm_loadu_si128(s + 1), _mm_unpackhi_epi32(low, zero)));
+		_mm_storeu_si128(s + 2, _mm_add_epi64(_mm_loadu_si128(s + 2), _mm_unpacklo_epi32(high, zero)));
+		_mm_storeu_si128(s + 3, _mm_add_epi64(_mm_loadu_si128(s + 3), _mm_unpackhi_epi32(high, zero)));
+	}
+	resample_accumulate_wide_scalar(sums + j, row + 2 * j, n - j, big_endian);
+}
+
+__attribute__((target("avx2")))
+void resample_accumulate_wide_avx2(uint64_t *sums, const unsigned char *row, const size_t n, const int big_endian) {
+	size_t j = 0;
+
+	for ( ; j + 16 <= n; j += 16 ) {
+		__m256i samples = _mm256_loadu_si256((const __m256i*) (row + 2 * j));
+		if ( big_endian )
+			samples = _mm256_or_si256(_mm256_slli_epi16(samples, 8), _mm256_srli_epi16(samples, 8));
+		const __m128i halves[2] = { _mm256_castsi256_si128(samples), _mm256_extracti128_si256(samples, 1) };
+		__m256i *s = (__m256i*) (sums + j);
+		for ( int k = 0; k < 2; ++k ) {
+			const __m256i low = _mm256_cvtepu16_epi64(halves[k]);
+			const __m256i high = _mm256_cvtepu16_epi64(_mm_srli_si128(halves[k], 8));
+			_mm256_storeu_si256(s + 2 * k, _mm256_add_epi64(_mm256_loadu_si256(s + 2 * k), low));
+			_mm256_storeu_si256(s + 2 * k + 1, _mm256_add_epi64(_mm256_loadu_si256(s + 2 * k + 1), high));
+		}
+	}
+	resample_accumulate_wide_sse2(sums + j, row + 2 * j, n - j, big_endian);
+}
+#endif
+
+void resample_accumulate_wide(uint64_t *sums, const unsigned char *row, const size_t n, const int big_endian) {
+#ifdef FEAT_SIMD
+	if ( __builtin_cpu_supports("avx2") )
+		resample_accumulate_wide_avx2(sums, row, n, big_endian);
+	else
+		resample_accumulate_wide_sse2(sums, row, n, big_endian);
+#else
+	resample_accumulate_wide_scalar(sums, row, n, big_endian);
+#endif
+}
+
+unsigned int resample_sample(const resample_format *format, const unsigned char *row, const size_t index) {
+	if ( !format->wide )
+		return row[index];
+	if ( format->big_endian )
+		return (unsigned int) row[2 * index] << 8 | row[2 * index + 1];
+	uint16_t sample;
+	memcpy(&sample, row + 2 * index, sizeof(sample));
+	return sample;
+}
+
+int resample_row_start(const Image *i, const int y) {
+	return (int) ((int64_t) y * i->row_height / i->src_height);
+}
+
+int resample_row_end(const Image *i, const int y) {
+	const int start = resample_row_start(i, y);
+	const int end = (int) ((int64_t) (y + 1) * i->row_height / i->src_height);
+	return end > start ? end : start + 1;
+}
+
+void resample_complete(const jp2a_context *ctx, Image *i, const int src_y) {
+	resampler *r = &i->resample;
+
+	while ( i->lasty < i->src_height && resample_row_end(i, i->lasty) <= src_y ) {
+		resample_flush(ctx, i, i->lasty);
+		++i->lasty;
+		// when upscaling the next output row uses the same source row
+		if ( i->lasty < i->src_height && resample_row_start(i, i->lasty) > r->last_row ) {
+			if ( r->format.wide )
+				memset(r->wide_sums, 0, (size_t) i->row_width * r->format.components * sizeof(uint64_t));
+			else
+				memset(r->sums, 0, (size_t) i->row_width * r->format.components * sizeof(uint32_t));
+			r->rows = 0;
+		}
+	}
+}
+
+void resample_row(const jp2a_context *ctx, Image *i, const resample_format *format, const unsigned char *row, const int src_y) {
+	resampler *r = &i->resample;
+
+	r->format = *format;
+	resample_complete(ctx, i, src_y);
+	if ( format->wide )
+		resample_accumulate_wide(r->wide_sums, row, (size_t) i->row_width * format->components, format->big_endian);
+	else
+		resample_accumulate(r->sums, row, (size_t) i->row_width * format->components);
+	++r->rows;
+	r->last_row = src_y;
+}
+
+int resample_next_row(const jp2a_context *ctx, const Image *i, const int src_y) {
+	if ( ctx->row_step <= 1 )
+		return src_y + 1;
+	// src_y belongs to output row lasty, the first of its rows was used
+	const int end = resample_row_end(i, i->lasty);
+	// compared with the distance to the end, so a huge --row-step does not overflow
+	return end - src_y > ctx->row_step ? src_y + ctx->row_step : end;
+}
+
+void resample_store(const jp2a_context *ctx, Image *i, const resample_format *format, const size_t index, const uint64_t sum[4], const uint64_t count) {
+	// IMAGE_ONE is 256 * 255, so for bytes these are the averages with 8 fractional bits, rounded down so that rounding them to 8 bits gives the same result as rounding the exact average
+	const uint64_t divisor = (uint64_t) format->max * count;
+
+	if ( format->gray ) {
+		i->pixel[index] = (uint16_t) (sum[0] * IMAGE_ONE / divisor);
+	} else {
+		// the weights have 16 fractional bits
+		const uint64_t weighted = sum[0] * ctx->weights[0] + sum[1] * ctx->weights[1] + sum[2] * ctx->weights[2];
+		i->pixel[index] = (uint16_t) ((weighted >> 8) * 255 / divisor);
+		if ( i->colors ) {
+			uint16_t *rgba = &i->rgba[index * i->channels];
+			rgba[0] = (uint16_t) (sum[0] * IMAGE_ONE / divisor);
+			rgba[1] = (uint16_t) (sum[1] * IMAGE_ONE / divisor);
+			rgba[2] = (uint16_t) (sum[2] * IMAGE_ONE / divisor);
+		}
+	}
+	if ( i->alpha )
+		i->rgba[index * i->channels + i->channels - 1] = format->alpha >= 0 ? (uint16_t) (sum[3] * IMAGE_ONE / divisor) : IMAGE_ONE;
+}
+
+void resample_flush(const jp2a_context *ctx, Image *i, const int y) {
+	const resampler *r = &i->resample;
+	const resample_format *format = &r->format;
+	const int c = format->components;
+	const size_t offset = (size_t) y * i->src_width;
+
+	if ( y < 0 || y >= i->src_height || r->rows == 0 )
+		return;
+
+	for ( int x = 0; x < i->src_width; ++x ) {
+		const int start = i->lookup_resx[x];
+		const int end = i->lookup_resx[x + 1] > start ? i->lookup_resx[x + 1] : start + 1;
+		uint64_t sum[4] = { 0, 0, 0, 0 };
+
+		if ( format->wide ) {
+			const uint64_t *s = &r->wide_sums[(size_t) start * c];
+			for ( int j = start; j < end; ++j, s += c ) {
+				sum[0] += s[0];
+				if ( !format->gray ) {
+					sum[1] += s[1];
+					sum[2] += s[2];
+				}
+				if ( format->alpha >= 0 && i->alpha )
+					sum[3] += s[format->alpha];
+			}
+		} else {
+			const uint32_t *s = &r->sums[(size_t) start * c];
+			for ( int j = start; j < end; ++j, s += c ) {
+				sum[0] += s[0];
+				if ( !format->gray ) {
+					sum[1] += s[1];
+					sum[2] += s[2];
+				}
+				if ( format->alpha >= 0 && i->alpha )
+					sum[3] += s[format->alpha];
+			}
+		}
+
+		resample_store(ctx, i, format, offset + x, sum, (uint64_t) (end - start) * r->rows);
+	}
+}
+
+void resample_finish(const jp2a_context *ctx, Image *i) {
+	resample_complete(ctx, i, i->row_height);
+	i->resample.rows = 0;
+}
+
+int resample_grid_init(const jp2a_context *ctx, Image *i, FILE *err) {
+	resampler *r = &i->resample;
+
+	free(r->grid);
+	free(r->grid_cols);
+	free(r->grid_rows);
+	free(r->grid_used);
+	r->grid = (uint64_t*) calloc((size_t) i->src_width * i->src_height * 4, sizeof(uint64_t));
+	r->grid_cols = (int*) malloc((size_t) i->row_width * 2 * sizeof(int));
+	r->grid_rows = (int*) malloc((size_t) i->row_height * 2 * sizeof(int));
+	r->grid_used = (int*) calloc(i->src_height, sizeof(int));
+	if ( !r->grid || !r->grid_cols || !r->grid_rows || !r->grid_used ) {
+		fprintf(err, "Not enough memory for given output dimension\n");
+		return 0;
+	}
+
+	// the boxes of the output columns and rows are ordered, so the ones a source column or row belongs to are next to each other
+	for ( int x = 0; x < i->row_width; ++x )
+		r->grid_cols[2 * x] = r->grid_cols[2 * x + 1] = 0;
+	for ( int x = 0; x < i->src_width; ++x ) {
+		const int start = i->lookup_resx[x];
+		const int end = i->lookup_resx[x + 1] > start ? i->lookup_resx[x + 1] : start + 1;
+		for ( int j = start; j < end; ++j ) {
+			if ( r->grid_cols[2 * j + 1] == 0 )
+				r->grid_cols[2 * j] = x;
+			r->grid_cols[2 * j + 1] = x + 1;
+		}
+	}
+
+	for ( int y = 0; y < i->row_height; ++y )
+		r->grid_rows[2 * y] = r->grid_rows[2 * y + 1] = 0;
+	for ( int y = 0; y < i->src_height; ++y ) {
+		const int start = resample_row_start(i, y);
+		const int end = resample_row_end(i, y);
+		// the same rows resample_next_row() would ask for
+		for ( int j = start; j < end; j = end - j > ctx->row_step ? j + ctx->row_step : end ) {
+			if ( r->grid_rows[2 * j + 1] == 0 )
+				r->grid_rows[2 * j] = y;
+			r->grid_rows[2 * j + 1] = y + 1;
+			++r->grid_used[y];
+		}
+	}
+	return 1;
+}
+
+void resample_grid_add(Image *i, const resample_format *format, const unsigned char *row, const int x, const int dx, const int n, const int src_y) {
+	const resampler *r = &i->resample;
+	const int c = format->components;
+	const int alpha = format->alpha >= 0 && i->alpha;
+
+	for ( int y = r->grid_rows[2 * src_y]; y < r->grid_rows[2 * src_y + 1]; ++y ) {
+		size_t s = 0;
+		for ( int j = 0, src_x = x; j < n; ++j, src_x += dx, s += c ) {
+			for ( int dst_x = r->grid_cols[2 * src_x]; dst_x < r->grid_cols[2 * src_x + 1]; ++dst_x ) {
+				uint64_t *sum = &r->grid[4 * ((size_t) y * i->src_width + dst_x)];
+				sum[0] += resample_sample(format, row, s);
+				if ( !format->gray ) {
+					sum[1] += resample_sample(format, row, s + 1);
+					sum[2] += resample_sample(format, row, s + 2);
+				}
+				if ( alpha )
+					sum[3] += resample_sample(format, row, s + format->alpha);
+			}
+		}
+	}
+}
+
+void resample_grid_finish(const jp2a_context *ctx, Image *i, const resample_format *format) {
+	const resampler *r = &i->resample;
+
+	for ( int y = 0; y < i->src_height; ++y ) {
+		if ( r->grid_used[y] == 0 )
+			continue;
+		for ( int x = 0; x < i->src_width; ++x ) {
+			const int start = i->lookup_resx[x];
+			const int end = i->lookup_resx[x + 1] > start ? i->lookup_resx[x + 1] : start + 1;
+			const size_t index = (size_t) y * i->src_width + x;
+			resample_store(ctx, i, format, index, &r->grid[4 * index], (uint64_t) (end - start) * r->grid_used[y]);
+		}
+	}
+	// resample_finish() has nothing left to write
+	i->lasty = i->src_height;
+}
@@ -0,0 +1,465 @@
+/*
+ * Copyright 2026 Christoph Raitzig
+ * Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#include "config.h"
+
+#ifdef FEAT_SERVE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "serve.h"
+#include "options.h"
+#include "html.h"
+#include "render.h"
+
+//! path of the socket the server listens on, removed by serve_stop()
+const char *serve_socket = NULL;
+
+int serve_read(const int fd, void *buffer, const size_t size) {
+	unsigned char *p = (unsigned char*) buffer;
+	size_t done = 0;
+
+	while ( done < size ) {
+		const ssize_t n = read(fd, p + done, size - done);
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return 0;
+		done += n;
+	}
+	return 1;
+}
+
+int serve_write(const int fd, const void *buffer, const size_t size) {
+	const unsigned char *p = (const unsigned char*) buffer;
+	size_t done = 0;
+
+	while ( done < size ) {
+		const ssize_t n = write(fd, p + done, size - done);
+		if ( n < 0 && errno == EINTR )
+			continue;
+		if ( n <= 0 )
+			return 0;
+		done += n;
+	}
+	return 1;
+}
+
+int serve_read_number(const int fd, uint32_t *value) {
+	unsigned char b[4];
+	if ( !serve_read(fd, b, 4) )
+		return 0;
+	*value = (uint32_t) b[0] << 24 | (uint32_t) b[1] << 16 | (uint32_t) b[2] << 8 | b[3];
+	return 1;
+}
+
+int serve_write_number(const int fd, const uint32_t value) {
+	const unsigned char b[4] = { value >> 24, value >> 16, value >> 8, value };
+	return serve_write(fd, b, 4);
+}
+
+int serve_read_request(const int fd, serve_request *r) {
+	uint32_t size;
+
+	r->options = NULL;
+	r->image = NULL;
+
+	if ( !serve_read_number(fd, &size) || size > SERVE_MAX_OPTIONS )
+		return 0;
+	r->options_size = size;
+	// one more zero byte, so the last option is terminated even if the client did not send its zero byte
+	r->options = calloc(size + 1, 1);
+	if ( r->options == NULL || !serve_read(fd, r->options, size) ) {
+		serve_free_request(r);
+		return 0;
+	}
+
+	if ( !serve_read_number(fd, &size) || size > SERVE_MAX_IMAGE ) {
+		serve_free_request(r);
+		return 0;
+	}
+	r->image_size = size;
+	r->image = malloc(size > 0 ? size : 1);
+	if ( r->image == NULL || !serve_read(fd, r->image, size) ) {
+		serve_free_request(r);
+		return 0;
+	}
+	return 1;
+}
+
+void serve_free_request(serve_request *r) {
+	free(r->options);
+	free(r->image);
+	r->options = NULL;
+	r->image = NULL;
+}
+
+int serve_option_allowed(const char *s) {
+	return strcmp(s, "-v") && strcmp(s, "--verbose") && strcmp(s, "-d") && strcmp(s, "--debug");
+}
+
+int serve_context(const serve_server *server, const serve_request *r, jp2a_context *ctx, FILE *err) {
+	jp2a_context_init(ctx);
+	// there is no terminal to fit the output to
+	ctx->termfit = 0;
+
+	// the command line was checked by parse_options(), other arguments are files or only concern the server
+	for ( int n = 1; n < server->argc; ++n ) {
+		if ( server->argv[n][0] == '-' && server->argv[n][1] )
+			parse_context_option(server->argv[n], ctx, err);
+	}
+
+	// a request can ask for less, but not for more than the command line
+	const int max_threads = render_threads(ctx);
+	const int width = ctx->width;
+	const int height = ctx->height;
+
+	for ( size_t pos = 0; pos < r->options_size; pos += strlen(r->options + pos) + 1 ) {
+		const char *s = r->options + pos;
+		if ( *s == 0 )
+			continue;
+		if ( !serve_option_allowed(s) ) {
+			fprintf(err, "Option %s can not be used with --serve\n", s);
+			return 0;
+		}
+		switch ( parse_context_option(s, ctx, err) ) {
+			case PARSE_OK:
+				continue;
+			case PARSE_UNKNOWN:
+				fprintf(err, "Unknown option %s\n", s);
+				// fall through
+			default:
+				return 0;
+		}
+	}
+
+	if ( ctx->video && !ctx->dump_frames ) {
+		fputs("Videos can not be played with --serve, use --dump-frames.\n", err);
+		return 0;
+	}
+
+	if ( (ctx->width != width && ctx->width > SERVE_MAX_SIZE) || (ctx->height != height && ctx->height > SERVE_MAX_SIZE) ) {
+		fprintf(err, "Width and height can be at most %d with --serve.\n", SERVE_MAX_SIZE);
+		return 0;
+	}
+
+	if ( !finish_options(ctx, 0, err) ) {
+		jp2a_context_free(ctx);
+		return 0;
+	}
+	if ( render_threads(ctx) > max_threads )
+		ctx->threads = max_threads;
+	return 1;
+}
+
+int serve_convert(const jp2a_context *ctx, const serve_request *r, FILE *fout, FILE *err) {
+	int status = SERVE_FAILED;
+
+	if ( ctx->html && !ctx->html_rawoutput ) print_html_document_start(ctx, ctx->html_fontsize, fout);
+	else if ( ctx->xhtml && !ctx->html_rawoutput ) print_xhtml_document_start(ctx, ctx->html_fontsize, fout);
+
+	FILE *fin = r->image_size > 0 ? fmemopen(r->image, r->image_size, "rb") : NULL;
+	if ( fin != NULL ) {
+		if ( jp2a_render(ctx, fin, fout, err) )
+			status = SERVE_OK;
+		fclose(fin);
+	}
+
+	if ( ctx->html && !ctx->html_rawoutput ) print_html_document_end(fout);
+	else if ( ctx->xhtml && !ctx->html_rawoutput ) print_xhtml_document_end(fout);
+	return status;
+}
+
+void serve_connection(const serve_server *server, const int fd) {
+	serve_request r;
+	jp2a_context ctx;
+
+	while ( serve_read_request(fd, &r) ) {
+		char *output = NULL;
+		size_t output_size = 0;
+		int status;
+
+		FILE *mem = open_memstream(&output, &output_size);
+		if ( mem == NULL ) {
+			serve_free_request(&r);
+			break;
+		}
+
+		// error messages of the options and the decoders are the reply of a failed request, otherwise they are not sent
+		char *errors = NULL;
+		size_t errors_size = 0;
+		FILE *err = open_memstream(&errors, &errors_size);
+		if ( err == NULL ) {
+			fclose(mem);
+			free(output);
+			serve_free_request(&r);
+			break;
+		}
+
+		if ( serve_context(server, &r, &ctx, err) ) {
+			status = serve_convert(&ctx, &r, mem, err);
+			jp2a_context_free(&ctx);
+		} else {
+			status = SERVE_INVALID;
+		}
+		fclose(err);
+		fclose(mem);
+		serve_free_request(&r);
+
+		const char *reply = status != SERVE_OK ? errors : output;
+		const size_t reply_size = status != SERVE_OK ? errors_size : output_size;
+		const int sent = serve_write_number(fd, status) && serve_write_number(fd, reply_size) && serve_write(fd, reply, reply_size);
+		free(errors);
+		free(output);
+		if ( !sent )
+			break;
+	}
+
+	close(fd);
+}
+
+void *serve_worker(void *arg) {
+	const serve_server *server = (const serve_server*) arg;
+
+	for ( ;; ) {
+		const int fd = accept(server->fd, NULL, NULL);
+		if ( fd < 0 ) {
+			if ( errno == EINTR || errno == ECONNABORTED )
+				continue;
+			// too many open connections or not enough memory: try again when other connections are closed
+			if ( errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM ) {
+				struct timespec delay = { 0, 100000000 };
+				nanosleep(&delay, NULL);
+				continue;
+			}
+			fprintf(stderr, "Could not accept a connection: %s\n", strerror(errno));
+			return NULL;
+		}
+		serve_connection(server, fd);
+	}
+}
+
+void serve_stop(int sig) {
+	(void) sig;
+	if ( serve_socket != NULL )
+		unlink(serve_socket);
+	_exit(0);
+}
+
+int serve(const char *path, int argc, char **argv, const int threads) {
+	serve_server server;
+	struct sockaddr_un addr;
+	struct stat st;
+
+	server.argc = argc;
+	server.argv = argv;
+
+	// check the defaults of the requests once, so the server does not start with invalid options
+	{
+		serve_request r;
+		jp2a_context ctx;
+		r.options = "";
+		r.options_size = 0;
+		if ( !serve_context(&server, &r, &ctx, stderr) )
+			return 1;
+		jp2a_context_free(&ctx);
+	}
+
+	// the socket is bound to a temporary name and renamed when it listens, so clients can connect as soon as it exists
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if ( snprintf(addr.sun_path, sizeof(addr.sun_path), "%s.%ld", path, (long) getpid()) >= (int) sizeof(addr.sun_path) ) {
+		fprintf(stderr, "Socket path '%s' is too long.\n", path);
+		return 1;
+	}
+	if ( lstat(path, &st) == 0 && !S_ISSOCK(st.st_mode) ) {
+		fprintf(stderr, "'%s' exists and is not a socket.\n", path);
+		return 1;
+	}
+
+	server.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ( server.fd < 0 ) {
+		fprintf(stderr, "Could not create a socket: %s\n", strerror(errno));
+		return 1;
+	}
+	unlink(addr.sun_path);
+	if ( bind(server.fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(server.fd, SOMAXCONN) != 0
+		|| rename(addr.sun_path, path) != 0 ) {
+		fprintf(stderr, "Could not listen on '%s': %s\n", path, strerror(errno));
+		unlink(addr.sun_path);
+		close(server.fd);
+		return 1;
+	}
+
+	serve_socket = path;
+	signal(SIGINT, serve_stop);
+	signal(SIGTERM, serve_stop);
+	// clients that close the connection early must not stop the server
+	signal(SIGPIPE, SIG_IGN);
+
+	// the calling thread is one of the threads of the pool
+	for ( int n = 1; n < threads; ++n ) {
+		pthread_t thread;
+		if ( pthread_create(&thread, NULL, serve_worker, &server) != 0 )
+			break;
+		pthread_detach(thread);
+	}
+	serve_worker(&server);
+
+	unlink(path);
+	close(server.fd);
+	return 1;
+}
+
+unsigned char *connect_read_file(const char *name, size_t *size) {
+	unsigned char *data = NULL;
+	size_t allocated = 0;
+	size_t n;
+	FILE *f = name[0] == '-' && !name[1] ? stdin : fopen(name, "rb");
+
+	if ( f == NULL )
+		return NULL;
+
+	*size = 0;
+	for ( ;; ) {
+		if ( *size == allocated ) {
+			allocated = allocated ? allocated * 2 : 65536;
+			unsigned char *p = realloc(data, allocated);
+			if ( p == NULL ) {
+				free(data);
+				data = NULL;
+				break;
+			}
+			data = p;
+		}
+		n = fread(data + *size, 1, allocated - *size, f);
+		if ( n == 0 )
+			break;
+		*size += n;
+	}
+	if ( data != NULL && ferror(f) ) {
+		free(data);
+		data = NULL;
+	}
+	if ( f != stdin )
+		fclose(f);
+	return data;
+}
+
+int connect_convert(const char *path, int argc, char **argv, FILE *fout) {
+	struct sockaddr_un addr;
+	jp2a_context scratch;
+	char *options;
+	size_t options_size = 0;
+	int retval = 0;
+
+	// the conversion options are sent with every image, they were already checked by parse_options()
+	// options the server does not accept in requests, like --verbose, only concern this process
+	options = malloc(SERVE_MAX_OPTIONS);
+	if ( options == NULL ) {
+		fputs("Not enough memory.\n", stderr);
+		return 1;
+	}
+	jp2a_context_init(&scratch);
+	for ( int n = 1; n < argc; ++n ) {
+		const char *s = argv[n];
+		if ( s[0] != '-' || !s[1] || !serve_option_allowed(s) || parse_context_option(s, &scratch, stderr) != PARSE_OK )
+			continue;
+		if ( options_size + strlen(s) + 1 > SERVE_MAX_OPTIONS ) {
+			fputs("Too many options.\n", stderr);
+			free(options);
+			return 1;
+		}
+		strcpy(options + options_size, s);
+		options_size += strlen(s) + 1;
+	}
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if ( fd < 0 || connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 ) {
+		fprintf(stderr, "Could not connect to '%s': %s\n", path, strerror(errno));
+		if ( fd >= 0 )
+			close(fd);
+		free(options);
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	for ( int n = 1; n < argc; ++n ) {
+		// skip options
+		if ( argv[n][0]=='-' && argv[n][1] )
+			continue;
+
+		size_t size;
+		unsigned char *image = connect_read_file(argv[n], &size);
+		if ( image == NULL ) {
+			fprintf(stderr, "Can't open %s\n", argv[n]);
+			retval = 1;
+			break;
+		}
+		if ( size > SERVE_MAX_IMAGE ) {
+			fprintf(stderr, "%s is too large.\n", argv[n]);
+			free(image);
+			retval = 1;
+			continue;
+		}
+
+		uint32_t status, reply_size;
+		const int sent = serve_write_number(fd, options_size) && serve_write(fd, options, options_size)
+			&& serve_write_number(fd, size) && serve_write(fd, image, size);
+		free(image);
+		if ( !sent || !serve_read_number(fd, &status) || !serve_read_number(fd, &reply_size) ) {
+			fputs("The server closed the connection.\n", stderr);
+			retval = 1;
+			break;
+		}
+
+		char *reply = malloc(reply_size > 0 ? reply_size : 1);
+		if ( reply == NULL || !serve_read(fd, reply, reply_size) ) {
+			fputs("The server closed the connection.\n", stderr);
+			free(reply);
+			retval = 1;
+			break;
+		}
+		fwrite(reply, 1, reply_size, status != SERVE_OK ? stderr : fout);
+		free(reply);
+
+		if ( status != SERVE_OK ) {
+			retval = 1;
+			if ( status == SERVE_INVALID )
+				break;
+		}
+	}
+
+	close(fd);
+	jp2a_context_free(&scratch);
+	free(options);
+	return retval;
+}
+
+#endif
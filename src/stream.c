@@ -0,0 +1,190 @@
+/*
+ * Copyright 2026 Christoph Raitzig
+ * Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "jpeglib.h"
+#include "jerror.h"
+#include "png.h"
+
+#include "stream.h"
+
+void input_stream_init(input_stream *in, FILE *fp) {
+	input_stream_init_observed(in, fp, NULL, NULL);
+}
+
+void input_stream_init_observed(input_stream *in, FILE *fp, input_stream_observer observer, void *data) {
+	in->fp = fp;
+	in->observer = observer;
+	in->observer_data = data;
+	in->header_size = fread(in->header, 1, INPUT_STREAM_HEADER_SIZE, fp);
+	in->header_pos = 0;
+	if ( in->observer )
+		in->observer(in->observer_data, in->header, in->header_size);
+}
+
+int input_stream_read_rest(input_stream *in) {
+	unsigned char buffer[INPUT_STREAM_CHUNK_SIZE];
+
+	in->header_pos = in->header_size;
+	while ( input_stream_read(in, buffer, sizeof(buffer)) > 0 );
+	return !ferror(in->fp);
+}
+
+size_t input_stream_read(input_stream *in, void *buf, size_t size) {
+	size_t n = 0;
+	if ( in->header_pos < in->header_size ) {
+		n = in->header_size - in->header_pos;
+		if ( n > size )
+			n = size;
+		memcpy(buf, in->header + in->header_pos, n);
+		in->header_pos += n;
+	}
+	if ( n < size && in->header_size == INPUT_STREAM_HEADER_SIZE ) {
+		const size_t read = fread((char*) buf + n, 1, size - n, in->fp);
+		if ( in->observer )
+			in->observer(in->observer_data, (char*) buf + n, read);
+		n += read;
+	}
+	return n;
+}
+
+int input_stream_read_line(input_stream *in, char *buf, size_t size) {
+	size_t n = 0;
+	char c;
+
+	while ( input_stream_read(in, &c, 1) == 1 ) {
+		if ( c == '\n' ) {
+			buf[n] = 0;
+			return n;
+		}
+		if ( n + 1 >= size )
+			return -1;
+		buf[n++] = c;
+	}
+	return -1;
+}
+
+ImageFormat input_stream_format(const input_stream *in) {
+	const unsigned char *h = in->header;
+	if ( in->header_size >= 3 && h[0] == 0xFF && h[1] == 0xD8 && h[2] == 0xFF )
+		return FORMAT_JPEG;
+	if ( in->header_size >= 8 && memcmp(h, "\x89PNG\r\n\x1a\n", 8) == 0 )
+		return FORMAT_PNG;
+	if ( in->header_size >= 12 && memcmp(h, "RIFF", 4) == 0 && memcmp(h + 8, "WEBP", 4) == 0 )
+		return FORMAT_WEBP;
+	if ( in->header_size >= 10 && memcmp(h, "YUV4MPEG2 ", 10) == 0 )
+		return FORMAT_Y4M;
+	return FORMAT_UNKNOWN;
+}
+
+const char *image_format_name(ImageFormat format) {
+	switch ( format ) {
+		case FORMAT_JPEG:
+			return "JPEG";
+		case FORMAT_PNG:
+			return "PNG";
+		case FORMAT_WEBP:
+			return "WebP";
+		case FORMAT_Y4M:
+			return "Y4M";
+		default:
+			return "unknown";
+	}
+}
+
+void jpeg_input_stream_init_source(j_decompress_ptr jpg) {
+	(void) jpg;
+}
+
+boolean jpeg_input_stream_fill_input_buffer(j_decompress_ptr jpg) {
+	jpeg_input_stream_source *src = (jpeg_input_stream_source*) jpg->src;
+	size_t n = input_stream_read(src->in, src->buffer, INPUT_STREAM_CHUNK_SIZE);
+
+	if ( n == 0 ) {
+		WARNMS(jpg, JWRN_JPEG_EOF);
+		// insert a fake EOI marker
+		src->buffer[0] = (JOCTET) 0xFF;
+		src->buffer[1] = (JOCTET) JPEG_EOI;
+		n = 2;
+	}
+
+	src->pub.next_input_byte = src->buffer;
+	src->pub.bytes_in_buffer = n;
+	return TRUE;
+}
+
+int jpeg_input_stream_next_image(j_decompress_ptr jpg) {
+	jpeg_input_stream_source *src = (jpeg_input_stream_source*) jpg->src;
+
+	for ( ;; ) {
+		if ( src->pub.bytes_in_buffer == 0 ) {
+			src->pub.next_input_byte = src->buffer;
+			src->pub.bytes_in_buffer = input_stream_read(src->in, src->buffer, INPUT_STREAM_CHUNK_SIZE);
+			if ( src->pub.bytes_in_buffer == 0 )
+				return 0;
+		}
+		if ( src->pub.next_input_byte[0] == 0xFF ) {
+			if ( src->pub.bytes_in_buffer == 1 ) {
+				// the marker continues in the next chunk
+				src->buffer[0] = 0xFF;
+				src->pub.next_input_byte = src->buffer;
+				src->pub.bytes_in_buffer = 1 + input_stream_read(src->in, src->buffer + 1, INPUT_STREAM_CHUNK_SIZE - 1);
+				if ( src->pub.bytes_in_buffer == 1 )
+					return 0;
+				continue;
+			}
+			if ( src->pub.next_input_byte[1] == JPEG_SOI )
+				return 1;
+		}
+		++src->pub.next_input_byte;
+		--src->pub.bytes_in_buffer;
+	}
+}
+
+void jpeg_input_stream_skip_input_data(j_decompress_ptr jpg, long num_bytes) {
+	struct jpeg_source_mgr *src = jpg->src;
+
+	if ( num_bytes <= 0 )
+		return;
+	while ( num_bytes > (long) src->bytes_in_buffer ) {
+		num_bytes -= (long) src->bytes_in_buffer;
+		(void) (*src->fill_input_buffer) (jpg);
+	}
+	src->next_input_byte += (size_t) num_bytes;
+	src->bytes_in_buffer -= (size_t) num_bytes;
+}
+
+void jpeg_input_stream_term_source(j_decompress_ptr jpg) {
+	(void) jpg;
+}
+
+void jpeg_input_stream_src(j_decompress_ptr jpg, input_stream *in) {
+	jpeg_input_stream_source *src;
+
+	src = (jpeg_input_stream_source*) (*jpg->mem->alloc_small) ((j_common_ptr) jpg, JPOOL_PERMANENT, sizeof(jpeg_input_stream_source));
+	src->buffer = (JOCTET*) (*jpg->mem->alloc_small) ((j_common_ptr) jpg, JPOOL_PERMANENT, INPUT_STREAM_CHUNK_SIZE * sizeof(JOCTET));
+	src->in = in;
+	src->pub.init_source = jpeg_input_stream_init_source;
+	src->pub.fill_input_buffer = jpeg_input_stream_fill_input_buffer;
+	src->pub.skip_input_data = jpeg_input_stream_skip_input_data;
+	src->pub.resync_to_restart = jpeg_resync_to_restart;
+	src->pub.term_source = jpeg_input_stream_term_source;
+	src->pub.bytes_in_buffer = 0;
+	src->pub.next_input_byte = NULL;
+	jpg->src = (struct jpeg_source_mgr*) src;
+}
+
+void png_input_stream_read(png_structp png_ptr, png_bytep data, png_size_t length) {
+	input_stream *in = (input_stream*) png_get_io_ptr(png_ptr);
+	if ( input_stream_read(in, data, length) != length )
+		png_error(png_ptr, "Read Error");
+}
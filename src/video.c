@@ -0,0 +1,436 @@
+/*
+ * Copyright 2026 Christoph Raitzig
+ * Distributed under the GNU General Public License (GPL) v2.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <errno.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#include <setjmp.h>
+
+#include "jpeglib.h"
+
+#include "aspect_ratio.h"
+#include "delta.h"
+#include "image.h"
+#include "stream.h"
+#include "video.h"
+
+#define CLAMP_BYTE(x) ( (x) < 0 ? 0 : ( (x) > 255 ? 255 : (x) ) )
+
+double frame_clock_now(void) {
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec now;
+	if ( clock_gettime(CLOCK_MONOTONIC, &now) == 0 )
+		return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+#endif
+	return 0.0;
+}
+
+void frame_clock_init(frame_clock *clock, float fps) {
+	clock->interval = fps > 0.0f ? 1.0 / fps : 0.0;
+	clock->next = 0.0;
+}
+
+float video_fps(const jp2a_context *ctx, const float rate) {
+	if ( ctx->dump_frames )
+		return 0.0f;
+	// --fps overrides the frame rate of the video
+	return ctx->fps > 0.0f ? ctx->fps : rate;
+}
+
+void frame_clock_wait(frame_clock *clock) {
+	double now;
+
+	if ( clock->interval <= 0.0 )
+		return;
+
+	now = frame_clock_now();
+	if ( now < clock->next ) {
+#ifdef HAVE_NANOSLEEP
+		double wait = clock->next - now;
+		struct timespec delay;
+		delay.tv_sec = (time_t) wait;
+		delay.tv_nsec = (long) ((wait - (double) delay.tv_sec) * 1e9);
+		while ( nanosleep(&delay, &delay) == -1 && errno == EINTR )
+			;
+#endif
+		clock->next += clock->interval;
+	} else if ( now - clock->next > clock->interval ) {
+		// first frame or too slow, start over
+		clock->next = now + clock->interval;
+	} else {
+		clock->next += clock->interval;
+	}
+}
+
+void play_mjpeg(const jp2a_context *ctx, input_stream *in, FILE *fout, error_collector *errors) {
+	my_jpeg_error_mgr jerr;
+	struct jpeg_decompress_struct jpg;
+	Image image;
+	delta_grid delta;
+	frame_clock clock;
+
+	empty_image(&image);
+	delta_grid_init(&delta);
+	if ( uses_delta(ctx) )
+		image.delta = &delta;
+	frame_clock_init(&clock, video_fps(ctx, 0.0f));
+	jpg.err = jpeg_std_error(&jerr.pub);
+	jerr.pub.error_exit = jpeg_error_exit;
+	jerr.pub.output_message = jpeg_output_message;
+	jerr.err = errors->err;
+	if ( setjmp(jerr.setjmp_buffer) ) {
+		errors->jpeg_error = &jerr;
+		errors->jpeg_status = 1;
+		jpeg_destroy_decompress(&jpg);
+		free_image(&image);
+		delta_grid_free(&delta);
+		print_errors(errors);
+		return;
+	}
+	jpeg_create_decompress(&jpg);
+	jpeg_input_stream_src(&jpg, in);
+	jpeg_save_markers(&jpg, JPEG_APP0 + 1, 0xffff);
+
+	while ( jpeg_input_stream_next_image(&jpg) ) {
+		frame_clock_wait(&clock);
+		if ( !decompress_jpeg_frame(ctx, &jpg, &image, fout, NULL, errors->err) ) {
+			// the message was printed already
+			errors->jpeg_status = 1;
+			break;
+		}
+		fflush(fout);
+	}
+
+	free_image(&image);
+	delta_grid_free(&delta);
+	jpeg_destroy_decompress(&jpg);
+}
+
+void play_webp(const jp2a_context *ctx, const uint8_t *data, const size_t size, FILE *fout, FILE *image_out, error_collector *errors) {
+	WebPData webp_data;
+	WebPAnimDecoderOptions options;
+	WebPAnimDecoder *dec;
+	WebPAnimInfo info;
+	Image image;
+	delta_grid delta;
+	frame_clock clock;
+	uint8_t *canvas;
+	int width, height;
+	int timestamp, previous = 0;
+
+	WebPDataInit(&webp_data);
+	webp_data.bytes = data;
+	webp_data.size = size;
+	WebPAnimDecoderOptionsInit(&options);
+	options.color_mode = MODE_RGBA;
+	options.use_threads = 0;
+
+	dec = WebPAnimDecoderNew(&webp_data, &options);
+	if ( dec == NULL || !WebPAnimDecoderGetInfo(dec, &info) ) {
+		errors->webp_error_msg = "Error decoding WebP animation";
+		errors->webp_status = 1;
+		WebPAnimDecoderDelete(dec);
+		print_errors(errors);
+		return;
+	}
+
+	aspect_ratio(ctx, info.canvas_width, info.canvas_height, 0, &width, &height);
+	if ( ctx->verbose ) {
+		fprintf(stderr, "Animation frames: %u\n", info.frame_count);
+		fprintf(stderr, "Animation loop count: %u\n", info.loop_count);
+	}
+	if ( height == 0 || width == 0 ) {
+		WebPAnimDecoderDelete(dec);
+		return;
+	}
+
+	empty_image(&image);
+	delta_grid_init(&delta);
+	if ( ctx->video && uses_delta(ctx) )
+		image.delta = &delta;
+	frame_clock_init(&clock, video_fps(ctx, 0.0f));
+
+	while ( WebPAnimDecoderHasMoreFrames(dec) ) {
+		if ( !WebPAnimDecoderGetNext(dec, &canvas, &timestamp) ) {
+			errors->webp_error_msg = "Error decoding a frame of a WebP animation";
+			errors->webp_status = 1;
+			print_errors(errors);
+			break;
+		}
+		if ( ctx->video ) {
+			// the timestamp is when the frame ends, show it until then unless the frame rate is fixed
+			if ( !ctx->dump_frames && ctx->fps <= 0.0f )
+				clock.interval = (double) (timestamp - previous) / 1000.0;
+			frame_clock_wait(&clock);
+		}
+		previous = timestamp;
+
+		// the messages of these errors are printed right away
+		if ( !reuse_image(ctx, &image, width, height, 0, 1, errors->err) ) {
+			errors->webp_status = 1;
+			break;
+		}
+		clear(ctx, &image);
+		if ( !init_image(&image, info.canvas_width, info.canvas_height, 0, errors->err) ) {
+			errors->webp_status = 1;
+			break;
+		}
+		for ( int y = 0; y < (int) info.canvas_height; y = resample_next_row(ctx, &image, y) )
+			process_scanline_png(ctx, canvas + (size_t) y * info.canvas_width * 4, y, 4, &image);
+		if ( !print_image(ctx, &image, fout, image_out, errors->err) ) {
+			errors->webp_status = 1;
+			break;
+		}
+
+		if ( !ctx->video )
+			break;
+		fflush(fout);
+	}
+
+	free_image(&image);
+	delta_grid_free(&delta);
+	WebPAnimDecoderDelete(dec);
+}
+
+int y4m_read_header(input_stream *in, y4m_stream *y4m, error_collector *errors) {
+	char line[Y4M_LINE_MAX];
+	const char *chroma = "420jpeg";
+	char *p;
+
+	y4m->width = y4m->height = 0;
+	y4m->fps = 0.0f;
+	y4m->frame = NULL;
+
+	if ( input_stream_read_line(in, line, sizeof(line)) < 0 || strncmp(line, "YUV4MPEG2 ", 10) != 0 ) {
+		errors->y4m_error_msg = "Not a Y4M stream: Invalid header";
+		errors->y4m_status = 1;
+		return 0;
+	}
+
+	// the header consists of parameters separated by spaces, the first character tells which one
+	for ( p = line + 10; *p; ) {
+		char *end = strchr(p, ' ');
+		if ( end )
+			*end = 0;
+		switch ( *p ) {
+			case 'W':
+				y4m->width = atoi(p + 1);
+				break;
+			case 'H':
+				y4m->height = atoi(p + 1);
+				break;
+			case 'F': {
+				int num, den;
+				if ( sscanf(p + 1, "%d:%d", &num, &den) == 2 && num > 0 && den > 0 )
+					y4m->fps = (float) num / (float) den;
+				break;
+			}
+			case 'C':
+				chroma = p + 1;
+				break;
+		}
+		p = end ? end + 1 : p + strlen(p);
+	}
+
+	if ( y4m->width <= 0 || y4m->height <= 0 || y4m->width > 65536 || y4m->height > 65536 ) {
+		errors->y4m_error_msg = "Invalid Y4M frame dimensions";
+		errors->y4m_status = 1;
+		return 0;
+	}
+
+	if ( !strcmp(chroma, "420") || !strcmp(chroma, "420jpeg") || !strcmp(chroma, "420paldv") || !strcmp(chroma, "420mpeg2") ) {
+		y4m->chroma = Y4M_420;
+		y4m->chroma_width = (y4m->width + 1) / 2;
+		y4m->chroma_height = (y4m->height + 1) / 2;
+	} else if ( !strcmp(chroma, "422") ) {
+		y4m->chroma = Y4M_422;
+		y4m->chroma_width = (y4m->width + 1) / 2;
+		y4m->chroma_height = y4m->height;
+	} else if ( !strcmp(chroma, "444") ) {
+		y4m->chroma = Y4M_444;
+		y4m->chroma_width = y4m->width;
+		y4m->chroma_height = y4m->height;
+	} else if ( !strcmp(chroma, "mono") ) {
+		y4m->chroma = Y4M_MONO;
+		y4m->chroma_width = y4m->chroma_height = 0;
+	} else {
+		errors->y4m_error_msg = "Unsupported Y4M color space, only 8-bit 420, 422, 444 and mono are supported";
+		errors->y4m_status = 1;
+		return 0;
+	}
+
+	y4m->frame_size = (size_t) y4m->width * y4m->height + 2 * (size_t) y4m->chroma_width * y4m->chroma_height;
+	y4m->frame = (unsigned char*) malloc(y4m->frame_size);
+	if ( !y4m->frame ) {
+		errors->y4m_error_msg = "Not enough memory for a Y4M frame";
+		errors->y4m_status = 1;
+		return 0;
+	}
+	return 1;
+}
+
+int y4m_read_frame(input_stream *in, y4m_stream *y4m, error_collector *errors) {
+	char line[Y4M_LINE_MAX];
+
+	if ( input_stream_read_line(in, line, sizeof(line)) < 0 )
+		return 0;
+	if ( strncmp(line, "FRAME", 5) != 0 || (line[5] != 0 && line[5] != ' ') ) {
+		errors->y4m_error_msg = "Invalid Y4M frame header";
+		errors->y4m_status = 1;
+		return 0;
+	}
+	if ( input_stream_read(in, y4m->frame, y4m->frame_size) != y4m->frame_size ) {
+		errors->y4m_error_msg = "Y4M frame is truncated";
+		errors->y4m_status = 1;
+		return 0;
+	}
+	return 1;
+}
+
+void y4m_row_to_rgb(const y4m_stream *y4m, const int y, unsigned char *row) {
+	const unsigned char *luma = y4m->frame + (size_t) y * y4m->width;
+	const unsigned char *cb = NULL;
+	const unsigned char *cr = NULL;
+	const int shift_x = y4m->chroma == Y4M_420 || y4m->chroma == Y4M_422;
+
+	if ( y4m->chroma != Y4M_MONO ) {
+		const int cy = y4m->chroma == Y4M_420 ? y / 2 : y;
+		cb = y4m->frame + (size_t) y4m->width * y4m->height + (size_t) cy * y4m->chroma_width;
+		cr = cb + (size_t) y4m->chroma_width * y4m->chroma_height;
+	}
+
+	// BT.601 in 8.8 fixed point
+	for ( int x = 0; x < y4m->width; ++x ) {
+		const int c = 298 * (luma[x] - 16) + 128;
+		const int d = cb ? cb[x >> shift_x] - 128 : 0;
+		const int e = cr ? cr[x >> shift_x] - 128 : 0;
+		const int r = (c + 409 * e) >> 8;
+		const int g = (c - 100 * d - 208 * e) >> 8;
+		const int b = (c + 516 * d) >> 8;
+
+		row[0] = CLAMP_BYTE(r);
+		row[1] = CLAMP_BYTE(g);
+		row[2] = CLAMP_BYTE(b);
+		row += 3;
+	}
+}
+
+int y4m_print_frame(const jp2a_context *ctx, const y4m_stream *y4m, Image *image, unsigned char *row, FILE *fout, FILE *image_out, FILE *err) {
+	int width, height;
+
+	aspect_ratio(ctx, y4m->width, y4m->height, 0, &width, &height);
+
+	if ( ctx->verbose ) print_info_y4m(ctx, y4m, width, height);
+
+	if ( height == 0 || width == 0 )
+		return 0;
+	if ( !reuse_image(ctx, image, width, height, 0, 0, err) )
+		return 0;
+	clear(ctx, image);
+	if ( !init_image(image, y4m->width, y4m->height, 0, err) )
+		return 0;
+
+	// with --row-step the skipped lines are not converted
+	for ( int y = 0; y < y4m->height; y = resample_next_row(ctx, image, y) ) {
+		y4m_row_to_rgb(y4m, y, row);
+		process_scanline_png(ctx, row, y, 3, image);
+		if ( ctx->verbose )
+			print_progress((float) (y + 1) / (float) y4m->height);
+	}
+
+	return print_image(ctx, image, fout, image_out, err);
+}
+
+void print_info_y4m(const jp2a_context *ctx, const y4m_stream *y4m, const int width, const int height) {
+	fprintf(stderr, "Source width: %d\n", y4m->width);
+	fprintf(stderr, "Source height: %d\n", y4m->height);
+	switch ( y4m->chroma ) {
+		case Y4M_420:
+			fprintf(stderr, "Source chroma subsampling: 4:2:0\n");
+			break;
+		case Y4M_422:
+			fprintf(stderr, "Source chroma subsampling: 4:2:2\n");
+			break;
+		case Y4M_444:
+			fprintf(stderr, "Source chroma subsampling: 4:4:4\n");
+			break;
+		case Y4M_MONO:
+			fprintf(stderr, "Source chroma subsampling: None (mono)\n");
+			break;
+	}
+	if ( y4m->fps > 0.0f )
+		fprintf(stderr, "Source frame rate: %.3f\n", y4m->fps);
+	fprintf(stderr, "Output width: %d\n", width);
+	fprintf(stderr, "Output height: %d\n", height);
+	fprintf(stderr, "Output palette (%d chars): '%s'\n", ctx->ascii_palette_length, ctx->ascii_palette);
+}
+
+void decompress_y4m(const jp2a_context *ctx, input_stream *in, FILE *fout, FILE *image_out, error_collector *errors) {
+	y4m_stream y4m;
+	Image image;
+	unsigned char *row;
+	delta_grid delta;
+	frame_clock clock;
+	int frame = 0;
+	int printed = 1;
+
+	if ( !y4m_read_header(in, &y4m, errors) ) {
+		free(y4m.frame);
+		print_errors(errors);
+		return;
+	}
+	row = (unsigned char*) malloc((size_t) y4m.width * 3);
+	if ( !row ) {
+		fprintf(errors->err, "Not enough memory for a Y4M frame\n");
+		errors->y4m_status = 1;
+		free(y4m.frame);
+		return;
+	}
+
+	empty_image(&image);
+	delta_grid_init(&delta);
+	if ( ctx->video && uses_delta(ctx) )
+		image.delta = &delta;
+	frame_clock_init(&clock, video_fps(ctx, y4m.fps));
+
+	while ( y4m_read_frame(in, &y4m, errors) ) {
+		if ( ctx->video )
+			frame_clock_wait(&clock);
+		++frame;
+		printed = y4m_print_frame(ctx, &y4m, &image, row, fout, image_out, errors->err);
+		if ( !printed || !ctx->video )
+			break;
+		fflush(fout);
+	}
+
+	if ( frame == 0 && !errors->y4m_status ) {
+		errors->y4m_error_msg = "Y4M stream contains no frames";
+		errors->y4m_status = 1;
+	}
+	if ( errors->y4m_status )
+		print_errors(errors);
+	// the message of a frame that could not be printed was printed right away
+	if ( !printed )
+		errors->y4m_status = 1;
+
+	free_image(&image);
+	delta_grid_free(&delta);
+	free(row);
+	free(y4m.frame);
+}
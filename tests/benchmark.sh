@@ -0,0 +1,84 @@
+#!/bin/bash
+
+# Copyright 2026 Christoph Raitzig
+#
+# Measures how fast jp2a prints colored output and downscales images.
+#
+# Usage: ./benchmark.sh [jp2a executable ...]
+#
+# Every given executable (default: ../src/jp2a) converts the same image
+# repeatedly with each color depth. The amount of output and the time taken
+# are printed, so two builds can be compared by passing both executables.
+#
+# Afterwards every executable downscales the frames of a large Y4M video
+# of noise, which hardly takes any time to decode, and the number of source
+# megapixels per second is printed.
+
+## NUMBER OF CONVERSIONS PER MEASUREMENT
+RUNS=${RUNS:-50}
+## IMAGE AND OUTPUT SIZE
+IMAGE=${IMAGE:-grind.jpg}
+SIZE=${SIZE:-300x100}
+## SIZE AND NUMBER OF FRAMES OF THE VIDEO FOR RESAMPLING
+VIDEO_WIDTH=${VIDEO_WIDTH:-1920}
+VIDEO_HEIGHT=${VIDEO_HEIGHT:-1080}
+VIDEO_FRAMES=${VIDEO_FRAMES:-20}
+
+export LC_ALL=C
+export COLORTERM=truecolor
+
+if test $# -eq 0 ; then
+	set -- ../src/jp2a
+fi
+
+function benchmark() {
+	local JP=${1}
+	shift
+	local BYTES=`${JP} --size=${SIZE} "$@" ${IMAGE} | wc -c`
+	local START=`date +%s%N`
+	for (( i = 0; i < RUNS; i++ )) ; do
+		${JP} --size=${SIZE} "$@" ${IMAGE} > /dev/null
+	done
+	local END=`date +%s%N`
+	awk -v args="$*" -v bytes=${BYTES} -v runs=${RUNS} -v ns=$(( END - START )) 'BEGIN {
+		if ( ns == 0 ) ns = 1
+		printf "  %-28s %9d bytes %8.2f ms %9.2f MB/s\n", args, bytes, ns / runs / 1000000, bytes * runs * 1000 / ns
+	}'
+}
+
+function benchmark_resampling() {
+	local JP=${1}
+	shift
+	local START=`date +%s%N`
+	${JP} --dump-frames --size=80x40 "$@" ${VIDEO} > /dev/null
+	local END=`date +%s%N`
+	awk -v args="$*" -v pixels=$(( VIDEO_WIDTH * VIDEO_HEIGHT * VIDEO_FRAMES )) -v ns=$(( END - START )) 'BEGIN {
+		if ( ns == 0 ) ns = 1
+		printf "  %-28s %8.2f ms %9.2f MP/s\n", args, ns / 1000000, pixels * 1000 / ns
+	}'
+}
+
+for JP in "$@" ; do
+	echo "${JP}: ${RUNS} runs, ${IMAGE} at ${SIZE}"
+	benchmark ${JP} --color-depth=4
+	benchmark ${JP} --color-depth=8
+	benchmark ${JP} --color-depth=24
+	benchmark ${JP} --color-depth=24 --fill
+	benchmark ${JP} --htmlls --color-depth=24
+done
+
+VIDEO=`mktemp`
+trap 'rm -f "${VIDEO}"' EXIT
+{
+	echo "YUV4MPEG2 W${VIDEO_WIDTH} H${VIDEO_HEIGHT} F25:1 C444"
+	for (( i = 0; i < VIDEO_FRAMES; i++ )) ; do
+		echo "FRAME"
+		head -c $(( VIDEO_WIDTH * VIDEO_HEIGHT * 3 )) /dev/urandom
+	done
+} > ${VIDEO}
+
+for JP in "$@" ; do
+	echo "${JP}: resampling ${VIDEO_FRAMES} frames of ${VIDEO_WIDTH}x${VIDEO_HEIGHT} to 80x40"
+	benchmark_resampling ${JP}
+	benchmark_resampling ${JP} --colors
+done
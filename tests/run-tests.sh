@@ -95,17 +95,47 @@ test_jp2a "invert, border" "-i -b --width=110 --height=30 jp2a.jpg" 110x30-i-b.t
 test_jp2a "width, flip, invert" "--width=78 --flipx --flipy --invert jp2a.jpg" flip-xy-invert.txt
 test_jp2a "width, border" "--width=78 -b jp2a.jpg jp2a.jpg" 2xnormal-b.txt
 test_jp2a "width, verbose" "--verbose --width=78 jp2a.jpg 2>&1 | tr -d '\r'" normal-verbose.txt
+test_jp2a "size, verbose, JPEG downscaling" "--verbose --size=40x15 grind.jpg 2>&1 >/dev/null | tr -d '\r'" grind-verbose-scale.txt
+test_jp2a "size, color, progressive JPEG, only needed scans" "--size=40x15 --colors grind-progressive.jpg" grind-progressive.txt
+test_jp2a "size, color, sequential JPEG with one scan per component" "--size=40x15 --colors grind-multiscan.jpg" grind-multiscan.txt
 
 TEMPFILE=`mktemp /tmp/jp2a-test-XXXXXX`
 test_jp2a "width, outfile" "--width=78 jp2a.jpg --output=${TEMPFILE} && cat ${TEMPFILE}" normal.txt
 rm -f ${TEMPFILE}
 
+test_jp2a "width, border, jobs" "--jobs=4 --width=78 -b jp2a.jpg jp2a.jpg" 2xnormal-b.txt
+test_jp2a "big size, jobs" "-j2 --size=2000x2000 dalsnuten-640x480-gray-low.jpg jp2a.jpg | tr -d '\r' | wc -c | tr -d ' '" dalsnuten-jp2a-2000x2000-md5.txt
+TEMPDIR=`mktemp -d /tmp/jp2a-test-XXXXXX`
+test_jp2a "width, output-dir, jobs" "--width=78 --jobs=2 --output-dir=${TEMPDIR} grind.jpg jp2a.jpg && cat ${TEMPDIR}/jp2a.txt" normal.txt
+test_jp2a "width, output-dir, same output file" "--width=78 --output-dir=${TEMPDIR} jp2a.jpg ../tests/jp2a.jpg 2>&1 | sed s,${TEMPDIR},DIR," output-dir-same-file.txt
+rm -rf ${TEMPDIR}
+
+TEMPDIR=`mktemp -d /tmp/jp2a-test-XXXXXX`
+test_jp2a "width, cache-dir" "--width=78 --cache-dir=${TEMPDIR} jp2a.jpg >/dev/null && ${JP} --width=78 --cache-dir=${TEMPDIR} jp2a.jpg" normal.txt
+test_jp2a "width, cache-dir, other options" "--width=78 --invert --cache-dir=${TEMPDIR} jp2a.jpg >/dev/null && ${JP} --width=78 --cache-dir=${TEMPDIR} jp2a.jpg" normal.txt
+test_jp2a "size, invert, cache-dir, downscaled image" "--size=80x30 --cache-dir=${TEMPDIR} grind.jpg >/dev/null && ${JP} grind.jpg -i --size=80x30 --cache-dir=${TEMPDIR}" grind.txt
+rm -rf ${TEMPDIR}
+
+if ${JP} --help 2>&1 | grep -q -- --serve ; then
+	SOCKET=`mktemp -u /tmp/jp2a-test-XXXXXX`
+	${JP} --serve=${SOCKET} --jobs=2 --width=78 &
+	SERVER=$!
+	for i in `seq 50`; do test -S ${SOCKET} && break; sleep 0.1; done
+	test_jp2a "width, serve" "--connect=${SOCKET} jp2a.jpg" normal.txt
+	test_jp2a "width, border, serve" "--connect=${SOCKET} -b jp2a.jpg jp2a.jpg" 2xnormal-b.txt
+	test_jp2a "Exif orientation 5, color, serve" "--connect=${SOCKET} --color --color-depth=24 jp2a-colorful-horizontal-270.jpg" jp2a-colorful-horizontal-270.txt
+	test_jp2a "width, verbose, serve" "--connect=${SOCKET} -v jp2a.jpg" normal.txt
+	test_jp2a "unknown format, serve" "--connect=${SOCKET} run-tests.sh 2>&1" serve-unknown-format.txt
+	kill ${SERVER}
+fi
+
 test_jp2a "width, clear" "--width=78 jp2a.jpg --clear" normal-clear.txt
 test_jp2a "height, grayscale" "logo-40x25-gray.jpg --height=30" logo-30.txt
 test_jp2a "size, invert" "grind.jpg -i --size=80x30" grind.txt
 test_jp2a "size, invert, red channel" "grind.jpg -i --size=80x30 --red=1.0 --green=0.0 --blue=0.0" grind-red.txt
 test_jp2a "size, invert, blue channel" "grind.jpg -i --size=80x30 --red=0.0 --green=1.0 --blue=0.0" grind-green.txt
 test_jp2a "size, invert, green channel" "grind.jpg -i --size=80x30 --red=0.0 --green=0.0 --blue=1.0" grind-blue.txt
+test_jp2a "size, invert, row step" "grind.jpg -i --size=80x30 --row-step=4" grind-row-step.txt
 test_jp2a "width, grayscale" "--width=78 dalsnuten-640x480-gray-low.jpg" dalsnuten-normal.txt
 test_jp2a "invert, width, grayscale" "--invert --width=78 dalsnuten-640x480-gray-low.jpg" dalsnuten-invert.txt
 test_jp2a "invert, size, grayscale" "--invert --size=80x49 dalsnuten-640x480-gray-low.jpg" dalsnuten-80x49-inv.txt
@@ -145,11 +175,14 @@ test_jp2a "color, xhtml, no-bold" "grind.jpg --colors --xhtml --html-no-bold --w
 test_jp2a "html-title, xhtml" "--width=10 --xhtml --html-title='just testing' jp2a.jpg" html-title.txt
 test_jp2a "html-title, html" "--size=80x50 --htmlls --html-title=\"C&amp;amp;\\\"&'<script>\" jp2a.jpg" html-title-entities.html
 test_jp2a "color, html-raw" "--width=10 --color --html-raw jp2a.jpg" html-raw.txt
+test_jp2a "color, html, classes, fill" "grind.jpg --color --fill --width=60 --htmlls --html-fontsize=8 --html-classes" grind-classes-fill.html
+test_jp2a "color, html, classes, fill, threads" "grind.jpg --color --fill --width=60 --htmlls --html-fontsize=8 --html-classes --threads=2" grind-classes-fill.html
 test_jp2a "color, ANSI" "grind.jpg --color-depth=4 --width=60" grind-color-ANSI.txt
 test_jp2a "color, ANSI, grayscale" "dalsnuten-640x480-gray-low.jpg --color-depth=4 --width=78" dalsnuten-color-ANSI.txt
 test_jp2a "color, 256 color palette" "grind.jpg --color-depth=8 --width=60" grind-color-256.txt
 test_jp2a "color, 256 color palette, grayscale" "dalsnuten-640x480-gray-low.jpg --color-depth=8 --width=78" dalsnuten-color-256.txt
 test_jp2a "color, truecolor" "grind.jpg --color-depth=24 --width=60" grind-color-truecolor.txt
+test_jp2a "color, truecolor, threads" "grind.jpg --color-depth=24 --width=60 --threads=3" grind-color-truecolor.txt
 test_jp2a "color, truecolor, grayscale" "dalsnuten-640x480-gray-low.jpg --color-depth=24 --width=78" dalsnuten-color-truecolor.txt
 test_jp2a "standard input, width" " 2>/dev/null ; cat jp2a.jpg | ${JP} --width=78 -" normal.txt
 test_jp2a "standard input, width, height" " 2>/dev/null ; cat jp2a.jpg | ${JP} - --width=40 --height=40" 40x40.txt
@@ -157,8 +190,17 @@ test_jp2a "big size" "--size=2000x2000 dalsnuten-640x480-gray-low.jpg jp2a.jpg |
 test_jp2a "PNG invert" "--invert --color --size=144x36 jp2a-colorful.png" jp2a-png-invert.txt
 test_jp2a "PNG colormap standard input" "2>/dev/null ; cat jp2a-colormap.png | ${JP} - --size=144x36" jp2a-png-colormap.txt
 test_jp2a "PNG interlaced 16-bit" "--size=300x150 --color jp2a-interlaced-16-bit.png" jp2a-png-interlaced-16-bit.txt
+test_jp2a "PNG interlaced 16-bit, row step" "--size=80x30 --color --row-step=3 jp2a-interlaced-16-bit.png" jp2a-png-interlaced-row-step.txt
 test_jp2a "WebP" "--width=78 jp2a.webp" jp2a-webp.txt
 test_jp2a "WebP scale up" "--width=120 jp2a.webp" jp2a-webp-scale-up.txt
+test_jp2a "WebP standard input" "2>/dev/null ; cat jp2a.webp | ${JP} --width=78 -" jp2a-webp.txt
+test_jp2a "WebP with .jpg extension" "--width=78 jp2a-webp-misnamed.jpg" jp2a-webp.txt
+test_jp2a "Y4M, first frame" "--width=30 grind.y4m" grind-y4m.txt
+test_jp2a "Y4M, video" "--video --fps=1000 --width=30 grind.y4m" grind-y4m-video.txt
+test_jp2a "Y4M, video, clear, only changed characters" "--video --fps=1000 --clear --colors --redraw-threshold=1 --width=30 grind.y4m" grind-y4m-delta.txt
+test_jp2a "Motion JPEG standard input, video" "2>/dev/null ; cat grind.jpg grind.jpg | ${JP} --video -i --size=80x30 -" grind-mjpeg.txt
+test_jp2a "WebP animation, first frame" "--width=30 grind-anim.webp" grind-anim-webp.txt
+test_jp2a "WebP animation, dump frames" "--dump-frames --width=30 grind-anim.webp" grind-anim-webp-frames.txt
 test_jp2a "size, curl download" "--size=454x207 https://jp2a.talinx.dev/jp2a.jpg" normal-curl.txt
 test_jp2a "very long jpg" "long.jpg" no-output.txt
 test_jp2a "very long png" "long.png" no-output.txt
@@ -172,7 +214,9 @@ test_jp2a "Exif orientation 8" "--width=78 jp2a-rotate-270.jpg" jp2a-rotate-270.
 test_jp2a "Exif orientation 5, color" "--width=78 --color --color-depth=24 jp2a-colorful-horizontal-270.jpg" jp2a-colorful-horizontal-270.txt
 test_jp2a "Exif orientation 2, flipx" "--width=78 --flipx jp2a-mirror-horizontal.jpg" jp2a-mirror-horizontal-flipx.txt
 test_jp2a "Exif orientation 6, flipy" "--width=78 --flipy jp2a-rotate-90.jpg" jp2a-rotate-90-flipy.txt
+test_jp2a "Exif orientation 6, standard input" "2>/dev/null ; cat jp2a-rotate-90.jpg | ${JP} --width=78 -" jp2a-rotate-90.txt
 test_jp2a "edges" "--width=128 --edge-threshold=0.3 jp2a.jpg" edges.txt
+test_jp2a "edges, threads" "--width=128 --edge-threshold=0.3 --threads=4 jp2a.jpg" edges.txt
 test_jp2a "edges only" "--width=128 --edge-threshold=0.3 --edges-only jp2a.jpg" edges-only.txt
 test_jp2a "edges only, invert" "--width=128 --edge-threshold=0.3 --edges-only --invert jp2a.jpg" edges-only-invert.txt
 